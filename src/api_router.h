@@ -0,0 +1,163 @@
+#pragma once
+// boost.beast будет использовать std::string_view вместо boost::string_view
+#define BOOST_BEAST_USE_STD_STRING_VIEW
+
+#include <boost/beast/http/verb.hpp>
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+#include <stdexcept>
+#include <string_view>
+
+namespace http_handler {
+
+namespace http = boost::beast::http;
+
+// Множество HTTP-методов, допустимых для маршрута
+class MethodMask {
+public:
+    constexpr MethodMask() = default;
+    constexpr MethodMask(std::initializer_list<http::verb> verbs) {
+        for(const auto verb : verbs) {
+            bits_ |= Bit(verb);
+        }
+    }
+
+    constexpr bool Contains(http::verb verb) const {
+        return (bits_ & Bit(verb)) != 0;
+    }
+
+private:
+    static constexpr std::uint64_t Bit(http::verb verb) {
+        return std::uint64_t{1} << static_cast<unsigned>(verb);
+    }
+
+    std::uint64_t bits_ = 0;
+};
+
+// Наибольшее число параметров в шаблоне пути
+inline constexpr std::size_t MAX_ROUTE_PARAMS = 2;
+using RouteParams = std::array<std::string_view, MAX_ROUTE_PARAMS>;
+
+// Шаблон пути состоит из сегментов вида /literal и /{}. Параметр {} совпадает
+// ровно с одним непустым сегментом пути
+constexpr bool IsValidRoutePattern(std::string_view pattern) {
+    if(pattern.empty()) {
+        return false;
+    }
+    std::size_t param_count = 0;
+    while(!pattern.empty()) {
+        if(pattern.front() != '/') {
+            return false;
+        }
+        pattern.remove_prefix(1);
+        const auto segment = pattern.substr(0, pattern.find('/'));
+        if(segment.empty() || (segment.find_first_of("{}?") != std::string_view::npos && segment != "{}")) {
+            return false;
+        }
+        if(segment == "{}" && ++param_count > MAX_ROUTE_PARAMS) {
+            return false;
+        }
+        pattern.remove_prefix(segment.size());
+    }
+    return true;
+}
+
+// Сопоставляет путь без строки запроса с корректным шаблоном. Литеральные части шаблона
+// сравниваются целиком, значения параметров записываются в params
+constexpr bool MatchRoutePattern(std::string_view pattern, std::string_view path, RouteParams& params) {
+    std::size_t param_count = 0;
+    while(true) {
+        const auto param_pos = pattern.find("{}");
+        const auto literal = pattern.substr(0, param_pos);
+        if(!path.starts_with(literal)) {
+            return false;
+        }
+        path.remove_prefix(literal.size());
+        if(param_pos == std::string_view::npos) {
+            return path.empty();
+        }
+        pattern.remove_prefix(param_pos + 2);
+        const auto value = path.substr(0, path.find('/'));
+        if(value.empty()) {
+            return false;
+        }
+        params[param_count++] = value;
+        path.remove_prefix(value.size());
+    }
+}
+
+// Таблица маршрутов, проверяемая при компиляции. Route - описание маршрута с полями
+// pattern (шаблон пути) и methods (MethodMask). Поиск не выделяет память:
+// параметры пути - это string_view на части цели запроса
+template <typename Route, std::size_t N>
+class RouteTable {
+public:
+    struct Match {
+        // nullptr - ни один шаблон не совпал с путём
+        const Route* route = nullptr;
+        bool is_method_allowed = false;
+        RouteParams params{};
+    };
+
+    consteval explicit RouteTable(const std::array<Route, N>& routes)
+        : routes_(routes) {
+        for(std::size_t i = 0; i < N; ++i) {
+            if(!IsValidRoutePattern(routes_[i].pattern)) {
+                throw std::logic_error("Invalid route pattern");
+            }
+            for(std::size_t j = 0; j < i; ++j) {
+                if(routes_[i].pattern == routes_[j].pattern) {
+                    throw std::logic_error("Duplicate route pattern");
+                }
+            }
+            path_sizes_[i] = GetPathSizeBounds(routes_[i].pattern);
+        }
+    }
+
+    // target может содержать строку запроса, она не участвует в сопоставлении
+    constexpr Match Find(std::string_view target, http::verb method) const {
+        const auto path = target.substr(0, target.find('?'));
+        Match match;
+        for(const auto& route : routes_) {
+            // Большинство маршрутов отсеиваются сравнением длин без обхода строк
+            const auto& bounds = path_sizes_[&route - routes_.data()];
+            if(path.size() < bounds.min || path.size() > bounds.max) {
+                continue;
+            }
+            if(MatchRoutePattern(route.pattern, path, match.params)) {
+                match.route = &route;
+                match.is_method_allowed = route.methods.Contains(method);
+                return match;
+            }
+            match.params = {};
+        }
+        return match;
+    }
+
+    constexpr const std::array<Route, N>& GetRoutes() const {
+        return routes_;
+    }
+
+private:
+    // Допустимые длины пути для шаблона: параметр занимает не меньше одного символа,
+    // а шаблон без параметров совпадает только с путём своей длины
+    struct PathSizeBounds {
+        std::size_t min = 0;
+        std::size_t max = 0;
+    };
+
+    static constexpr PathSizeBounds GetPathSizeBounds(std::string_view pattern) {
+        std::size_t param_count = 0;
+        for(auto pos = pattern.find("{}"); pos != std::string_view::npos; pos = pattern.find("{}", pos + 2)) {
+            ++param_count;
+        }
+        const auto min = pattern.size() - param_count;
+        return {min, param_count == 0 ? min : std::string_view::npos};
+    }
+
+    std::array<Route, N> routes_;
+    std::array<PathSizeBounds, N> path_sizes_{};
+};
+
+}  // namespace http_handler
@@ -0,0 +1,50 @@
+#pragma once
+#include "api_router.h"
+
+namespace http_handler {
+
+using namespace std::literals;
+
+// Где выполняется запрос к конечной точке API
+enum class ApiExecution {
+    // Неизменяемые данные и БД: в любом потоке без блокировок
+    ANY_THREAD,
+    // Чтение состояния игры: в любом потоке под блокировками на чтение
+    SHARED_READ,
+    // Команда игрока: в strand его игровой сессии
+    SESSION_STRAND,
+    // Изменение набора игроков и сессий, тик: последовательно внутри api_strand
+    API_STRAND
+};
+
+enum class ApiEndpoint {
+    JOIN,
+    PLAYERS,
+    GAME_STATE,
+    PLAYER_ACTION,
+    TICK,
+    MAPS,
+    MAP,
+    RECORDS
+};
+
+struct ApiRoute {
+    std::string_view pattern;
+    MethodMask methods;
+    ApiEndpoint endpoint;
+    ApiExecution execution;
+};
+
+// Маршруты HTTP API, по которым ApiHandler выбирает конечную точку и поток выполнения
+inline constexpr RouteTable API_ROUTES{std::array{
+    ApiRoute{"/api/v1/game/join"sv, {http::verb::post}, ApiEndpoint::JOIN, ApiExecution::API_STRAND},
+    ApiRoute{"/api/v1/game/players"sv, {http::verb::get, http::verb::head}, ApiEndpoint::PLAYERS, ApiExecution::SHARED_READ},
+    ApiRoute{"/api/v1/game/state"sv, {http::verb::get, http::verb::head}, ApiEndpoint::GAME_STATE, ApiExecution::SHARED_READ},
+    ApiRoute{"/api/v1/game/player/action"sv, {http::verb::post}, ApiEndpoint::PLAYER_ACTION, ApiExecution::SESSION_STRAND},
+    ApiRoute{"/api/v1/game/tick"sv, {http::verb::post}, ApiEndpoint::TICK, ApiExecution::API_STRAND},
+    ApiRoute{"/api/v1/maps"sv, {http::verb::get, http::verb::head}, ApiEndpoint::MAPS, ApiExecution::ANY_THREAD},
+    ApiRoute{"/api/v1/maps/{}"sv, {http::verb::get, http::verb::head}, ApiEndpoint::MAP, ApiExecution::ANY_THREAD},
+    ApiRoute{"/api/v1/game/records"sv, {http::verb::get}, ApiEndpoint::RECORDS, ApiExecution::ANY_THREAD},
+}};
+
+}  // namespace http_handler
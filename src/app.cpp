@@ -48,8 +48,13 @@ model::Map::Id Player::GetMapId() const {
 
 Token PlayerTokens::AddPlayer(Player& player) {
     // Генерируем новый токен
-    std::uint64_t value1 = generator1_();
-    std::uint64_t value2 = generator2_();
+    std::uint64_t value1;
+    std::uint64_t value2;
+    {
+        std::lock_guard lock{generator_mutex_};
+        value1 = generator1_();
+        value2 = generator2_();
+    }
 
     // Преобразуем числа в шестнадцатеричные строки
     std::stringstream ss1;
@@ -63,16 +68,90 @@ Token PlayerTokens::AddPlayer(Player& player) {
     Token new_token(hex_value1 + hex_value2);
 
     // Добавляем нового игрока
-    auto added_token_it = token_to_player.insert({new_token, &player}).first;
+    AddToken(new_token, player);
+
+    return new_token;
+}
 
-    return (*added_token_it).first;
+Player* PlayerTokens::FindPlayerByToken(const Token& token) const {
+    const auto& shard = GetTokenShard(token);
+    std::shared_lock lock{shard.mutex};
+    const auto it = shard.token_to_player.find(token);
+    return it == shard.token_to_player.end() ? nullptr : it->second;
 }
 
-Player* PlayerTokens::FindPlayerByToken(Token token) {
-    if(token_to_player.count(token) == 1) {
-        return token_to_player.at(token);
+std::optional<Token> PlayerTokens::FindTokenByPlayer(Player::Id player_id, const model::Map::Id& map_id) const {
+    const PlayerKey key{*player_id, map_id};
+    const auto& shard = GetPlayerShard(key);
+    std::shared_lock lock{shard.mutex};
+    const auto it = shard.player_to_token.find(key);
+    if(it == shard.player_to_token.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+PlayerTokens::TokenToPlayerPtr PlayerTokens::GetTokens() const {
+    TokenToPlayerPtr token_to_player;
+    for(const auto& shard : token_shards_) {
+        std::shared_lock lock{shard.mutex};
+        token_to_player.insert(shard.token_to_player.begin(), shard.token_to_player.end());
+    }
+    return token_to_player;
+}
+
+void PlayerTokens::SetTokens(TokenToPlayerPtr&& token_to_player_) {
+    std::array<std::unique_lock<std::shared_mutex>, SHARD_COUNT> player_locks;
+    std::array<std::unique_lock<std::shared_mutex>, SHARD_COUNT> token_locks;
+    for(size_t i = 0; i < SHARD_COUNT; ++i) {
+        player_locks[i] = std::unique_lock{player_shards_[i].mutex};
+        player_shards_[i].player_to_token.clear();
+    }
+    for(size_t i = 0; i < SHARD_COUNT; ++i) {
+        token_locks[i] = std::unique_lock{token_shards_[i].mutex};
+        token_shards_[i].token_to_player.clear();
+    }
+    for(auto& [token, player] : token_to_player_) {
+        GetPlayerShard(GetPlayerKey(*player)).player_to_token.insert_or_assign(GetPlayerKey(*player), token);
+        GetTokenShard(token).token_to_player.emplace(token, player);
     }
-    return nullptr;
+}
+
+void PlayerTokens::AddToken(Token token, Player& player) {
+    const auto key = GetPlayerKey(player);
+    auto& player_shard = GetPlayerShard(key);
+    std::unique_lock player_lock{player_shard.mutex};
+    auto [player_it, is_inserted] = player_shard.player_to_token.try_emplace(key, token);
+    if(!is_inserted && player_it->second != token) {
+        // Прежний токен игрока больше не действителен
+        auto& old_token_shard = GetTokenShard(player_it->second);
+        std::unique_lock token_lock{old_token_shard.mutex};
+        old_token_shard.token_to_player.erase(player_it->second);
+        player_it->second = token;
+    }
+    auto& token_shard = GetTokenShard(token);
+    std::unique_lock token_lock{token_shard.mutex};
+    token_shard.token_to_player.insert_or_assign(std::move(token), &player);
+}
+
+void PlayerTokens::RemovePlayer(Player::Id player_id, const model::Map::Id& map_id) {
+    const PlayerKey key{*player_id, map_id};
+    auto& player_shard = GetPlayerShard(key);
+    std::unique_lock player_lock{player_shard.mutex};
+    const auto player_it = player_shard.player_to_token.find(key);
+    if(player_it == player_shard.player_to_token.end()) {
+        return;
+    }
+    {
+        auto& token_shard = GetTokenShard(player_it->second);
+        std::unique_lock token_lock{token_shard.mutex};
+        const auto token_it = token_shard.token_to_player.find(player_it->second);
+        // Токен мог быть передан другому игроку при восстановлении состояния
+        if(token_it != token_shard.token_to_player.end() && GetPlayerKey(*token_it->second) == key) {
+            token_shard.token_to_player.erase(token_it);
+        }
+    }
+    player_shard.player_to_token.erase(player_it);
 }
 
 Player& Players::Add(util::Tagged<std::string, model::Map> map_id, std::string user_name) {
@@ -118,19 +197,22 @@ bool Application::IsGameAuto () const {
     return game_.IsGameAuto();
 }
 
-const std::vector<Player*> Application::ListPlayersUseCase(const Token& token) const {
-    std::vector<Player*> session_players;
+const std::vector<Player> Application::ListPlayersUseCase(const Token& token) const {
+    std::vector<Player> session_players;
+    std::shared_lock state_lock{state_mutex_};
     auto player_ptr = player_tokens_.FindPlayerByToken(token);
     if(player_ptr == nullptr) {
         return {};
     }
     // Возвращаем список игроков из одной игровой сессии
     auto player_map_id = player_ptr->GetMapId();
-    auto players_count = players_.GetPlayersCount(player_map_id);
-
-    for(auto i = 0U; i < players_count; i++) {
-        auto session_player = players_.FindByPlayerIdAndMapId(i, player_map_id);
-        session_players.push_back(session_player);
+    std::shared_lock session_lock{session_mutexes_.at(player_map_id)};
+    const auto& session_dogs = game_.FindSession(player_map_id)->GetDogs();
+    session_players.reserve(session_dogs.size());
+    // Идентификаторы псов не обязаны идти подряд, поэтому перебираем псов сессии.
+    // Игроки копируются, так как после снятия блокировки они могут уйти на покой
+    for(const auto& dog : session_dogs) {
+        session_players.push_back(*players_.FindByPlayerIdAndMapId(dog.first, player_map_id));
     }
     return session_players;
 }
@@ -144,6 +226,8 @@ JoinGameResult Application::JoinGameUseCase(std::string user_name, const model::
     } else if (map_ptr == nullptr){
         throw JoinGameError(JoinGameError::JoinGameErrorReason::INVALID_MAP);
     }
+    std::unique_lock state_lock{state_mutex_};
+    std::unique_lock session_lock{session_mutexes_.at(map_id)};
     if(game_.FindSession(map_id) == nullptr) {
         model::GameSession session(map_ptr, game_.GetRandomize(), game_.GetLootGeneratorConfig());
         game_.AddSession(session);
@@ -154,20 +238,34 @@ JoinGameResult Application::JoinGameUseCase(std::string user_name, const model::
     return {new_token, added_player.GetPlayerId()};
 }
 
-const model::GameSession* Application::GetGameStateUseCase(std::string_view authorization_field) const {
+SessionView Application::GetGameStateUseCase(std::string_view authorization_field) const {
     app::Token token(std::string(""));
     if(!app::IsValidAuthorizationField(authorization_field, token)) {
         throw GetGameStateError(GetGameStateError::GetGameStateErrorReason::INVALID_AUTH_FIELD);
     }
+    std::shared_lock state_lock{state_mutex_};
     const auto player_ptr = player_tokens_.FindPlayerByToken(token);
     
     if(player_ptr == nullptr) {
         throw GetGameStateError(GetGameStateError::GetGameStateErrorReason::INVALID_TOKEN);
     }
     auto player_map_id = player_ptr->GetMapId();
-    const auto session_ptr = game_.FindSession(player_map_id);
-    //return session_ptr->GetDogs();
-    return session_ptr;
+    // Сессии не удаляются, поэтому после захвата мьютекса сессии state_mutex_ можно отпустить
+    std::shared_lock session_lock{session_mutexes_.at(player_map_id)};
+    return {std::move(session_lock), game_.FindSession(player_map_id)};
+}
+
+std::optional<model::Map::Id> Application::FindPlayerMapUseCase(std::string_view authorization_field) const {
+    app::Token token(std::string(""));
+    if(!app::IsValidAuthorizationField(authorization_field, token)) {
+        return std::nullopt;
+    }
+    // Игрок не может быть удалён, пока найден его токен, поэтому state_mutex_ не нужен
+    std::optional<model::Map::Id> map_id;
+    player_tokens_.VisitPlayerByToken(token, [&map_id](const Player& player) {
+        map_id = player.GetMapId();
+    });
+    return map_id;
 }
 
 const extra::ExtraData& Application::GetExtraData() const {
@@ -179,6 +277,7 @@ void Application::MovePlayersUseCase(std::string_view authorization_field, std::
     if(!app::IsValidAuthorizationField(authorization_field, token)) {
         throw MovePlayersError(MovePlayersError::MovePlayersErrorReason::INVALID_AUTH_FIELD);
     }
+    std::shared_lock state_lock{state_mutex_};
     const auto player_ptr = player_tokens_.FindPlayerByToken(token);
     if(player_ptr == nullptr) {
         throw MovePlayersError(MovePlayersError::MovePlayersErrorReason::INVALID_TOKEN);
@@ -186,9 +285,11 @@ void Application::MovePlayersUseCase(std::string_view authorization_field, std::
     if(!IsValidMoveDirection(move_direction)) {
         throw MovePlayersError(MovePlayersError::MovePlayersErrorReason::INVALID_MOVE_ARG);
     }
+    std::unique_lock session_lock{session_mutexes_.at(player_ptr->GetMapId())};
     auto player_session = game_.FindSession(player_ptr->GetMapId());
     auto map_dog_speed = game_.FindMap(player_ptr->GetMapId())->GetDogSpeed();
     player_session->FindDog(*(player_ptr->GetPlayerId()))->SetSpeed(move_direction, map_dog_speed);
+    player_session->MarkDogChanged(*(player_ptr->GetPlayerId()));
 }
 
 const std::vector<postgres::PlayerRetireInfo> Application::GetRetirePlayersUseCase(std::vector<std::pair<std::string, std::string>> params) const {
@@ -201,128 +302,245 @@ const std::vector<postgres::PlayerRetireInfo> Application::GetRetirePlayersUseCa
             size = param_item.second;
         }
     }
-    return DB.GetRetirePlayersInfo(start_idx, size);
+    if(!DB) {
+        return {};
+    }
+    return DB->GetRetirePlayersInfo(start_idx, size);
 }
 
-void Application::TickTimeUseCase(std::uint64_t time_Delta) const {
+Application::RetiredDogs Application::TickSession(model::GameSession& session, std::uint64_t time_Delta) const {
+    std::unique_lock session_lock{session_mutexes_.at(session.GetIDMap())};
     const double shift = 0.4;
     double time_Delta_sec = static_cast<double>(time_Delta) / 1000;
-    auto& sessions = game_.GetSessions();
-    for(auto& session_items : sessions) {
-        std::vector<collision_detector::Gatherer> gatherers;
-        std::vector<std::uint64_t> Dogs_to_delete_idxs;
-        auto& dogs = session_items.second.GetDogs();
-        for(auto& dog : dogs) {
-            const auto& dog_coords = dog.second.GetCoords();
-            geom::Point2D gatherer_start_pos(dog_coords.x, dog_coords.y);
-            const auto& dog_speed = dog.second.GetSpeed();
-            if(dog_speed.h_s == 0 && dog_speed.v_s == 0) {
-                if(game_.GetDogRetireTime() <= (dog.second.GetStandByTime() + std::chrono::milliseconds(time_Delta))) {
-                    Dogs_to_delete_idxs.push_back(dog.first);
-                    auto dif = game_.GetDogRetireTime() - dog.second.GetStandByTime();
-                    dog.second.AddInGameTime(dog.second.GetStandByTime() + dif);
-                } else {
-                    dog.second.AddStandByTime(std::chrono::milliseconds(time_Delta));
-                }
+    const auto map_ptr = session.GetMapPtr();
+    std::vector<collision_detector::Gatherer> gatherers;
+    std::vector<std::uint64_t> Dogs_to_delete_idxs;
+    auto& dogs = session.GetDogs();
+    for(auto& dog : dogs) {
+        const auto& dog_coords = dog.second.GetCoords();
+        geom::Point2D gatherer_start_pos(dog_coords.x, dog_coords.y);
+        const auto& dog_speed = dog.second.GetSpeed();
+        if(dog_speed.h_s == 0 && dog_speed.v_s == 0) {
+            if(game_.GetDogRetireTime() <= (dog.second.GetStandByTime() + std::chrono::milliseconds(time_Delta))) {
+                Dogs_to_delete_idxs.push_back(dog.first);
+                auto dif = game_.GetDogRetireTime() - dog.second.GetStandByTime();
+                dog.second.AddInGameTime(dog.second.GetStandByTime() + dif);
             } else {
-                if(dog.second.GetStandByTime().count() != 0) {
-                    dog.second.AddInGameTime(dog.second.GetStandByTime());
-                    dog.second.SetStandByTime(std::chrono::milliseconds(0));
-                }
-                dog.second.AddInGameTime(std::chrono::milliseconds(time_Delta));
+                dog.second.AddStandByTime(std::chrono::milliseconds(time_Delta));
             }
-            auto map_ptr = game_.FindMap(session_items.second.GetIDMap());
-            auto hor_road = map_ptr->FindHorRoad(dog_coords.x, dog_coords.y);
-            auto ver_road = map_ptr->FindVertRoad(dog_coords.x, dog_coords.y);
-            if(dog_speed.h_s < 0) {
-                double hor_left_limit;
-                if(hor_road != nullptr){
-                    hor_left_limit = std::min(hor_road->GetStart().x, hor_road->GetEnd().x) - shift;
-                } else {
-                    hor_left_limit = ver_road->GetStart().x - shift;
-                }
-                double new_x_coord = dog_coords.x + (dog_speed.h_s * time_Delta_sec);
-                if(new_x_coord > hor_left_limit) {
-                    dog.second.SetCoords({(new_x_coord), (dog_coords.y)});
-                } else {
-                    dog.second.SetCoords({roundToOneDecimal(hor_left_limit), (dog_coords.y)});
-                    dog.second.SetSpeed({}, 0.0);
-                }
-            } else if(dog_speed.h_s > 0) {
-                double hor_right_limit;
-                if(hor_road != nullptr){
-                    hor_right_limit = std::max(hor_road->GetStart().x, hor_road->GetEnd().x) + shift;
-                } else {
-                    hor_right_limit = ver_road->GetStart().x + shift;
-                }
-                double new_x_coord = dog_coords.x + (dog_speed.h_s * time_Delta_sec);
-                if(new_x_coord < hor_right_limit) {
-                    dog.second.SetCoords({(new_x_coord), (dog_coords.y)});
-                } else {
-                    dog.second.SetCoords({roundToOneDecimal(hor_right_limit), (dog_coords.y)});
-                    dog.second.SetSpeed({}, 0.0);
-                }
-            } else if (dog_speed.v_s < 0) {
-                double ver_up_limit;
-                if(ver_road != nullptr){
-                    ver_up_limit = std::min(ver_road->GetStart().y, ver_road->GetEnd().y) - shift;
-                } else {
-                    ver_up_limit = hor_road->GetStart().y - shift;
-                }
-                double new_y_coord = dog_coords.y + (dog_speed.v_s * time_Delta_sec);
-                if(new_y_coord > ver_up_limit) {
-                    dog.second.SetCoords({(dog_coords.x), (new_y_coord)});
-                } else {
-                    dog.second.SetCoords({(dog_coords.x), roundToOneDecimal(ver_up_limit)});
-                    dog.second.SetSpeed({}, 0.0);
-                }
-            } else if (dog_speed.v_s > 0) {
-                double ver_down_limit;
-                if(ver_road != nullptr){
-                    ver_down_limit = std::max(ver_road->GetStart().y, ver_road->GetEnd().y) + shift;
-                } else {
-                    ver_down_limit = hor_road->GetStart().y + shift;
-                }
-                double new_y_coord = dog_coords.y + (dog_speed.v_s * time_Delta_sec);
-                if(new_y_coord < ver_down_limit) {
-                    dog.second.SetCoords({(dog_coords.x), (new_y_coord)});
-                } else {
-                    dog.second.SetCoords({(dog_coords.x), roundToOneDecimal(ver_down_limit)});
-                    dog.second.SetSpeed({}, 0.0);
-                }
+        } else {
+            if(dog.second.GetStandByTime().count() != 0) {
+                dog.second.AddInGameTime(dog.second.GetStandByTime());
+                dog.second.SetStandByTime(std::chrono::milliseconds(0));
             }
-            geom::Point2D gatherer_end_pos(dog_coords.x, dog_coords.y);
-            gatherers.push_back({gatherer_start_pos, gatherer_end_pos, 0.3});
+            dog.second.AddInGameTime(std::chrono::milliseconds(time_Delta));
         }
-        session_items.second.HandleEvents(gatherers);
-        if(!Dogs_to_delete_idxs.empty()) {
-            for(auto dog_idx : Dogs_to_delete_idxs) {
-                const auto& dog = dogs.at(dog_idx);
-                DB.SetDogToDB(dog);
-                auto tokens = player_tokens_.GetTokens();
-                for(auto it = tokens.begin(); it != tokens.end(); ) {
-                    if((*(*it).second->GetPlayerId() == dog_idx) &&
-                         (*it).second->GetName() == dog.GetName() &&
-                         (*it).second->GetMapId() == session_items.second.GetIDMap()) {
-                        it = tokens.erase(it);
-                    } else {
-                        ++it;
-                    }
-                }
-                player_tokens_.SetTokens(tokens);
-                players_.DeletePlayer(dog_idx , session_items.second.GetIDMap());
-                dogs.erase(dog_idx);
+        if(dog_speed.h_s != 0 || dog_speed.v_s != 0) {
+            session.MarkDogChanged(dog.first);
+        }
+        // Поиск дорог выполняется только при переходе пса через перекрёсток
+        const auto& road_location = dog.second.LocateRoads(*map_ptr);
+        auto hor_road = road_location.hor_road;
+        auto ver_road = road_location.vert_road;
+        if(dog_speed.h_s < 0) {
+            double hor_left_limit;
+            if(hor_road != nullptr){
+                hor_left_limit = std::min(hor_road->GetStart().x, hor_road->GetEnd().x) - shift;
+            } else {
+                hor_left_limit = ver_road->GetStart().x - shift;
+            }
+            double new_x_coord = dog_coords.x + (dog_speed.h_s * time_Delta_sec);
+            if(new_x_coord > hor_left_limit) {
+                dog.second.SetCoords({(new_x_coord), (dog_coords.y)});
+            } else {
+                dog.second.SetCoords({roundToOneDecimal(hor_left_limit), (dog_coords.y)});
+                dog.second.SetSpeed({}, 0.0);
+            }
+        } else if(dog_speed.h_s > 0) {
+            double hor_right_limit;
+            if(hor_road != nullptr){
+                hor_right_limit = std::max(hor_road->GetStart().x, hor_road->GetEnd().x) + shift;
+            } else {
+                hor_right_limit = ver_road->GetStart().x + shift;
+            }
+            double new_x_coord = dog_coords.x + (dog_speed.h_s * time_Delta_sec);
+            if(new_x_coord < hor_right_limit) {
+                dog.second.SetCoords({(new_x_coord), (dog_coords.y)});
+            } else {
+                dog.second.SetCoords({roundToOneDecimal(hor_right_limit), (dog_coords.y)});
+                dog.second.SetSpeed({}, 0.0);
+            }
+        } else if (dog_speed.v_s < 0) {
+            double ver_up_limit;
+            if(ver_road != nullptr){
+                ver_up_limit = std::min(ver_road->GetStart().y, ver_road->GetEnd().y) - shift;
+            } else {
+                ver_up_limit = hor_road->GetStart().y - shift;
+            }
+            double new_y_coord = dog_coords.y + (dog_speed.v_s * time_Delta_sec);
+            if(new_y_coord > ver_up_limit) {
+                dog.second.SetCoords({(dog_coords.x), (new_y_coord)});
+            } else {
+                dog.second.SetCoords({(dog_coords.x), roundToOneDecimal(ver_up_limit)});
+                dog.second.SetSpeed({}, 0.0);
+            }
+        } else if (dog_speed.v_s > 0) {
+            double ver_down_limit;
+            if(ver_road != nullptr){
+                ver_down_limit = std::max(ver_road->GetStart().y, ver_road->GetEnd().y) + shift;
+            } else {
+                ver_down_limit = hor_road->GetStart().y + shift;
+            }
+            double new_y_coord = dog_coords.y + (dog_speed.v_s * time_Delta_sec);
+            if(new_y_coord < ver_down_limit) {
+                dog.second.SetCoords({(dog_coords.x), (new_y_coord)});
+            } else {
+                dog.second.SetCoords({(dog_coords.x), roundToOneDecimal(ver_down_limit)});
+                dog.second.SetSpeed({}, 0.0);
             }
         }
-        session_items.second.AddLoot(std::chrono::milliseconds(time_Delta));
-        if(listener_ != nullptr) {
-            listener_->OnTick(std::chrono::milliseconds(time_Delta));
+        geom::Point2D gatherer_end_pos(dog_coords.x, dog_coords.y);
+        gatherers.push_back({gatherer_start_pos, gatherer_end_pos, 0.3});
+    }
+    session.HandleEvents(gatherers);
+    RetiredDogs retired_dogs;
+    for(auto dog_idx : Dogs_to_delete_idxs) {
+        retired_dogs.emplace_back(dog_idx, dogs.at(dog_idx));
+        session.RemoveDog(dog_idx);
+    }
+    session.AddLoot(std::chrono::milliseconds(time_Delta));
+    session.CommitTick();
+    return retired_dogs;
+}
+
+void Application::RetireDogs(const model::GameSession& session, const RetiredDogs& retired_dogs) const {
+    for(const auto& [dog_idx, dog] : retired_dogs) {
+        // Токен удаляется раньше игрока: пока токен найден, указатель на игрока действителен
+        player_tokens_.RemovePlayer(Player::Id{dog_idx}, session.GetIDMap());
+        players_.DeletePlayer(dog_idx , session.GetIDMap());
+    }
+}
+
+void Application::SaveRetiredDogs(const RetiredDogs& retired_dogs) const {
+    if(!retired_players_writer_) {
+        return;
+    }
+    for(const auto& [dog_idx, dog] : retired_dogs) {
+        const double play_time = static_cast<double>(dog.GetInGameTime().count()) / 1000;
+        retired_players_writer_->Push({dog.GetName(), dog.GetScore(), play_time});
+    }
+}
+
+postgres::RetiredPlayersWriter::Stats Application::GetRetiredPlayersStats() const {
+    return retired_players_writer_ ? retired_players_writer_->GetStats() : postgres::RetiredPlayersWriter::Stats{};
+}
+
+void Application::TickTimeUseCase(std::uint64_t time_Delta) const {
+    // Набор сессий меняет только JoinGameUseCase, который не выполняется одновременно с тиком,
+    // поэтому state_mutex_ не удерживается, пока сессии обновляются
+    auto& sessions = game_.GetSessions();
+    TickResults tick_results;
+    tick_results.reserve(sessions.size());
+    for(auto& session_items : sessions) {
+        tick_results.emplace_back(&session_items.second, TickSession(session_items.second, time_Delta));
+    }
+    FinishTick(tick_results, time_Delta);
+}
+
+void Application::TickTimeUseCase(std::uint64_t time_Delta, std::function<void()> on_complete) const {
+    auto& sessions = game_.GetSessions();
+    if(!tick_strand_ || sessions.size() <= 1) {
+        TickTimeUseCase(time_Delta);
+        on_complete();
+        return;
+    }
+    // Сессия обновляется в своём strand, после уже поступивших команд её игроков.
+    // Сессии разных карт не разделяют изменяемого состояния, поэтому обновляются параллельно.
+    // Вызвавший поток не ждёт сессии: последняя обновлённая сессия продолжает тик в tick_strand_.
+    // Сессия, созданная JoinGameUseCase во время тика, обновится со следующего тика
+    struct ParallelTick {
+        TickResults results;
+        std::atomic<size_t> sessions_left;
+        std::function<void()> on_complete;
+    };
+    auto tick = std::make_shared<ParallelTick>();
+    tick->results.reserve(sessions.size());
+    for(auto& session_items : sessions) {
+        tick->results.emplace_back(&session_items.second, RetiredDogs{});
+    }
+    tick->sessions_left = tick->results.size();
+    tick->on_complete = std::move(on_complete);
+    for(size_t i = 0; i < tick->results.size(); ++i) {
+        auto& session = *tick->results[i].first;
+        boost::asio::post(session_strands_.at(session.GetIDMap()), [this, tick, i, time_Delta] {
+            auto& [session_ptr, retired_dogs] = tick->results[i];
+            try {
+                retired_dogs = TickSession(*session_ptr, time_Delta);
+            } catch (...) {
+                // Ошибка в одной сессии не должна оставить тик незавершённым
+            }
+            if(tick->sessions_left.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                boost::asio::post(*tick_strand_, [this, tick, time_Delta] {
+                    try {
+                        FinishTick(tick->results, time_Delta);
+                    } catch (...) {
+                    }
+                    // Следующий тик планируется, даже если этот завершился с ошибкой
+                    tick->on_complete();
+                });
+            }
+        });
+    }
+}
+
+void Application::FinishTick(const TickResults& tick_results, std::uint64_t time_Delta) const {
+    // Токены и игроки общие для всех сессий, поэтому обрабатываем их последовательно
+    {
+        std::unique_lock state_lock{state_mutex_};
+        for(const auto& [session_ptr, retired_dogs] : tick_results) {
+            RetireDogs(*session_ptr, retired_dogs);
         }
     }
+    // Очередь записи в БД не требует state_mutex_
+    for(const auto& [session_ptr, retired_dogs] : tick_results) {
+        SaveRetiredDogs(retired_dogs);
+    }
+    // Слушатели вызываются без блокировок и могут обращаться к сценариям чтения
+    for(auto listener : listeners_) {
+        listener->OnTick(std::chrono::milliseconds(time_Delta));
+    }
+}
+
+void Application::EnableSessionStrands(boost::asio::io_context& ioc) {
+    for(const auto& map : game_.GetMaps()) {
+        session_strands_.try_emplace(map.GetId(), boost::asio::make_strand(ioc));
+    }
+}
+
+const SessionStrand* Application::FindSessionStrand(const model::Map::Id& map_id) const {
+    const auto it = session_strands_.find(map_id);
+    return it == session_strands_.end() ? nullptr : &it->second;
+}
+
+void Application::EnableParallelTick(unsigned threads_count, SessionStrand tick_strand) {
+    // Сессии обновляются параллельно, только если для этого есть потоки
+    if(threads_count > 1) {
+        tick_strand_.emplace(std::move(tick_strand));
+    }
+}
+
+StateReadLock Application::LockStateForRead() const {
+    StateReadLock lock{std::shared_lock{state_mutex_}, {}};
+    // Мьютексы сессий захватываются после state_mutex_ и всегда в одном порядке
+    lock.session_locks.reserve(session_mutexes_.size());
+    for(auto& [map_id, session_mutex] : session_mutexes_) {
+        lock.session_locks.emplace_back(session_mutex);
+    }
+    return lock;
 }
 
-void Application::SetApplicationListener(ApplicationListener* listener) {
-    listener_ = listener;
+void Application::AddApplicationListener(ApplicationListener* listener) {
+    listeners_.push_back(listener);
 }
 
 }
\ No newline at end of file
@@ -1,7 +1,18 @@
 #pragma once
+#include <array>
+#include <atomic>
+#include <functional>
 #include <random>
 #include <sstream>
 #include <iomanip>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <utility>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/strand.hpp>
 #include "model.h"
 #include "extra_data.h"
 #include "loot_generator.h"
@@ -37,23 +48,90 @@ private:
     model::Map::Id map_id_;
 };
 
+// Токены игроков с индексами в обе стороны: токен -> игрок и игрок -> токен.
+// Индексы разбиты на сегменты со своими блокировками, поэтому проверки токенов
+// из разных потоков не ждут друг друга, а поиск и удаление выполняются за O(1).
+// Указатель на игрока действителен, пока игрок не удалён из Players
 class PlayerTokens {
 public:
     using TokenToPlayerPtr = std::unordered_map<Token, Player*, util::TaggedHasher<Token>>;
     
     Token AddPlayer(Player& player);
-    Player* FindPlayerByToken(Token token);
-    TokenToPlayerPtr GetTokens() const {
-        return token_to_player;
+    Player* FindPlayerByToken(const Token& token) const;
+    // Вызывает action(const Player&) для владельца токена, пока токен не может быть удалён.
+    // Возвращает false, если токен не найден
+    template <typename Action>
+    bool VisitPlayerByToken(const Token& token, Action&& action) const {
+        const auto& shard = GetTokenShard(token);
+        std::shared_lock lock{shard.mutex};
+        const auto it = shard.token_to_player.find(token);
+        if(it == shard.token_to_player.end()) {
+            return false;
+        }
+        action(std::as_const(*it->second));
+        return true;
+    }
+    std::optional<Token> FindTokenByPlayer(Player::Id player_id, const model::Map::Id& map_id) const;
+    // Вызывает action(const Token&, const Player&) для каждого токена, не копируя индекс.
+    // Сегменты обходятся по очереди, поэтому обход согласован, только если токены
+    // в это время не изменяются, например при сохранении состояния под блокировкой
+    template <typename Action>
+    void ForEachToken(Action&& action) const {
+        for(const auto& shard : token_shards_) {
+            std::shared_lock lock{shard.mutex};
+            for(const auto& [token, player] : shard.token_to_player) {
+                action(token, std::as_const(*player));
+            }
+        }
     }
-    // TokenToPlayerPtr& GetTokensRef() {
-    //     return token_to_player;
-    // }
+    // Копия всех токенов. Требует O(числа игроков), для сохранения состояния служит ForEachToken
+    TokenToPlayerPtr GetTokens() const;
     void SetTokens(const TokenToPlayerPtr& token_to_player_){
-        token_to_player = token_to_player_;
+        SetTokens(TokenToPlayerPtr(token_to_player_));
     }
+    void SetTokens(TokenToPlayerPtr&& token_to_player_);
+    // Добавляет токен уже существующего игрока, например при восстановлении состояния.
+    // У игрока один токен, прежний токен игрока удаляется
+    void AddToken(Token token, Player& player);
+    // Удаляет токен игрока
+    void RemovePlayer(Player::Id player_id, const model::Map::Id& map_id);
     
 private:
+    static constexpr size_t SHARD_COUNT = 16;
+
+    using PlayerKey = std::pair<std::uint64_t, model::Map::Id>;
+    struct PlayerKeyHasher {
+        size_t operator()(const PlayerKey& key) const {
+            return std::hash<std::uint64_t>()(key.first) ^ util::TaggedHasher<model::Map::Id>()(key.second);
+        }
+    };
+
+    struct TokenShard {
+        mutable std::shared_mutex mutex;
+        TokenToPlayerPtr token_to_player;
+    };
+    struct PlayerShard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<PlayerKey, Token, PlayerKeyHasher> player_to_token;
+    };
+
+    static PlayerKey GetPlayerKey(const Player& player) {
+        return {*player.GetPlayerId(), player.GetMapId()};
+    }
+    TokenShard& GetTokenShard(const Token& token) {
+        return token_shards_[util::TaggedHasher<Token>()(token) % SHARD_COUNT];
+    }
+    const TokenShard& GetTokenShard(const Token& token) const {
+        return token_shards_[util::TaggedHasher<Token>()(token) % SHARD_COUNT];
+    }
+    PlayerShard& GetPlayerShard(const PlayerKey& key) {
+        return player_shards_[PlayerKeyHasher()(key) % SHARD_COUNT];
+    }
+    const PlayerShard& GetPlayerShard(const PlayerKey& key) const {
+        return player_shards_[PlayerKeyHasher()(key) % SHARD_COUNT];
+    }
+
+    std::mutex generator_mutex_;
     std::random_device random_device_;
     std::mt19937_64 generator1_{[this] {
         std::uniform_int_distribution<std::mt19937_64::result_type> dist;
@@ -68,7 +146,9 @@ private:
     // Можно поэкспериментировать с алгоритмом генерирования токенов,
     // чтобы сделать их подбор ещё более затруднительным
 
-    std::unordered_map<Token, Player*, util::TaggedHasher<Token>> token_to_player;
+    // Сегмент игрока блокируется раньше сегмента токена
+    std::array<PlayerShard, SHARD_COUNT> player_shards_;
+    std::array<TokenShard, SHARD_COUNT> token_shards_;
 };
  
 class Players {
@@ -88,12 +168,21 @@ public:
     Player& Add(util::Tagged<std::string, model::Map> map_id, std::string user_name);
     size_t GetPlayersCount(model::Map::Id map_id);
     Player* FindByPlayerIdAndMapId(size_t i, model::Map::Id player_map_id);
-    DogIdMapIdToPlayer GetPlayers() const {
+    const DogIdMapIdToPlayer& GetPlayers() const {
         return players_;
     }
     void SetPlayers(const DogIdMapIdToPlayer& players){
         players_ = players;
     }
+    void SetPlayers(DogIdMapIdToPlayer&& players){
+        players_ = std::move(players);
+    }
+
+    // Добавляет игрока с известным идентификатором, не создавая пса
+    Player& Insert(Player player) {
+        const auto key = std::pair(*(player.GetPlayerId()), player.GetMapId());
+        return players_.insert_or_assign(key, std::move(player)).first->second;
+    }
 
     void DeletePlayer(std::uint64_t player_idx ,model::Map::Id map_id) {
         players_.erase({player_idx, map_id});
@@ -167,6 +256,21 @@ bool IsValidMoveDirection(const std::string& move_direction);
 
 double roundToOneDecimal(double value);
 
+// Игровая сессия вместе с блокировкой на чтение. Пока объект существует, сессия не изменяется
+struct SessionView {
+    std::shared_lock<std::shared_mutex> lock;
+    const model::GameSession* session = nullptr;
+};
+
+// Блокировка на чтение всего состояния игры: игроков, токенов и всех сессий
+struct StateReadLock {
+    std::shared_lock<std::shared_mutex> state_lock;
+    std::vector<std::shared_lock<std::shared_mutex>> session_locks;
+};
+
+// Команды игроков одной сессии выполняются последовательно в её strand
+using SessionStrand = boost::asio::strand<boost::asio::io_context::executor_type>;
+
 class ApplicationListener {
 public:
     virtual void OnTick(std::chrono::milliseconds time_delta) = 0;
@@ -175,28 +279,89 @@ public:
 class Application {
 public:
     Application(model::Game& game, app::Players& players, app::PlayerTokens& player_tokens, extra::ExtraData& extra_data, const postgres::DBParams& db_params) :
-        game_(game), players_(players), player_tokens_(player_tokens), extra_data_(extra_data), DB(postgres::Database(db_params)) {}
+        Application(game, players, player_tokens, extra_data) {
+        DB.emplace(db_params);
+        retired_players_writer_ = std::make_unique<postgres::RetiredPlayersWriter>(*DB);
+    }
+    // Без БД: ушедшие на покой игроки не сохраняются, а список рекордов пуст. Используется в тестах
+    Application(model::Game& game, app::Players& players, app::PlayerTokens& player_tokens, extra::ExtraData& extra_data) :
+        game_(game), players_(players), player_tokens_(player_tokens), extra_data_(extra_data) {
+        // Сессия на карте не больше одной, поэтому мьютексы сессий создаются заранее
+        // и ищутся без блокировки state_mutex_
+        for(const auto& map : game_.GetMaps()) {
+            session_mutexes_.try_emplace(map.GetId());
+        }
+    }
 
     bool IsGameAuto () const;
 
     const model::Map* GetMapUseCase(const std::string& map_id_str) const;
     const extra::ExtraData& GetExtraData() const;
     const model::Game::Maps& ListMapsUseCase () const;
-    const std::vector<Player*> ListPlayersUseCase(const Token& token) const;
+    // Сценарии чтения можно вызывать из любого потока одновременно со сценариями изменения.
+    // Сценарии изменения (Join, Move, Tick) выполняются последовательно относительно друг друга
+    const std::vector<Player> ListPlayersUseCase(const Token& token) const;
     JoinGameResult JoinGameUseCase(std::string user_name, const model::Map::Id& map_id) const;
-    const model::GameSession* GetGameStateUseCase(std::string_view authorization_field) const;
+    SessionView GetGameStateUseCase(std::string_view authorization_field) const;
+    // Карта, в сессии которой играет владелец токена. nullopt, если токен недействителен
+    std::optional<model::Map::Id> FindPlayerMapUseCase(std::string_view authorization_field) const;
     void MovePlayersUseCase(std::string_view authorization_field, std::string move_direction) const;
+    // Обновляет сессии последовательно в вызывающем потоке
     void TickTimeUseCase(std::uint64_t time_Delta) const;
-    void SetApplicationListener(ApplicationListener* listener);
+    // Если включено параллельное обновление, раздаёт сессии их strand и сразу возвращает управление.
+    // Завершение тика и on_complete выполняются в strand, переданном в EnableParallelTick.
+    // Иначе обновляет сессии последовательно и вызывает on_complete до возврата
+    void TickTimeUseCase(std::uint64_t time_Delta, std::function<void()> on_complete) const;
+    // Создаёт strand для сессии каждой карты. Вызывается до запуска ioc.
+    // ioc должен быть уничтожен после Application
+    void EnableSessionStrands(boost::asio::io_context& ioc);
+    // nullptr, если strand сессий не созданы
+    const SessionStrand* FindSessionStrand(const model::Map::Id& map_id) const;
+    // Включает параллельное обновление игровых сессий в их strand. tick_strand - strand,
+    // в котором выполняются тики и присоединение игроков. При threads_count <= 1
+    // сессии обновляются последовательно
+    void EnableParallelTick(unsigned threads_count, SessionStrand tick_strand);
+    // Для слушателей, читающих состояние, которое одновременно могут изменять команды игроков
+    StateReadLock LockStateForRead() const;
+    // Слушатели вызываются один раз за тик, после обновления всех сессий
+    void AddApplicationListener(ApplicationListener* listener);
+    // Счётчики фоновой записи ушедших на покой игроков
+    postgres::RetiredPlayersWriter::Stats GetRetiredPlayersStats() const;
     const std::vector<postgres::PlayerRetireInfo> GetRetirePlayersUseCase(std::vector<std::pair<std::string, std::string>> params) const;
 
 private:
+    using MapIdHasher = util::TaggedHasher<model::Map::Id>;
+    // Псы, ушедшие на покой за тик, вместе с их индексами в сессии
+    using RetiredDogs = std::vector<std::pair<std::uint64_t, model::Dog>>;
+    using TickResults = std::vector<std::pair<model::GameSession*, RetiredDogs>>;
+
+    // Перемещает псов, обрабатывает подбор трофеев и генерирует новые.
+    // Затрагивает только данные сессии, поэтому может выполняться параллельно для разных сессий
+    RetiredDogs TickSession(model::GameSession& session, std::uint64_t time_Delta) const;
+    // Удаляет игроков и токены ушедших на покой псов. Вызывается под state_mutex_
+    void RetireDogs(const model::GameSession& session, const RetiredDogs& retired_dogs) const;
+    // Ставит ушедших на покой псов в очередь записи в БД. Не блокируется
+    void SaveRetiredDogs(const RetiredDogs& retired_dogs) const;
+    // Удаляет ушедших на покой игроков и вызывает слушателей после обновления всех сессий
+    void FinishTick(const TickResults& tick_results, std::uint64_t time_Delta) const;
+
     model::Game& game_;
     app::Players& players_;
     app::PlayerTokens& player_tokens_;
     extra::ExtraData& extra_data_;
-    ApplicationListener* listener_ = nullptr;
-    postgres::Database DB;
+    std::vector<ApplicationListener*> listeners_;
+    std::optional<postgres::Database> DB;
+    // Записывает ушедших на покой игроков в фоне, пакетами. Объявлен после DB,
+    // чтобы при уничтожении дописать очередь, пока БД ещё доступна
+    std::unique_ptr<postgres::RetiredPlayersWriter> retired_players_writer_;
+    // Задан, если сессии обновляются параллельно
+    std::optional<SessionStrand> tick_strand_;
+    // Заполняется до запуска ioc и далее не изменяется
+    std::unordered_map<model::Map::Id, SessionStrand, MapIdHasher> session_strands_;
+    // Защищает игроков, токены и набор сессий. Содержимое сессии защищает мьютекс сессии.
+    // Мьютекс сессии захватывается после state_mutex_ и никогда - до него
+    mutable std::shared_mutex state_mutex_;
+    mutable std::unordered_map<model::Map::Id, std::shared_mutex, MapIdHasher> session_mutexes_;
 };
 
 }
\ No newline at end of file
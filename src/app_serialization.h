@@ -4,6 +4,7 @@
 #include <boost/serialization/unordered_map.hpp>
 
 #include "app.h"
+#include "model_serialization.h"
 
 using namespace std::literals;
 
@@ -60,7 +61,7 @@ public:
 
     explicit PlayersRepr(const app::Players& players)
     {
-        auto players_items = players.GetPlayers();
+        const auto& players_items = players.GetPlayers();
         for(auto& player_item : players_items) {
             PlayerRepr player_repr(player_item.second);
             players_reprs_.push_back(player_repr);
@@ -95,11 +96,9 @@ public:
 
     explicit PlayerTokensRepr(const app::PlayerTokens& players_tokens)
         {
-            auto tokens_to_players = players_tokens.GetTokens();
-            for(const auto& token_to_player : tokens_to_players) {
-                PlayerRepr player_repr(*(token_to_player.second));
-                tokens_to_players_reprs_.insert({*(token_to_player.first), player_repr});
-        }
+            players_tokens.ForEachToken([this](const app::Token& token, const app::Player& player) {
+                tokens_to_players_reprs_.insert({*token, PlayerRepr(player)});
+            });
     }
 
     [[nodiscard]] app::PlayerTokens::TokenToPlayerPtr Restore(app::Players& players) {
@@ -124,4 +123,53 @@ private:
 };
 
 
+// JournalRecordRepr - запись журнала состояния: изменения сессий с прошлой записи
+// и токены присоединившихся за это время игроков.
+// Игроки и токены ушедших на покой псов удаляются вместе с псами
+class JournalRecordRepr {
+public:
+    using TokenToPlayerRepr = std::map<std::string, PlayerRepr>;
+
+    JournalRecordRepr() = default;
+
+    void AddSessionChanges(const model::GameSession& session, const model::SessionChanges& changes) {
+        sessions_changes_.emplace_back(session, changes);
+    }
+
+    void AddJoinedPlayer(const app::Token& token, const app::Player& player) {
+        joined_players_.insert({*token, PlayerRepr(player)});
+    }
+
+    bool IsEmpty() const {
+        return sessions_changes_.empty() && joined_players_.empty();
+    }
+
+    void Apply(model::Game& game, app::Players& players, app::PlayerTokens& player_tokens) const {
+        for(const auto& session_changes : sessions_changes_) {
+            if(session_changes.Apply(game) == nullptr) {
+                continue;
+            }
+            const model::Map::Id map_id{session_changes.GetMapId()};
+            for(auto dog_index : session_changes.GetRemovedDogs()) {
+                player_tokens.RemovePlayer(app::Player::Id{dog_index}, map_id);
+                players.DeletePlayer(dog_index, map_id);
+            }
+        }
+        for(const auto& [token, player_repr] : joined_players_) {
+            auto& player = players.Insert(player_repr.Restore());
+            player_tokens.AddToken(app::Token{token}, player);
+        }
+    }
+
+    template <typename Archive>
+    void serialize(Archive& ar, [[maybe_unused]] const unsigned version) {
+        ar& sessions_changes_;
+        ar& joined_players_;
+    }
+
+private:
+    std::vector<SessionChangesRepr> sessions_changes_;
+    TokenToPlayerRepr joined_players_;
+};
+
 }  // namespace serialization
\ No newline at end of file
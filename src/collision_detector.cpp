@@ -1,5 +1,15 @@
 #include "collision_detector.h"
 #include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <unordered_map>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace collision_detector {
 
@@ -22,6 +32,149 @@ CollectionResult TryCollectPoint(geom::Point2D a, geom::Point2D b, geom::Point2D
     return CollectionResult(sq_distance, proj_ratio);
 }
 
+namespace {
+
+// Обрабатывает предметы с индексами [begin, items.Size()) по той же формуле, что и TryCollectPoint
+void TryCollectPointsTail(geom::Point2D a, geom::Point2D b, const ItemsBatch& items,
+                          CollectionResults& results, size_t begin) {
+    const double v_x = b.x - a.x;
+    const double v_y = b.y - a.y;
+    const double v_len2 = v_x * v_x + v_y * v_y;
+    for (size_t i = begin; i < items.Size(); ++i) {
+        const double u_x = items.x[i] - a.x;
+        const double u_y = items.y[i] - a.y;
+        const double u_dot_v = u_x * v_x + u_y * v_y;
+        const double u_len2 = u_x * u_x + u_y * u_y;
+        results.proj_ratio[i] = u_dot_v / v_len2;
+        results.sq_distance[i] = u_len2 - (u_dot_v * u_dot_v) / v_len2;
+    }
+}
+
+}  // namespace
+
+void TryCollectPointsScalar(geom::Point2D a, geom::Point2D b, const ItemsBatch& items, CollectionResults& results) {
+    assert(b.x != a.x || b.y != a.y);
+    results.proj_ratio.resize(items.Size());
+    results.sq_distance.resize(items.Size());
+    TryCollectPointsTail(a, b, items, results, 0);
+}
+
+void TryCollectPoints(geom::Point2D a, geom::Point2D b, const ItemsBatch& items, CollectionResults& results) {
+    assert(b.x != a.x || b.y != a.y);
+    const size_t count = items.Size();
+    results.proj_ratio.resize(count);
+    results.sq_distance.resize(count);
+    const double v_x = b.x - a.x;
+    const double v_y = b.y - a.y;
+    const double v_len2 = v_x * v_x + v_y * v_y;
+    size_t i = 0;
+#if defined(__AVX__)
+    const __m256d a_x4 = _mm256_set1_pd(a.x);
+    const __m256d a_y4 = _mm256_set1_pd(a.y);
+    const __m256d v_x4 = _mm256_set1_pd(v_x);
+    const __m256d v_y4 = _mm256_set1_pd(v_y);
+    const __m256d v_len2_4 = _mm256_set1_pd(v_len2);
+    for (; i + 4 <= count; i += 4) {
+        const __m256d u_x = _mm256_sub_pd(_mm256_loadu_pd(&items.x[i]), a_x4);
+        const __m256d u_y = _mm256_sub_pd(_mm256_loadu_pd(&items.y[i]), a_y4);
+        const __m256d u_dot_v = _mm256_add_pd(_mm256_mul_pd(u_x, v_x4), _mm256_mul_pd(u_y, v_y4));
+        const __m256d u_len2 = _mm256_add_pd(_mm256_mul_pd(u_x, u_x), _mm256_mul_pd(u_y, u_y));
+        _mm256_storeu_pd(&results.proj_ratio[i], _mm256_div_pd(u_dot_v, v_len2_4));
+        _mm256_storeu_pd(&results.sq_distance[i],
+                         _mm256_sub_pd(u_len2, _mm256_div_pd(_mm256_mul_pd(u_dot_v, u_dot_v), v_len2_4)));
+    }
+#elif defined(__SSE2__)
+    const __m128d a_x2 = _mm_set1_pd(a.x);
+    const __m128d a_y2 = _mm_set1_pd(a.y);
+    const __m128d v_x2 = _mm_set1_pd(v_x);
+    const __m128d v_y2 = _mm_set1_pd(v_y);
+    const __m128d v_len2_2 = _mm_set1_pd(v_len2);
+    for (; i + 2 <= count; i += 2) {
+        const __m128d u_x = _mm_sub_pd(_mm_loadu_pd(&items.x[i]), a_x2);
+        const __m128d u_y = _mm_sub_pd(_mm_loadu_pd(&items.y[i]), a_y2);
+        const __m128d u_dot_v = _mm_add_pd(_mm_mul_pd(u_x, v_x2), _mm_mul_pd(u_y, v_y2));
+        const __m128d u_len2 = _mm_add_pd(_mm_mul_pd(u_x, u_x), _mm_mul_pd(u_y, u_y));
+        _mm_storeu_pd(&results.proj_ratio[i], _mm_div_pd(u_dot_v, v_len2_2));
+        _mm_storeu_pd(&results.sq_distance[i],
+                      _mm_sub_pd(u_len2, _mm_div_pd(_mm_mul_pd(u_dot_v, u_dot_v), v_len2_2)));
+    }
+#endif
+    // Остаток, не кратный ширине SIMD-регистра, и сборки без SIMD
+    TryCollectPointsTail(a, b, items, results, i);
+}
+
+namespace {
+
+// Broad-phase: предметы раскладываются по ячейкам равномерной сетки, и для собирателя
+// проверяются только предметы из ячеек, которые накрывает прямоугольник вокруг его пути.
+class ItemsGrid {
+public:
+    explicit ItemsGrid(const ItemGathererProvider& provider) {
+        items_.reserve(provider.ItemsCount());
+        for (size_t i = 0; i < provider.ItemsCount(); ++i) {
+            const Item& item = items_.emplace_back(provider.GetItem(i));
+            max_item_width_ = std::max(max_item_width_, item.width);
+            cells_[{ToCell(item.position.x), ToCell(item.position.y)}].push_back(i);
+        }
+    }
+
+    const std::vector<Item>& GetItems() const {
+        return items_;
+    }
+
+    // Заполняет candidates индексами предметов, которые может подобрать собиратель,
+    // в порядке возрастания, чтобы события шли в том же порядке, что и при полном переборе
+    void FindCandidates(const Gatherer& gatherer, std::vector<size_t>& candidates) const {
+        candidates.clear();
+        // Небольшой запас компенсирует погрешность вычисления расстояния в TryCollectPoint
+        const double reach = gatherer.width + max_item_width_ + REACH_EPSILON;
+        const auto min_x = ToCell(std::min(gatherer.start_pos.x, gatherer.end_pos.x) - reach);
+        const auto max_x = ToCell(std::max(gatherer.start_pos.x, gatherer.end_pos.x) + reach);
+        const auto min_y = ToCell(std::min(gatherer.start_pos.y, gatherer.end_pos.y) - reach);
+        const auto max_y = ToCell(std::max(gatherer.start_pos.y, gatherer.end_pos.y) + reach);
+
+        const double cells_count = (static_cast<double>(max_x - min_x) + 1) * (static_cast<double>(max_y - min_y) + 1);
+        if (cells_count > static_cast<double>(std::max(cells_.size(), items_.size()))) {
+            // Путь накрывает больше ячеек, чем есть предметов — дешевле проверить все
+            candidates.resize(items_.size());
+            std::iota(candidates.begin(), candidates.end(), size_t{0});
+            return;
+        }
+        for (auto cell_x = min_x; cell_x <= max_x; ++cell_x) {
+            for (auto cell_y = min_y; cell_y <= max_y; ++cell_y) {
+                if (auto it = cells_.find({cell_x, cell_y}); it != cells_.end()) {
+                    candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+                }
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+    }
+
+private:
+    using CellKey = std::pair<std::int64_t, std::int64_t>;
+    struct CellKeyHasher {
+        size_t operator()(const CellKey& key) const {
+            size_t hash_value = std::hash<std::int64_t>()(key.first);
+            hash_value ^= std::hash<std::int64_t>()(key.second) + 0x9e3779b9 + (hash_value << 6) + (hash_value >> 2);
+            return hash_value;
+        }
+    };
+
+    // Сторона ячейки соизмерима с шириной дороги и путём пса за тик
+    constexpr static double CELL_SIZE = 2.0;
+    constexpr static double REACH_EPSILON = 1e-6;
+
+    static std::int64_t ToCell(double coord) {
+        return static_cast<std::int64_t>(std::floor(coord / CELL_SIZE));
+    }
+
+    std::vector<Item> items_;
+    double max_item_width_ = 0.0;
+    std::unordered_map<CellKey, std::vector<size_t>, CellKeyHasher> cells_;
+};
+
+}  // namespace
+
 std::vector<GatheringEvent> FindGatherEvents(
     const ItemGathererProvider& provider) {
     std::vector<GatheringEvent> detected_events;
@@ -30,18 +183,28 @@ std::vector<GatheringEvent> FindGatherEvents(
         return p1.x == p2.x && p1.y == p2.y;
     };
 
+    const ItemsGrid items_grid(provider);
+    const auto& items = items_grid.GetItems();
+    std::vector<size_t> candidates;
+    ItemsBatch batch;
+    CollectionResults results;
+
     for (size_t g = 0; g < provider.GatherersCount(); ++g) {
         Gatherer gatherer = provider.GetGatherer(g);
         if (eq_pt(gatherer.start_pos, gatherer.end_pos)) {
             continue;
         }
-        for (size_t i = 0; i < provider.ItemsCount(); ++i) {
-            Item item = provider.GetItem(i);
-            auto collect_result
-                = TryCollectPoint(gatherer.start_pos, gatherer.end_pos, item.position);
+        items_grid.FindCandidates(gatherer, candidates);
+        batch.Clear();
+        for (size_t i : candidates) {
+            batch.Add(items[i]);
+        }
+        TryCollectPoints(gatherer.start_pos, gatherer.end_pos, batch, results);
+        for (size_t k = 0; k < candidates.size(); ++k) {
+            const CollectionResult collect_result{results.sq_distance[k], results.proj_ratio[k]};
 
-            if (collect_result.IsCollected(gatherer.width + item.width)) {
-                GatheringEvent evt{.item_id = i,
+            if (collect_result.IsCollected(gatherer.width + batch.width[k])) {
+                GatheringEvent evt{.item_id = candidates[k],
                                    .gatherer_id = g,
                                    .sq_distance = collect_result.sq_distance,
                                    .time = collect_result.proj_ratio};
@@ -31,6 +31,43 @@ struct Item {
     double width;
 };
 
+// Предметы в виде структуры массивов: координаты и ширины лежат подряд,
+// что позволяет обрабатывать несколько предметов одной SIMD-инструкцией
+struct ItemsBatch {
+    void Clear() {
+        x.clear();
+        y.clear();
+        width.clear();
+    }
+
+    void Add(const Item& item) {
+        x.push_back(item.position.x);
+        y.push_back(item.position.y);
+        width.push_back(item.width);
+    }
+
+    size_t Size() const {
+        return x.size();
+    }
+
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> width;
+};
+
+// Результаты TryCollectPoint для пакета предметов, i-й элемент соответствует i-му предмету
+struct CollectionResults {
+    std::vector<double> sq_distance;
+    std::vector<double> proj_ratio;
+};
+
+// Пакетный вариант TryCollectPoint: движемся из a в b и пытаемся подобрать все предметы пакета.
+// Использует AVX или SSE2, если они доступны при сборке, иначе TryCollectPointsScalar.
+void TryCollectPoints(geom::Point2D a, geom::Point2D b, const ItemsBatch& items, CollectionResults& results);
+
+// Скалярная реализация TryCollectPoints
+void TryCollectPointsScalar(geom::Point2D a, geom::Point2D b, const ItemsBatch& items, CollectionResults& results);
+
 struct Gatherer {
     geom::Point2D start_pos;
     geom::Point2D end_pos;
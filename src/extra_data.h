@@ -12,6 +12,8 @@ using namespace boost::json;
 
 class ExtraData {
 public:
+    // Без дополнительных данных карт
+    ExtraData() = default;
     explicit ExtraData(const std::filesystem::path& json_path) {
         std::ifstream file(json_path);
         std::string input(std::istreambuf_iterator<char>(file), {});
@@ -0,0 +1,303 @@
+#include "game_state_hub.h"
+
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/post.hpp>
+
+namespace http_handler {
+
+namespace json = boost::json;
+using namespace std::literals;
+
+namespace {
+
+StringResponse MakeRejectResponse(http::status status, unsigned http_version,
+                                  std::string_view code, std::string_view message) {
+    StringResponse response(status, http_version);
+    json::object obj;
+    obj["code"] = code;
+    obj["message"] = message;
+    response.set(http::field::content_type, ContentType::JSON);
+    response.set(http::field::cache_control, "no-cache");
+    response.body() = json::serialize(obj);
+    response.content_length(response.body().size());
+    response.keep_alive(false);
+    return response;
+}
+
+std::shared_ptr<const std::string> MakeFrame(const json::object& obj) {
+    return std::make_shared<const std::string>(json::serialize(obj));
+}
+
+// Возвращает значение заголовка Authorization или формирует его из параметра token
+std::string GetAuthorization(const StringRequest& req) {
+    if (req.find(http::field::authorization) != req.end()) {
+        return std::string(req.at(http::field::authorization));
+    }
+    const auto params = ExtractUrlParams(std::string(req.target()));
+    if (params) {
+        for (const auto& [key, value] : *params) {
+            if (key == "token"s) {
+                return "Bearer "s + value;
+            }
+        }
+    }
+    return {};
+}
+
+}  // namespace
+
+std::string MakeFullStateFrame(const model::GameSession* session_ptr) {
+    auto obj = MakeGameStateJson(session_ptr);
+    obj["tick"] = session_ptr->GetTick();
+    obj["full"] = true;
+    return json::serialize(obj);
+}
+
+std::string MakeDeltaStateFrame(const model::GameSession* session_ptr) {
+    const auto tick = session_ptr->GetTick();
+    return json::serialize(MakeGameStateDeltaJson(session_ptr, *session_ptr->GetChangesSince(tick - 1)));
+}
+
+WebSocketSession::WebSocketSession(tcp::socket&& socket, std::shared_ptr<GameStateHub> hub)
+    : ws_(std::move(socket)), hub_(std::move(hub)) {
+}
+
+void WebSocketSession::Start(StringRequest&& req, std::string authorization) {
+    net::dispatch(ws_.get_executor(), [self = shared_from_this(), req = std::move(req),
+                                       authorization = std::move(authorization)]() mutable {
+        self->authorization_ = std::move(authorization);
+        self->upgrade_request_ = std::move(req);
+        self->ws_.set_option(websocket::stream_base::timeout::suggested(beast::role_type::server));
+        self->ws_.async_accept(self->upgrade_request_,
+                               beast::bind_front_handler(&WebSocketSession::OnAccept, self));
+    });
+}
+
+void WebSocketSession::Reject(StringResponse&& response) {
+    net::dispatch(ws_.get_executor(), [self = shared_from_this(), response = std::move(response)]() mutable {
+        auto safe_response = std::make_shared<StringResponse>(std::move(response));
+        self->is_closed_ = true;
+        http::async_write(self->ws_.next_layer(), *safe_response,
+                          [self, safe_response](beast::error_code, std::size_t) {
+                              beast::error_code ec;
+                              self->ws_.next_layer().socket().shutdown(tcp::socket::shutdown_send, ec);
+                          });
+    });
+}
+
+void WebSocketSession::Send(std::shared_ptr<const std::string> frame) {
+    net::dispatch(ws_.get_executor(), [self = shared_from_this(), frame = std::move(frame)]() mutable {
+        if (self->is_closed_) {
+            return;
+        }
+        if (self->write_queue_.size() >= GameStateHub::MAX_PENDING_FRAMES) {
+            // Клиент не успевает принимать состояние: пропуск кадров нарушил бы цепочку изменений
+            return self->DoClose();
+        }
+        self->write_queue_.push_back(std::move(frame));
+        if (self->is_accepted_ && self->write_queue_.size() == 1) {
+            self->Write();
+        }
+    });
+}
+
+void WebSocketSession::Close() {
+    net::dispatch(ws_.get_executor(), [self = shared_from_this()] {
+        self->DoClose();
+    });
+}
+
+void WebSocketSession::OnAccept(beast::error_code ec) {
+    if (ec) {
+        is_closed_ = true;
+        return;
+    }
+    is_accepted_ = true;
+    // Кадры, поставленные в очередь до завершения рукопожатия
+    if (!write_queue_.empty()) {
+        Write();
+    }
+    Read();
+}
+
+void WebSocketSession::Read() {
+    buffer_.clear();
+    ws_.async_read(buffer_, beast::bind_front_handler(&WebSocketSession::OnRead, shared_from_this()));
+}
+
+void WebSocketSession::OnRead(beast::error_code ec, [[maybe_unused]] std::size_t bytes_read) {
+    if (ec) {
+        // Клиент закрыл соединение или произошла ошибка чтения. Очередь не очищается:
+        // первый кадр может записываться, его освободит OnWrite
+        is_closed_ = true;
+        return;
+    }
+    hub_->HandleMessage(shared_from_this(), authorization_, beast::buffers_to_string(buffer_.data()));
+    Read();
+}
+
+void WebSocketSession::Write() {
+    ws_.text(true);
+    const auto& frame = write_queue_.front();
+    ws_.async_write(net::buffer(*frame), beast::bind_front_handler(&WebSocketSession::OnWrite, shared_from_this()));
+}
+
+void WebSocketSession::OnWrite(beast::error_code ec, [[maybe_unused]] std::size_t bytes_written) {
+    if (ec) {
+        is_closed_ = true;
+        write_queue_.clear();
+        return;
+    }
+    write_queue_.pop_front();
+    if (is_closed_) {
+        write_queue_.clear();
+        return;
+    }
+    if (!write_queue_.empty()) {
+        Write();
+    }
+}
+
+void WebSocketSession::DoClose() {
+    if (is_closed_) {
+        return;
+    }
+    is_closed_ = true;
+    if (!is_accepted_) {
+        beast::error_code ec;
+        ws_.next_layer().socket().shutdown(tcp::socket::shutdown_both, ec);
+        return;
+    }
+    ws_.async_close(websocket::close_code::normal, [self = shared_from_this()](beast::error_code) {});
+}
+
+bool GameStateHub::IsWebSocketTarget(std::string_view target) {
+    constexpr auto path = "/api/v1/game/ws"sv;
+    return target == path || (target.starts_with(path) && target.at(path.size()) == '?');
+}
+
+void GameStateHub::Accept(tcp::socket&& socket, StringRequest&& req) {
+    auto session = std::make_shared<WebSocketSession>(std::move(socket), shared_from_this());
+    if (!IsWebSocketTarget(req.target())) {
+        return session->Reject(MakeRejectResponse(http::status::bad_request, req.version(),
+                                                  "badRequest"sv, "Invalid endpoint"sv));
+    }
+    net::dispatch(api_strand_, [self = shared_from_this(), session, req = std::move(req)]() mutable {
+        self->Subscribe(std::move(session), std::move(req));
+    });
+}
+
+void GameStateHub::Subscribe(std::shared_ptr<WebSocketSession> session, StringRequest&& req) {
+    assert(api_strand_.running_in_this_thread());
+    auto authorization = GetAuthorization(req);
+    try {
+        AddSubscriber(session, authorization);
+        session->Start(std::move(req), std::move(authorization));
+    } catch (const app::GetGameStateError& ec) {
+        if (ec.What() == app::GetGameStateError::GetGameStateErrorReason::INVALID_AUTH_FIELD) {
+            session->Reject(MakeRejectResponse(http::status::unauthorized, req.version(),
+                                               "invalidToken"sv, "Authorization header is required"sv));
+        } else {
+            session->Reject(MakeRejectResponse(http::status::unauthorized, req.version(),
+                                               "unknownToken"sv, "Player token has not been found"sv));
+        }
+    }
+}
+
+void GameStateHub::AddSubscriber(std::shared_ptr<GameStateSubscriber> subscriber, std::string authorization) {
+    assert(api_strand_.running_in_this_thread());
+    const auto session_view = app_.GetGameStateUseCase(authorization);
+    subscribers_[session_view.session->GetIDMap()].push_back({std::move(subscriber), std::move(authorization), std::nullopt});
+}
+
+size_t GameStateHub::GetSubscribersCount() const {
+    assert(api_strand_.running_in_this_thread());
+    size_t count = 0;
+    for (const auto& [map_id, subscribers] : subscribers_) {
+        count += subscribers.size();
+    }
+    return count;
+}
+
+void GameStateHub::OnTick([[maybe_unused]] std::chrono::milliseconds time_delta) {
+    assert(api_strand_.running_in_this_thread());
+    for (auto it = subscribers_.begin(); it != subscribers_.end();) {
+        auto& subscribers = it->second;
+        // Кадры сессии формируются один раз и разделяются всеми подписчиками
+        std::shared_ptr<const std::string> full_frame;
+        std::shared_ptr<const std::string> delta_frame;
+        for (auto& subscriber : subscribers) {
+            auto session = subscriber.session.lock();
+            if (!session) {
+                continue;
+            }
+            // Блокировка сессии снимается в конце итерации, до обращения к следующему подписчику
+            app::SessionView session_view;
+            try {
+                session_view = app_.GetGameStateUseCase(subscriber.authorization);
+            } catch (const app::GetGameStateError&) {
+                // Игрок ушёл на покой, его токен больше не действителен
+                session->Close();
+                subscriber.session.reset();
+                continue;
+            }
+            const auto session_ptr = session_view.session;
+            const auto tick = session_ptr->GetTick();
+            if (subscriber.last_tick == tick) {
+                continue;
+            }
+            if (subscriber.last_tick && *subscriber.last_tick + 1 == tick) {
+                if (!delta_frame) {
+                    delta_frame = std::make_shared<const std::string>(MakeDeltaStateFrame(session_ptr));
+                }
+                session->Send(delta_frame);
+            } else {
+                if (!full_frame) {
+                    full_frame = std::make_shared<const std::string>(MakeFullStateFrame(session_ptr));
+                }
+                session->Send(full_frame);
+            }
+            subscriber.last_tick = tick;
+        }
+        std::erase_if(subscribers, [](const Subscriber& subscriber) {
+            return subscriber.session.expired();
+        });
+        if (subscribers.empty()) {
+            it = subscribers_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void GameStateHub::HandleMessage(std::shared_ptr<WebSocketSession> session, std::string authorization, std::string message) {
+    const auto map_id = app_.FindPlayerMapUseCase(authorization);
+    if (!map_id) {
+        // Игрок ушёл на покой, его токен больше не действителен
+        return session->Close();
+    }
+    // Команда выполняется в strand сессии игрока, как и команды, полученные по HTTP
+    const auto strand = app_.FindSessionStrand(*map_id);
+    net::dispatch(strand ? *strand : api_strand_, [self = shared_from_this(), session = std::move(session),
+                                                   authorization = std::move(authorization), message = std::move(message)] {
+        // Команда имеет тот же формат, что и тело запроса /api/v1/game/player/action
+        boost::system::error_code ec;
+        json::value value = json::parse(message, ec);
+        try {
+            if (ec) {
+                throw std::invalid_argument("Invalid JSON");
+            }
+            const std::string move_direction(value.as_object().at("move").as_string().c_str());
+            self->app_.MovePlayersUseCase(authorization, move_direction);
+        } catch (const app::MovePlayersError& error) {
+            if (error.What() != app::MovePlayersError::MovePlayersErrorReason::INVALID_MOVE_ARG) {
+                return session->Close();
+            }
+            session->Send(MakeFrame({{"code", "invalidArgument"}, {"message", "Failed to parse action"}}));
+        } catch (const std::exception&) {
+            session->Send(MakeFrame({{"code", "invalidArgument"}, {"message", "Failed to parse action"}}));
+        }
+    });
+}
+
+}  // namespace http_handler
@@ -0,0 +1,115 @@
+#pragma once
+// boost.beast будет использовать std::string_view вместо boost::string_view
+#define BOOST_BEAST_USE_STD_STRING_VIEW
+
+#include <boost/beast/websocket.hpp>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include "request_handler.h"
+
+namespace http_handler {
+
+namespace websocket = beast::websocket;
+using tcp = net::ip::tcp;
+
+class GameStateHub;
+
+// Кадр с полным состоянием сессии на её текущий тик: состояние /api/v1/game/state с полями tick и full
+std::string MakeFullStateFrame(const model::GameSession* session_ptr);
+// Кадр с изменениями сессии за её последний тик. Сессия должна выполнить хотя бы один тик
+std::string MakeDeltaStateFrame(const model::GameSession* session_ptr);
+
+// Получатель кадров состояния игровой сессии
+class GameStateSubscriber {
+public:
+    // Ставит кадр в очередь на отправку. Может вызываться из любого потока
+    virtual void Send(std::shared_ptr<const std::string> frame) = 0;
+    // Прекращает получение кадров. Может вызываться из любого потока
+    virtual void Close() = 0;
+
+protected:
+    ~GameStateSubscriber() = default;
+};
+
+// WebSocket-соединение игрока. Получает состояние сессии после каждого тика
+// и принимает команды движения. Все операции с сокетом выполняются в его strand.
+// Клиент, накопивший MAX_PENDING_FRAMES неотправленных кадров, отключается
+class WebSocketSession : public GameStateSubscriber, public std::enable_shared_from_this<WebSocketSession> {
+public:
+    WebSocketSession(tcp::socket&& socket, std::shared_ptr<GameStateHub> hub);
+
+    // Завершает установку соединения и начинает чтение команд игрока
+    void Start(StringRequest&& req, std::string authorization);
+    // Отклоняет запрос на подключение HTTP-ответом и закрывает сокет
+    void Reject(StringResponse&& response);
+    void Send(std::shared_ptr<const std::string> frame) override;
+    // Закрывает соединение
+    void Close() override;
+
+private:
+    void OnAccept(beast::error_code ec);
+    void Read();
+    void OnRead(beast::error_code ec, [[maybe_unused]] std::size_t bytes_read);
+    void Write();
+    void OnWrite(beast::error_code ec, [[maybe_unused]] std::size_t bytes_written);
+    void DoClose();
+
+    websocket::stream<beast::tcp_stream> ws_;
+    beast::flat_buffer buffer_;
+    StringRequest upgrade_request_;
+    std::shared_ptr<GameStateHub> hub_;
+    std::string authorization_;
+    // Кадры, ожидающие отправки. Первый кадр очереди записывается в данный момент,
+    // поэтому при начатой записи очередь очищает только OnWrite
+    std::deque<std::shared_ptr<const std::string>> write_queue_;
+    bool is_accepted_ = false;
+    bool is_closed_ = false;
+};
+
+// Рассылает состояние игровых сессий подписанным WebSocket-клиентам после каждого тика.
+// Новый подписчик получает полный снимок, далее - только изменения за тик
+class GameStateHub : public app::ApplicationListener, public std::enable_shared_from_this<GameStateHub> {
+public:
+    using Strand = net::strand<net::io_context::executor_type>;
+
+    // Количество неотправленных кадров, после которого медленный клиент отключается
+    static constexpr size_t MAX_PENDING_FRAMES = 64;
+
+    GameStateHub(Strand api_strand, app::Application& app)
+        : api_strand_{api_strand}, app_(app) {}
+
+    static bool IsWebSocketTarget(std::string_view target);
+
+    // Аутентифицирует игрока по токену из заголовка Authorization или параметра token
+    // и подписывает соединение на состояние его игровой сессии
+    void Accept(tcp::socket&& socket, StringRequest&& req);
+    // Подписывает получателя на состояние игровой сессии игрока с заголовком authorization.
+    // Бросает app::GetGameStateError, если токен недействителен. Вызывается внутри api_strand
+    void AddSubscriber(std::shared_ptr<GameStateSubscriber> subscriber, std::string authorization);
+    // Количество подписчиков всех сессий. Вызывается внутри api_strand
+    size_t GetSubscribersCount() const;
+    // Вызывается внутри api_strand после каждого тика
+    void OnTick(std::chrono::milliseconds time_delta) override;
+    // Выполняет команду, полученную по WebSocket, в strand сессии игрока
+    void HandleMessage(std::shared_ptr<WebSocketSession> session, std::string authorization, std::string message);
+
+private:
+    struct Subscriber {
+        std::weak_ptr<GameStateSubscriber> session;
+        std::string authorization;
+        // Тик, состояние на который уже отправлено клиенту
+        std::optional<std::uint64_t> last_tick;
+    };
+    using MapIdHasher = util::TaggedHasher<model::Map::Id>;
+
+    void Subscribe(std::shared_ptr<WebSocketSession> session, StringRequest&& req);
+
+    Strand api_strand_;
+    app::Application& app_;
+    // Подписчики по картам. Используются только внутри api_strand
+    std::unordered_map<model::Map::Id, std::vector<Subscriber>, MapIdHasher> subscribers_;
+};
+
+}  // namespace http_handler
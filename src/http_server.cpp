@@ -40,7 +40,13 @@ namespace http_server {
         if (ec) {
             return ReportError(ec, "read"sv);
         }
-        HandleRequest(std::move(request_), stream_.socket().remote_endpoint().address().to_string());
+        auto client_ip = stream_.socket().remote_endpoint().address().to_string();
+        if (beast::websocket::is_upgrade(request_)) {
+            // Дальше соединение обслуживается по протоколу WebSocket, HTTP-сессия завершается
+            stream_.expires_never();
+            return HandleUpgrade(stream_.release_socket(), std::move(request_), std::move(client_ip));
+        }
+        HandleRequest(std::move(request_), std::move(client_ip));
     }
 
     void SessionBase::OnWrite(bool close, beast::error_code ec, [[maybe_unused]] std::size_t bytes_written) {
@@ -7,8 +7,10 @@
 #include <boost/asio/strand.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
+#include <boost/beast/websocket.hpp>
 #include <iostream>
 #include  <variant>
+#include "shared_body.h"
 #include "logging.h"
 #include "request_handler.h"
 
@@ -23,7 +25,9 @@ namespace http = beast::http;
 namespace sys = boost::system;
 using StringResponse = http::response<http::string_body>;
 using FileResponse = http::response<http::file_body>;
-using Response = std::variant<StringResponse, FileResponse>;
+// Ответ, тело которого разделяется между несколькими ответами без копирования
+using SharedStringResponse = http::response<http_body::SharedStringBody>;
+using Response = std::variant<StringResponse, FileResponse, SharedStringResponse>;
 
 void ReportError(beast::error_code ec, std::string_view what);
 
@@ -64,6 +68,8 @@ private:
 
     // Обработку запроса делегируем подклассу
     virtual void HandleRequest(HttpRequest&& request, std::string client_ip) = 0;
+    // Запрос на установку WebSocket-соединения, сокет передаётся подклассу
+    virtual void HandleUpgrade(tcp::socket&& socket, HttpRequest&& request, std::string client_ip) = 0;
 
     virtual std::shared_ptr<SessionBase> GetSharedThis() = 0;
 };
@@ -82,21 +88,18 @@ private:
         // Захватываем умный указатель на текущий объект Session в лямбде,
         // чтобы продлить время жизни сессии до вызова лямбды.
         // Используется generic-лямбда функция, способная принять response произвольного типа
-
-        auto start_response_time = std::chrono::high_resolution_clock::now();
-        request_handler_(std::move(request), client_ip, [self = this->shared_from_this(), this, client_ip, start_response_time](auto&& response) {  
-            auto end_response_time = std::chrono::high_resolution_clock::now();
-            auto duration_response_time = std::chrono::duration_cast<std::chrono::microseconds>(end_response_time - start_response_time).count();
-            if(std::holds_alternative<StringResponse>(response)){
-                request_handler_.LogResponse(response, client_ip, duration_response_time);
-                self->Write(std::move(std::get<StringResponse>(response)));
-            } else if(std::holds_alternative<FileResponse>(response)) {
-                request_handler_.LogResponse(response, client_ip, duration_response_time);
-                self->Write(std::move(std::get<FileResponse>(response)));
-            }
+        // Время ответа измеряет и выводит в журнал декоратор обработчика
+        request_handler_(std::move(request), client_ip, [self = this->shared_from_this()](auto&& response) {  
+            std::visit([&self](auto&& typed_response) {
+                self->Write(std::move(typed_response));
+            }, std::move(response));
         });
     }
 
+    void HandleUpgrade(tcp::socket&& socket, HttpRequest&& request, std::string client_ip) override {
+        request_handler_.HandleUpgrade(std::move(socket), std::move(request), client_ip);
+    }
+
     std::shared_ptr<SessionBase> GetSharedThis() override {
         return this->shared_from_this();
     }
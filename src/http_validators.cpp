@@ -0,0 +1,95 @@
+#include "http_validators.h"
+
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+
+namespace http_handler {
+
+using namespace std::literals;
+
+namespace {
+
+// Слабое сравнение ETag не учитывает признак W/
+std::string_view StripWeakPrefix(std::string_view etag) {
+    if(etag.starts_with("W/"sv)) {
+        etag.remove_prefix(2);
+    }
+    return etag;
+}
+
+}  // namespace
+
+std::string_view Trim(std::string_view str) {
+    const auto begin = str.find_first_not_of(" \t"sv);
+    if(begin == std::string_view::npos) {
+        return {};
+    }
+    return str.substr(begin, str.find_last_not_of(" \t"sv) - begin + 1);
+}
+
+std::string FormatHttpDate(std::time_t time) {
+    std::tm tm{};
+    gmtime_r(&time, &tm);
+    char buffer[32];
+    const auto size = std::strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return {buffer, size};
+}
+
+std::optional<std::time_t> ParseHttpDate(std::string_view date) {
+    std::tm tm{};
+    std::istringstream in{std::string(date)};
+    in.imbue(std::locale::classic());
+    in >> std::get_time(&tm, "%a, %d %b %Y %H:%M:%S GMT");
+    if(in.fail()) {
+        return std::nullopt;
+    }
+    return timegm(&tm);
+}
+
+std::string MakeFileETag(std::int64_t modification_time, std::uintmax_t size) {
+    char buffer[48];
+    const int length = std::snprintf(buffer, sizeof(buffer), "\"%llx-%llx\"",
+                                     static_cast<unsigned long long>(modification_time),
+                                     static_cast<unsigned long long>(size));
+    return {buffer, static_cast<std::size_t>(length)};
+}
+
+std::string MakeContentETag(std::string_view content) {
+    std::uint64_t hash = 14695981039346656037ull;
+    for(const unsigned char ch : content) {
+        hash ^= ch;
+        hash *= 1099511628211ull;
+    }
+    char buffer[48];
+    const int length = std::snprintf(buffer, sizeof(buffer), "\"%016llx-%zx\"",
+                                     static_cast<unsigned long long>(hash), content.size());
+    return {buffer, static_cast<std::size_t>(length)};
+}
+
+bool IsETagMatched(std::string_view if_none_match, std::string_view etag) {
+    etag = StripWeakPrefix(etag);
+    while(!if_none_match.empty()) {
+        const auto comma = if_none_match.find(',');
+        const auto candidate = Trim(if_none_match.substr(0, comma));
+        if_none_match = comma == std::string_view::npos ? std::string_view{} : if_none_match.substr(comma + 1);
+        if(candidate == "*"sv || StripWeakPrefix(candidate) == etag) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool IsNotModified(const RequestValidators& validators, std::string_view etag,
+                   std::optional<std::time_t> last_modified) {
+    if(!validators.if_none_match.empty()) {
+        return IsETagMatched(validators.if_none_match, etag);
+    }
+    if(validators.if_modified_since.empty() || !last_modified) {
+        return false;
+    }
+    const auto if_modified_since = ParseHttpDate(validators.if_modified_since);
+    return if_modified_since && *last_modified <= *if_modified_since;
+}
+
+}  // namespace http_handler
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace http_handler {
+
+// Убирает пробелы и табуляции по краям значения или элемента списка в заголовке
+std::string_view Trim(std::string_view str);
+
+// Время в формате HTTP-date (IMF-fixdate): "Sun, 06 Nov 1994 08:49:37 GMT"
+std::string FormatHttpDate(std::time_t time);
+// Разбирает HTTP-date в формате IMF-fixdate. Устаревшие форматы не поддерживаются
+std::optional<std::time_t> ParseHttpDate(std::string_view date);
+
+// Строгий ETag файла вида "<время изменения>-<размер>" в шестнадцатеричной записи
+std::string MakeFileETag(std::int64_t modification_time, std::uintmax_t size);
+// Строгий ETag содержимого, сформированного сервером: хэш FNV-1a и размер
+std::string MakeContentETag(std::string_view content);
+
+// Заголовки условного запроса
+struct RequestValidators {
+    std::string_view if_none_match;
+    std::string_view if_modified_since;
+};
+
+// Совпадает ли один из ETag заголовка If-None-Match с etag. Сравнение слабое, как требует RFC 9110
+bool IsETagMatched(std::string_view if_none_match, std::string_view etag);
+// Актуально ли представление у клиента, то есть можно ли ответить 304 Not Modified.
+// If-Modified-Since учитывается, только если в запросе нет If-None-Match
+bool IsNotModified(const RequestValidators& validators, std::string_view etag,
+                   std::optional<std::time_t> last_modified = std::nullopt);
+
+}  // namespace http_handler
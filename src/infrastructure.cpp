@@ -1,39 +1,411 @@
 #include "infrastructure.h"
+#include <boost/archive/archive_exception.hpp>
 #include <boost/archive/binary_oarchive.hpp>
 #include <boost/archive/binary_iarchive.hpp>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <thread>
 #include "model_serialization.h"
 #include "app_serialization.h"
+#include "state_file.h"
 
 
 namespace infra {
-    
+
+SerializationListener::~SerializationListener() {
+    ReapSnapshot(true);
+}
+
 void SerializationListener::OnTick(SerializationListener::TimeInterval time_delta) {
+    ReapSnapshot(false);
+    if(is_incremental_) {
+        // История изменений сессии хранит лишь MAX_CHANGES_HISTORY тиков, а период сохранения
+        // может быть длиннее, поэтому изменения собираются каждый тик. История меняется только
+        // во время тика, а OnTick вызывается после него, поэтому блокировка не нужна
+        CollectChanges();
+    }
     if(game_.IsGameAuto()) {
-        if(time_since_save_ + time_delta > save_period_) {
-            time_since_save_ = TimeInterval{0};
-        } else {
-            time_since_save_ += time_delta;
+        time_since_save_ += time_delta;
+        if(time_since_save_ < save_period_) {
+            return;
         }
+        time_since_save_ = TimeInterval{0};
+    }
+    const auto state_lock = state_locker_ ? state_locker_() : app::StateReadLock{};
+    if(is_incremental_) {
+        SaveChanges();
+    } else if(snapshot_pid_ < 0) {
+        StartSnapshot();
+    } else {
+        // Прошлый снимок ещё записывается, состояние сохранится в следующий период
+        SkipSnapshot();
     }
-    auto temp_path = path_to_state_file_.string() + "_temp"s;
-    std::ofstream out{temp_path, std::ios_base::binary};
-    boost::archive::binary_oarchive ar{out};
-    serialization::SessionsRepr sessions_repr(game_.GetSessions());
-    serialization::PlayersRepr players_repr{players_};
-    serialization::PlayerTokensRepr players_tokens_repr{player_tokens_};
-    ar << sessions_repr;
-    ar << players_repr;
-    ar << players_tokens_repr;
-    // Перезаписываем временный файл в целевой
-    std::filesystem::rename(temp_path, path_to_state_file_);
 }
 
 void SerializationListener::SetSavePeriod(std::chrono::milliseconds save_period) {
     save_period_ = save_period;
 }
 
+void SerializationListener::SetStateLocker(StateLocker locker) {
+    state_locker_ = std::move(locker);
+}
+
+void SerializationListener::SetForker(Forker forker) {
+    forker_ = std::move(forker);
+}
+
 void SerializationListener::SetPathToStateFile(std::filesystem::path path_to_state_file) {
     path_to_state_file_ = path_to_state_file;
 }
 
-}
\ No newline at end of file
+void SerializationListener::SetIncremental(bool is_incremental) {
+    is_incremental_ = is_incremental;
+}
+
+bool SerializationListener::LoadState() {
+    if(!std::filesystem::exists(path_to_state_file_)) {
+        return false;
+    }
+    if(state_file::IsStateFile(path_to_state_file_)) {
+        const auto info = state_file::Load(path_to_state_file_, game_, players_, player_tokens_);
+        checkpoint_id_ = info.checkpoint_id;
+        checkpoint_journal_offset_ = info.journal_offset;
+    } else {
+        // Сохранение прежней версии сервера - архив boost::serialization.
+        // Следующая контрольная точка будет записана уже в новом формате
+        std::ifstream in{path_to_state_file_, std::ios_base::binary};
+        boost::archive::binary_iarchive ar{in};
+        serialization::SessionsRepr sessions_repr{};
+        serialization::PlayersRepr players_repr{};
+        serialization::PlayerTokensRepr players_tokens_repr{};
+        ar >> sessions_repr;
+        ar >> players_repr;
+        ar >> players_tokens_repr;
+        game_.SetSessions(sessions_repr.Restore(game_));
+        players_.SetPlayers(players_repr.Restore());
+        player_tokens_.SetTokens(players_tokens_repr.Restore(players_));
+        try {
+            ar >> checkpoint_id_;
+            ar >> checkpoint_journal_offset_;
+        } catch (const boost::archive::archive_exception&) {
+            // Файл записан без журнала, номера контрольной точки в нём нет
+            checkpoint_id_ = 0;
+            checkpoint_journal_offset_ = 0;
+        }
+    }
+    checkpoint_size_ = std::filesystem::file_size(path_to_state_file_);
+    ReplayJournal();
+    // Восстановленные сессии начинают отсчёт тиков заново
+    RememberSavedState();
+    return true;
+}
+
+void SerializationListener::ReplayJournal() {
+    const auto journal_path = GetJournalPath();
+    std::ifstream in{journal_path, std::ios_base::binary};
+    std::uint64_t journal_checkpoint_id = 0;
+    if(!in.read(reinterpret_cast<char*>(&journal_checkpoint_id), sizeof(journal_checkpoint_id))) {
+        return;
+    }
+    // Журнал прежней контрольной точки остаётся, если сервер завершился до его замены.
+    // Записи до начала снимка в контрольной точке уже учтены
+    std::uint64_t offset = 0;
+    if(journal_checkpoint_id == checkpoint_id_) {
+        offset = sizeof(journal_checkpoint_id);
+    } else if(journal_checkpoint_id + 1 == checkpoint_id_
+              && checkpoint_journal_offset_ <= std::filesystem::file_size(journal_path)) {
+        offset = checkpoint_journal_offset_;
+    } else {
+        return;
+    }
+    in.seekg(offset);
+    std::uint64_t valid_size = offset;
+    std::string record_data;
+    while(true) {
+        std::uint64_t record_size = 0;
+        if(!in.read(reinterpret_cast<char*>(&record_size), sizeof(record_size))) {
+            break;
+        }
+        record_data.resize(record_size);
+        // Запись, оборванная при аварийном завершении, отбрасывается
+        if(!in.read(record_data.data(), record_size)) {
+            break;
+        }
+        std::istringstream record_strm{record_data};
+        boost::archive::binary_iarchive ar{record_strm, boost::archive::no_header};
+        serialization::JournalRecordRepr record;
+        ar >> record;
+        record.Apply(game_, players_, player_tokens_);
+        valid_size += sizeof(record_size) + record_size;
+    }
+    in.close();
+    if(!is_incremental_) {
+        return;
+    }
+    // Продолжаем журнал после последней целой записи
+    std::filesystem::resize_file(journal_path, valid_size);
+    if(journal_checkpoint_id == checkpoint_id_) {
+        journal_.open(journal_path, std::ios_base::binary | std::ios_base::app);
+        journal_size_ = valid_size;
+    } else {
+        RotateJournal(offset);
+    }
+}
+
+void SerializationListener::SaveState() {
+    ReapSnapshot(true);
+    const auto journal_offset = journal_size_;
+    is_snapshot_covering_gap_ = is_full_snapshot_required_;
+    WriteCheckpoint(checkpoint_id_ + 1, journal_offset);
+    FinishSnapshot(journal_offset);
+    RememberSavedState();
+}
+
+void SerializationListener::StartSnapshot() {
+    const auto checkpoint_id = checkpoint_id_ + 1;
+    const auto journal_offset = journal_size_;
+    is_snapshot_covering_gap_ = is_full_snapshot_required_;
+    const pid_t pid = forker_ ? forker_() : fork();
+    if(pid == 0) {
+        // Дочерний процесс только записывает снимок и завершается, не выполняя деструкторы родителя
+        int exit_code = EXIT_SUCCESS;
+        try {
+            WriteCheckpoint(checkpoint_id, journal_offset);
+        } catch (...) {
+            exit_code = EXIT_FAILURE;
+        }
+        _exit(exit_code);
+    }
+    if(pid < 0) {
+        std::cerr << "Failed to start state snapshot process, saving synchronously"sv << std::endl;
+        WriteCheckpoint(checkpoint_id, journal_offset);
+        FinishSnapshot(journal_offset);
+    } else {
+        snapshot_pid_ = pid;
+        snapshot_journal_offset_ = journal_offset;
+        snapshot_deadline_ = std::chrono::steady_clock::now() + SNAPSHOT_TIMEOUT;
+        skipped_snapshots_ = 0;
+    }
+    // Дальнейшие записи журнала содержат только изменения после снимка
+    RememberSavedState();
+}
+
+void SerializationListener::ReapSnapshot(bool wait) {
+    if(snapshot_pid_ < 0) {
+        return;
+    }
+    int status = 0;
+    pid_t result = 0;
+    bool is_killed = false;
+    while(true) {
+        do {
+            result = waitpid(snapshot_pid_, &status, WNOHANG);
+        } while(result < 0 && errno == EINTR);
+        if(result != 0) {
+            break;
+        }
+        if(std::chrono::steady_clock::now() >= snapshot_deadline_) {
+            // Завершённый сигналом процесс дожидаемся без ограничения: SIGKILL не перехватывается
+            kill(snapshot_pid_, SIGKILL);
+            is_killed = true;
+            do {
+                result = waitpid(snapshot_pid_, &status, 0);
+            } while(result < 0 && errno == EINTR);
+            break;
+        }
+        if(!wait) {
+            // Снимок ещё записывается
+            return;
+        }
+        std::this_thread::sleep_for(SNAPSHOT_POLL_INTERVAL);
+    }
+    snapshot_pid_ = -1;
+    if(skipped_snapshots_ > 0) {
+        std::cerr << "State snapshots skipped while the previous one was written: "sv << skipped_snapshots_ << std::endl;
+    }
+    if(is_killed) {
+        // Прежняя контрольная точка и журнал остаются действительными
+        std::cerr << "State snapshot process timed out and was killed"sv << std::endl;
+        return;
+    }
+    if(result < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        std::cerr << "Failed to write state snapshot"sv << std::endl;
+        return;
+    }
+    FinishSnapshot(snapshot_journal_offset_);
+}
+
+void SerializationListener::SkipSnapshot() {
+    // Сообщаем о первом пропуске, общее число пропусков - после завершения записи
+    if(skipped_snapshots_++ == 0) {
+        std::cerr << "State snapshot skipped: the previous one is still being written"sv << std::endl;
+    }
+}
+
+void SerializationListener::WriteCheckpoint(std::uint64_t checkpoint_id, std::uint64_t journal_offset) const {
+    auto temp_path = path_to_state_file_.string() + "_temp"s;
+    state_file::CheckpointInfo info;
+    if(is_incremental_) {
+        info = {checkpoint_id, journal_offset};
+    }
+    state_file::Save(temp_path, game_, players_, player_tokens_, info);
+    // Перезаписываем временный файл в целевой
+    std::filesystem::rename(temp_path, path_to_state_file_);
+}
+
+void SerializationListener::FinishSnapshot(std::uint64_t journal_offset) {
+    if(!is_incremental_) {
+        return;
+    }
+    ++checkpoint_id_;
+    checkpoint_size_ = std::filesystem::file_size(path_to_state_file_);
+    RotateJournal(journal_offset);
+    if(is_snapshot_covering_gap_) {
+        is_full_snapshot_required_ = false;
+        is_snapshot_covering_gap_ = false;
+    }
+}
+
+void SerializationListener::RotateJournal(std::uint64_t offset) {
+    const auto journal_path = GetJournalPath();
+    const auto temp_path = journal_path.string() + "_temp"s;
+    journal_.close();
+    {
+        std::ofstream out{temp_path, std::ios_base::binary | std::ios_base::trunc};
+        out.write(reinterpret_cast<const char*>(&checkpoint_id_), sizeof(checkpoint_id_));
+        std::ifstream in{journal_path, std::ios_base::binary};
+        if(offset != 0 && in && in.seekg(offset)) {
+            std::copy(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>(),
+                      std::ostreambuf_iterator<char>(out));
+        }
+    }
+    // Журнал заменяется после записи контрольной точки: если сервер упадёт раньше,
+    // при загрузке старый журнал применится к новой точке с сохранённой в ней позиции
+    std::filesystem::rename(temp_path, journal_path);
+    journal_.open(journal_path, std::ios_base::binary | std::ios_base::app);
+    journal_size_ = std::filesystem::file_size(journal_path);
+}
+
+void SerializationListener::CollectChanges() {
+    for(const auto& [map_id, session] : game_.GetSessions()) {
+        // Сессия, созданная после прошлого сохранения, собирается с нулевого тика
+        auto& collected_tick = collected_ticks_[map_id];
+        if(collected_tick == session.GetTick()) {
+            continue;
+        }
+        const auto changes = session.GetChangesSince(collected_tick);
+        collected_tick = session.GetTick();
+        if(!changes) {
+            // Журнал не может восполнить пропуск, нужен полный снимок. Сохранённое состояние запомнит снимок
+            if(!is_full_snapshot_required_) {
+                std::cerr << "State journal cannot cover missed ticks, waiting for a full snapshot"sv << std::endl;
+            }
+            is_full_snapshot_required_ = true;
+            // Снимок, который уже записывается, пропуск не содержит
+            is_snapshot_covering_gap_ = false;
+            continue;
+        }
+        unsaved_changes_[map_id].Merge(*changes);
+    }
+}
+
+void SerializationListener::SaveChanges() {
+    if(!journal_.is_open()) {
+        RotateJournal(0);
+    }
+    if(is_full_snapshot_required_) {
+        // Снимок не ожидается под блокировкой состояния: если прошлый ещё записывается,
+        // попытка повторится в следующий период
+        if(snapshot_pid_ < 0) {
+            StartSnapshot();
+        } else {
+            SkipSnapshot();
+        }
+        return;
+    }
+    serialization::JournalRecordRepr record;
+    std::map<model::Map::Id, std::vector<std::uint64_t>> joined_dogs;
+    for(const auto& [map_id, session] : game_.GetSessions()) {
+        const auto changes_it = unsaved_changes_.find(map_id);
+        if(changes_it == unsaved_changes_.end()) {
+            continue;
+        }
+        const auto& changes = changes_it->second;
+        if(changes.changed_dogs.empty() && changes.removed_dogs.empty()
+            && changes.changed_loots.empty() && changes.removed_loots.empty()) {
+            continue;
+        }
+        record.AddSessionChanges(session, changes);
+        auto& saved_dogs = saved_dogs_[map_id];
+        for(auto dog_index : changes.changed_dogs) {
+            if(saved_dogs.insert(dog_index).second) {
+                joined_dogs[map_id].push_back(dog_index);
+            }
+        }
+        for(auto dog_index : changes.removed_dogs) {
+            saved_dogs.erase(dog_index);
+        }
+    }
+    unsaved_changes_.clear();
+    // Токены нужны только для игроков, присоединившихся с прошлого сохранения
+    for(const auto& [map_id, dog_indices] : joined_dogs) {
+        for(auto dog_index : dog_indices) {
+            // Пёс мог уйти на покой до сохранения. Токен удаляется раньше игрока,
+            // поэтому игрок с найденным токеном существует
+            const auto token = player_tokens_.FindTokenByPlayer(app::Player::Id{dog_index}, map_id);
+            if(token) {
+                record.AddJoinedPlayer(*token, *players_.FindByPlayerIdAndMapId(dog_index, map_id));
+            }
+        }
+    }
+    if(!record.IsEmpty()) {
+        std::ostringstream record_strm;
+        {
+            boost::archive::binary_oarchive ar{record_strm, boost::archive::no_header};
+            ar << record;
+        }
+        const auto record_data = record_strm.str();
+        const std::uint64_t record_size = record_data.size();
+        journal_.write(reinterpret_cast<const char*>(&record_size), sizeof(record_size));
+        journal_.write(record_data.data(), record_data.size());
+        journal_.flush();
+        journal_size_ += sizeof(record_size) + record_data.size();
+    }
+    // Снимок делается после записи изменений, чтобы журнал до его начала был полным
+    if(checkpoint_size_ == 0 || journal_size_ > std::max(checkpoint_size_, MIN_JOURNAL_SIZE)) {
+        if(snapshot_pid_ < 0) {
+            StartSnapshot();
+        } else {
+            SkipSnapshot();
+        }
+    }
+}
+
+void SerializationListener::RememberSavedState() {
+    // Без журнала сохранённое состояние отслеживать не нужно
+    if(!is_incremental_) {
+        return;
+    }
+    collected_ticks_.clear();
+    unsaved_changes_.clear();
+    saved_dogs_.clear();
+    for(const auto& [map_id, session] : game_.GetSessions()) {
+        collected_ticks_[map_id] = session.GetTick();
+        auto& saved_dogs = saved_dogs_[map_id];
+        for(const auto& dog_item : session.GetDogs()) {
+            saved_dogs.insert(dog_item.first);
+        }
+    }
+}
+
+std::filesystem::path SerializationListener::GetJournalPath() const {
+    return path_to_state_file_.string() + ".journal"s;
+}
+
+}
@@ -1,5 +1,10 @@
 #pragma once
 
+#include <sys/types.h>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <unordered_set>
 #include "app.h"
 
 
@@ -8,26 +13,112 @@ using namespace std::literals;
 namespace infra {
 
 
+// Сохраняет состояние игры в файл.
+// В полном режиме каждое сохранение перезаписывает файл целиком.
+// В инкрементальном режиме изменения сессий собираются каждый тик и раз в период
+// дописываются в журнал <файл состояния>.journal, а полный снимок (контрольная точка)
+// записывается, когда журнал становится больше снимка или собрать изменения
+// пропущенных тиков уже нельзя. При загрузке к контрольной точке применяется журнал.
+// Снимки во время игры записывает дочерний процесс: fork даёт ему неизменяемую копию
+// состояния (страницы памяти копируются только при изменении), поэтому тик ждёт
+// лишь создания процесса, а не сериализации всего мира. Процесс, не успевший записать
+// снимок за SNAPSHOT_TIMEOUT, завершается принудительно
 class SerializationListener : public app::ApplicationListener {
 public:
     using TimeInterval = std::chrono::milliseconds;
+    using StateLocker = std::function<app::StateReadLock()>;
+    // Создаёт процесс записи снимка, возвращает то же, что fork
+    using Forker = std::function<pid_t()>;
     SerializationListener(model::Game& game, app::Players& players, app::PlayerTokens& player_tokens) :
         game_(game), players_(players), player_tokens_(player_tokens) {}
+    SerializationListener(const SerializationListener&) = delete;
+    SerializationListener& operator=(const SerializationListener&) = delete;
+    // Дожидается завершения записи снимка, но не дольше SNAPSHOT_TIMEOUT
+    ~SerializationListener();
 
     void OnTick(std::chrono::milliseconds time_delta) override;
     void SetSavePeriod(std::chrono::milliseconds save_period);
     void SetPathToStateFile(std::filesystem::path path_to_state_file);
+    void SetIncremental(bool is_incremental);
+    // Команды игроков выполняются одновременно с тиком, поэтому на время сохранения
+    // состояние блокируется на чтение функцией locker
+    void SetStateLocker(StateLocker locker);
+    // Заменяет fork при создании процесса записи снимка
+    void SetForker(Forker forker);
+
+    // Загружает контрольную точку и применяет к ней журнал. Возвращает false, если файла состояния нет
+    bool LoadState();
+    // Синхронно записывает полный снимок состояния и очищает журнал.
+    // Предварительно дожидается снимка, записываемого в фоне
+    void SaveState();
 
 private:
+    // Журнал меньше этого размера не сворачивается в контрольную точку
+    static constexpr std::uintmax_t MIN_JOURNAL_SIZE = 64 * 1024;
+    // Время на запись снимка дочерним процессом. Процесс мог зависнуть, например,
+    // на блокировке аллокатора, захваченной другим потоком в момент fork
+    static constexpr TimeInterval SNAPSHOT_TIMEOUT = 60s;
+    static constexpr TimeInterval SNAPSHOT_POLL_INTERVAL = 10ms;
+
+    // Добавляет к несохранённым изменения сессий за прошедшие тики
+    void CollectChanges();
+    void SaveChanges();
+    // Применяет журнал к загруженной контрольной точке и открывает его для продолжения записи
+    void ReplayJournal();
+    // Запускает запись снимка в дочернем процессе. Если fork не удался, пишет снимок синхронно
+    void StartSnapshot();
+    // Проверяет, завершилась ли запись снимка. При wait ожидает её завершения.
+    // Процесс, превысивший SNAPSHOT_TIMEOUT, завершается, а снимок считается неудавшимся
+    void ReapSnapshot(bool wait);
+    // Учитывает снимок, пропущенный из-за ещё не завершённой записи прошлого
+    void SkipSnapshot();
+    void WriteCheckpoint(std::uint64_t checkpoint_id, std::uint64_t journal_offset) const;
+    // Учитывает записанную контрольную точку: следующий номер, размер и новый журнал.
+    // Снимок, начатый после пропуска тиков, снова разрешает запись журнала
+    void FinishSnapshot(std::uint64_t journal_offset);
+    // Начинает журнал контрольной точки checkpoint_id_, перенося в него записи старого журнала
+    // начиная с позиции offset. При offset == 0 журнал начинается пустым
+    void RotateJournal(std::uint64_t offset);
+    // Запоминает тики и псов сессий, чьё состояние уже сохранено, и отбрасывает собранные изменения
+    void RememberSavedState();
+    std::filesystem::path GetJournalPath() const;
+
     model::Game& game_;
     app::Players& players_;
     app::PlayerTokens& player_tokens_;
-    TimeInterval save_period_;
-    TimeInterval time_since_save_;
+    TimeInterval save_period_{0};
+    TimeInterval time_since_save_{0};
     std::filesystem::path path_to_state_file_;
+    bool is_incremental_ = false;
+    StateLocker state_locker_;
+    Forker forker_;
+    // Номер контрольной точки. Журнал предыдущей точки применяется начиная с checkpoint_journal_offset_,
+    // журналы с другими номерами пропускаются
+    std::uint64_t checkpoint_id_ = 0;
+    std::uintmax_t checkpoint_size_ = 0;
+    std::uintmax_t journal_size_ = 0;
+    // Позиция в журнале прежней контрольной точки, с которой продолжается журнал текущей
+    std::uint64_t checkpoint_journal_offset_ = 0;
+    // Процесс, записывающий снимок, позиция журнала на момент снимка и срок записи
+    pid_t snapshot_pid_ = -1;
+    std::uint64_t snapshot_journal_offset_ = 0;
+    std::chrono::steady_clock::time_point snapshot_deadline_;
+    // Снимки, пропущенные за время записи текущего
+    unsigned skipped_snapshots_ = 0;
+    // Журнал не может восполнить тики, пропущенные сверх истории изменений сессии.
+    // Пока не записан снимок, начатый после пропуска, журнал не пополняется:
+    // контрольная точка с журналом остаются согласованными, хотя и устаревают
+    bool is_full_snapshot_required_ = false;
+    bool is_snapshot_covering_gap_ = false;
+    std::ofstream journal_;
+    // Изменения сессий с прошлого сохранения, собранные по тик collected_ticks_ включительно
+    std::map<model::Map::Id, std::uint64_t> collected_ticks_;
+    std::map<model::Map::Id, model::SessionChanges> unsaved_changes_;
+    // Псы, уже попавшие в снимок или журнал. Остальные изменившиеся псы принадлежат новым игрокам
+    std::map<model::Map::Id, std::unordered_set<std::uint64_t>> saved_dogs_;
 };
 
 
 
 
-}
\ No newline at end of file
+}
@@ -1,8 +1,154 @@
 #include "logging.h"
+#include <boost/log/sinks/async_frontend.hpp>
+#include <boost/log/sinks/block_on_overflow.hpp>
+#include <boost/log/sinks/bounded_fifo_queue.hpp>
+#include <boost/log/sinks/drop_on_overflow.hpp>
+#include <boost/log/sinks/text_ostream_backend.hpp>
+#include <boost/core/null_deleter.hpp>
+#include <algorithm>
+#include <charconv>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
 #include  <variant>
 
 namespace server_log {
 
+    namespace {
+
+        namespace sinks = logging::sinks;
+
+        template <typename OverflowStrategy>
+        using AsyncConsoleSink = sinks::asynchronous_sink<sinks::text_ostream_backend,
+                                                          sinks::bounded_fifo_queue<LOG_QUEUE_CAPACITY, OverflowStrategy>>;
+
+        // Поток вывода журнала. Тип очереди зависит от политики переполнения,
+        // поэтому работа с фронтендом передаётся через функции
+        class AsyncLogWriter {
+        public:
+            template <typename OverflowStrategy>
+            explicit AsyncLogWriter(boost::shared_ptr<AsyncConsoleSink<OverflowStrategy>> sink)
+                : sink_(sink)
+                , flush_([sink] {
+                    // Записи форматируются здесь, а не в потоке, обработавшем запрос.
+                    // std::cout сбрасывается один раз на весь накопленный пакет
+                    sink->feed_records();
+                    sink->locked_backend()->flush();
+                })
+                , worker_([this] { Run(); }) {
+            }
+
+            AsyncLogWriter(const AsyncLogWriter&) = delete;
+            AsyncLogWriter& operator=(const AsyncLogWriter&) = delete;
+
+            ~AsyncLogWriter() {
+                {
+                    std::lock_guard lock{mutex_};
+                    stop_ = true;
+                }
+                stop_cv_.notify_one();
+                worker_.join();
+                logging::core::get()->remove_sink(sink_);
+                flush_();
+            }
+
+        private:
+            void Run() {
+                std::unique_lock lock{mutex_};
+                while(!stop_) {
+                    stop_cv_.wait_for(lock, LOG_FLUSH_INTERVAL, [this] { return stop_; });
+                    lock.unlock();
+                    flush_();
+                    lock.lock();
+                }
+            }
+
+            boost::shared_ptr<sinks::sink> sink_;
+            std::function<void()> flush_;
+            std::mutex mutex_;
+            std::condition_variable stop_cv_;
+            bool stop_ = false;
+            // Поток объявлен последним, чтобы запускаться после инициализации остальных полей
+            std::thread worker_;
+        };
+
+        template <typename OverflowStrategy>
+        std::unique_ptr<AsyncLogWriter> MakeAsyncLogWriter() {
+            auto backend = boost::make_shared<sinks::text_ostream_backend>();
+            backend->add_stream(boost::shared_ptr<std::ostream>(&std::cout, boost::null_deleter()));
+            backend->auto_flush(false);
+            // Записи забирает AsyncLogWriter, собственный поток фронтенда не нужен
+            auto sink = boost::make_shared<AsyncConsoleSink<OverflowStrategy>>(backend, false);
+            sink->set_formatter(&JsonLineFormatter);
+            logging::core::get()->add_sink(sink);
+            return std::make_unique<AsyncLogWriter>(sink);
+        }
+
+        std::unique_ptr<AsyncLogWriter> async_log_writer;
+
+        // Дописывает число, дополненное нулями слева до width цифр
+        void AppendPadded(std::string& buffer, std::uint64_t value, int width) {
+            char digits[20];
+            int pos = sizeof(digits);
+            do {
+                digits[--pos] = static_cast<char>('0' + value % 10);
+                value /= 10;
+                --width;
+            } while(value != 0 || width > 0);
+            buffer.append(digits + pos, sizeof(digits) - pos);
+        }
+
+        // Дописывает время в формате to_iso_extended_string: YYYY-MM-DDTHH:MM:SS[.ffffff]
+        void AppendIsoTimestamp(std::string& buffer, const boost::posix_time::ptime& ts) {
+            if(ts.is_special()) {
+                buffer += to_iso_extended_string(ts);
+                return;
+            }
+            const auto date = ts.date();
+            const auto time = ts.time_of_day();
+            AppendPadded(buffer, date.year(), 4);
+            buffer += '-';
+            AppendPadded(buffer, date.month().as_number(), 2);
+            buffer += '-';
+            AppendPadded(buffer, date.day(), 2);
+            buffer += 'T';
+            AppendPadded(buffer, time.hours(), 2);
+            buffer += ':';
+            AppendPadded(buffer, time.minutes(), 2);
+            buffer += ':';
+            AppendPadded(buffer, time.seconds(), 2);
+            // Как и boost, нулевую дробную часть секунд не выводим
+            if(const auto fractional_seconds = time.fractional_seconds(); fractional_seconds != 0) {
+                buffer += '.';
+                AppendPadded(buffer, fractional_seconds, boost::posix_time::time_duration::num_fractional_digits());
+            }
+        }
+
+        // Дописывает вывод сериализатора, подготовленного вызовом reset
+        void AppendSerialized(std::string& buffer, json::serializer& serializer) {
+            char chunk[256];
+            while(!serializer.done()) {
+                const auto part = serializer.read(chunk, sizeof(chunk));
+                buffer.append(part.data(), part.size());
+            }
+        }
+
+    }  // namespace
+
+    void InitAsyncLogging(LogOverflowPolicy policy) {
+        StopAsyncLogging();
+        if(policy == LogOverflowPolicy::DROP) {
+            async_log_writer = MakeAsyncLogWriter<sinks::drop_on_overflow>();
+        } else {
+            async_log_writer = MakeAsyncLogWriter<sinks::block_on_overflow>();
+        }
+    }
+
+    void StopAsyncLogging() {
+        async_log_writer.reset();
+    }
+
     void MyFormatter(logging::record_view const& rec, logging::formatting_ostream& strm) {
 
         json::object output;
@@ -23,23 +169,176 @@ namespace server_log {
         strm << boost::json::serialize(output) << std::endl;
     }
 
-    unsigned GetResponseResult(const Response& response) {
-        if (std::holds_alternative<StringResponse>(response)) {
-            return std::get<StringResponse>(response).result_int(); 
-        } else if (std::holds_alternative<FileResponse>(response)) {
-            return std::get<FileResponse>(response).result_int(); 
+    void JsonLineFormatter(logging::record_view const& rec, logging::formatting_ostream& strm) {
+        thread_local std::string buffer;
+        thread_local json::serializer serializer;
+        buffer.clear();
+        buffer += '{';
+
+        // Поля выводятся в том же порядке, что и в MyFormatter
+        if(auto ts = rec[timestamp]; ts.get_ptr()) {
+            buffer += R"("timestamp":")";
+            AppendIsoTimestamp(buffer, *ts);
+            buffer += '"';
+        }
+
+        // Дополнительные данные сериализуются прямо из атрибута, без копирования
+        if(auto data = rec[additional_data]; data.get_ptr()) {
+            if(buffer.size() > 1) {
+                buffer += ',';
+            }
+            buffer += R"("data":)";
+            serializer.reset(data.get_ptr());
+            AppendSerialized(buffer, serializer);
+        }
+
+        if(auto message = rec[logging::expressions::smessage]; message.get_ptr()) {
+            if(buffer.size() > 1) {
+                buffer += ',';
+            }
+            buffer += R"("message":)";
+            serializer.reset(json::string_view{message->data(), message->size()});
+            AppendSerialized(buffer, serializer);
         }
-        return 0;
+
+        buffer += '}';
+        strm.write(buffer.data(), buffer.size());
+        strm << std::endl;
     }
 
-    std::string_view GetResponseContentType(const Response& response) {
-        try{
-            if (std::holds_alternative<StringResponse>(response)) {
-                return std::get<StringResponse>(response).at(boost::beast::http::field::content_type); 
-            } else if (std::holds_alternative<FileResponse>(response)) {
-                return std::get<FileResponse>(response).at(boost::beast::http::field::content_type); 
+    Severity ParseSeverity(std::string_view name) {
+        Severity severity;
+        if(!logging::trivial::from_string(name.data(), name.size(), severity)) {
+            throw std::invalid_argument("Unknown log level: "s + std::string(name));
+        }
+        return severity;
+    }
+
+    RouteLogRule ParseRouteLogRule(std::string_view spec) {
+        const auto colon = spec.rfind(':');
+        if(colon == std::string_view::npos || colon == 0) {
+            throw std::invalid_argument("Route log rule must look like <prefix>:<options>: "s + std::string(spec));
+        }
+        RouteLogRule rule;
+        rule.prefix = spec.substr(0, colon);
+        bool has_sample = false;
+        auto options = spec.substr(colon + 1);
+        while(!options.empty()) {
+            const auto comma = options.find(',');
+            const auto option = options.substr(0, comma);
+            options = comma == std::string_view::npos ? std::string_view{} : options.substr(comma + 1);
+            if(option == "aggregate"sv) {
+                rule.aggregate = true;
+            } else if(option.starts_with("level="sv)) {
+                rule.min_severity = ParseSeverity(option.substr("level="sv.size()));
+            } else if(option.starts_with("sample="sv)) {
+                const auto value = option.substr("sample="sv.size());
+                const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), rule.sample_rate);
+                if(ec != std::errc{} || end != value.data() + value.size()) {
+                    throw std::invalid_argument("Wrong sample rate in route log rule: "s + std::string(spec));
+                }
+                has_sample = true;
+            } else {
+                throw std::invalid_argument("Unknown route log option: "s + std::string(option));
+            }
+        }
+        // Маршрут со счётчиками по умолчанию не выводит отдельные запросы
+        if(rule.aggregate && !has_sample) {
+            rule.sample_rate = 0;
+        }
+        return rule;
+    }
+
+    RequestLogPolicy::RequestLogPolicy(std::vector<RouteLogRule> rules, Severity min_severity,
+                                       std::chrono::milliseconds statistics_period)
+        : min_severity_(min_severity)
+        , statistics_period_(statistics_period)
+        , last_flush_(Clock::now().time_since_epoch().count()) {
+        // Правила с более длинным префиксом проверяются первыми
+        std::stable_sort(rules.begin(), rules.end(), [](const RouteLogRule& lhs, const RouteLogRule& rhs) {
+            return lhs.prefix.size() > rhs.prefix.size();
+        });
+        routes_.reserve(rules.size());
+        for(auto& rule : rules) {
+            routes_.push_back(std::make_unique<Route>(std::move(rule)));
+        }
+    }
+
+    RequestLogPolicy::Decision RequestLogPolicy::Decide(std::string_view target) {
+        const auto path = target.substr(0, target.find('?'));
+        for(const auto& route : routes_) {
+            if(!path.starts_with(route->rule.prefix)) {
+                continue;
+            }
+            const auto sample_rate = route->rule.sample_rate;
+            const bool is_sampled = sample_rate != 0
+                && route->seen.fetch_add(1, std::memory_order_relaxed) % sample_rate == 0;
+            return {route.get(), is_sampled, std::max(route->rule.min_severity, min_severity_)};
+        }
+        return {nullptr, true, min_severity_};
+    }
+
+    void RequestLogPolicy::CountResponse(const Decision& decision, unsigned code, int64_t response_time) {
+        if(!decision.route || !decision.route->rule.aggregate) {
+            return;
+        }
+        auto& route = *decision.route;
+        route.requests.fetch_add(1, std::memory_order_relaxed);
+        if(code >= 200 && code < 600) {
+            route.code_classes[code / 100 - 2].fetch_add(1, std::memory_order_relaxed);
+        }
+        route.total_response_time.fetch_add(response_time, std::memory_order_relaxed);
+        auto max_response_time = route.max_response_time.load(std::memory_order_relaxed);
+        while(response_time > max_response_time
+              && !route.max_response_time.compare_exchange_weak(max_response_time, response_time, std::memory_order_relaxed)) {
+        }
+
+        // Счётчики выводит один поток, первым заметивший окончание периода
+        const auto now = Clock::now().time_since_epoch().count();
+        auto last_flush = last_flush_.load(std::memory_order_relaxed);
+        if(now - last_flush >= statistics_period_.count()
+           && last_flush_.compare_exchange_strong(last_flush, now, std::memory_order_relaxed)) {
+            FlushStatistics();
+        }
+    }
+
+    void RequestLogPolicy::FlushStatistics() {
+        last_flush_.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+        for(const auto& route : routes_) {
+            if(!route->rule.aggregate) {
+                continue;
             }
+            const auto requests = route->requests.exchange(0, std::memory_order_relaxed);
+            if(requests == 0) {
+                continue;
+            }
+            std::array<uint64_t, 4> code_classes{};
+            for(size_t i = 0; i < code_classes.size(); ++i) {
+                code_classes[i] = route->code_classes[i].exchange(0, std::memory_order_relaxed);
+            }
+            const auto total_response_time = route->total_response_time.exchange(0, std::memory_order_relaxed);
+            const auto max_response_time = route->max_response_time.exchange(0, std::memory_order_relaxed);
+            json::value statistics_data{{"route"s, route->rule.prefix}, {"requests"s, requests},
+                                        {"2xx"s, code_classes[0]}, {"3xx"s, code_classes[1]},
+                                        {"4xx"s, code_classes[2]}, {"5xx"s, code_classes[3]},
+                                        {"avg_response_time"s, total_response_time / static_cast<int64_t>(requests)},
+                                        {"max_response_time"s, max_response_time}};
+            BOOST_LOG_TRIVIAL(info) << logging::add_value(additional_data, statistics_data)
+                    << "route statistics"sv;
+        }
+    }
 
+    unsigned GetResponseResult(const Response& response) {
+        return std::visit([](const auto& typed_response) {
+            return typed_response.result_int();
+        }, response);
+    }
+
+    std::string_view GetResponseContentType(const Response& response) {
+        try{
+            return std::visit([](const auto& typed_response) {
+                return typed_response.at(boost::beast::http::field::content_type);
+            }, response);
         } catch(const std::out_of_range& ex) {
             // В случае отсутствия поля content_type в ответе сервера
         }
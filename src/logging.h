@@ -17,8 +17,13 @@
 #include <boost/format.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/json.hpp>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <memory>
 #include <variant>
+#include <vector>
+#include "shared_body.h"
 
 namespace server_log {
 
@@ -31,29 +36,125 @@ namespace server_log {
     using namespace std::literals;
     using StringResponse = http::response<http::string_body>;
     using FileResponse = http::response<http::file_body>;
-    using Response = std::variant<StringResponse, FileResponse>;
+    // Ответ, тело которого разделяется между несколькими ответами без копирования
+    using SharedStringResponse = http::response<http_body::SharedStringBody>;
+    using Response = std::variant<StringResponse, FileResponse, SharedStringResponse>;
     using HttpRequest = http::request<http::string_body>;
 
     BOOST_LOG_ATTRIBUTE_KEYWORD(timestamp, "TimeStamp", boost::posix_time::ptime)
     BOOST_LOG_ATTRIBUTE_KEYWORD(additional_data, "AdditionalData", json::value)
 
     void MyFormatter(logging::record_view const& rec, logging::formatting_ostream& strm);
+    // Выводит ту же строку, что и MyFormatter, но собирает её в буфере потока без промежуточного
+    // json::object. Буфер и сериализатор переиспользуются, поэтому после первых записей
+    // форматирование не выделяет память
+    void JsonLineFormatter(logging::record_view const& rec, logging::formatting_ostream& strm);
+
+    // Поведение журнала, когда очередь записей заполнена
+    enum class LogOverflowPolicy {
+        // Запись отбрасывается, поток, обрабатывающий запрос, не ждёт
+        DROP,
+        // Поток ждёт, пока поток вывода освободит место в очереди
+        BLOCK
+    };
+    // Количество записей, ожидающих вывода
+    constexpr size_t LOG_QUEUE_CAPACITY = 8192;
+    // Как часто поток вывода забирает записи из очереди и сбрасывает их в std::cout одним пакетом
+    constexpr std::chrono::milliseconds LOG_FLUSH_INTERVAL{20};
+
+    // Подключает асинхронный вывод журнала: записи ставятся в ограниченную очередь,
+    // форматируются и выводятся отдельным потоком
+    void InitAsyncLogging(LogOverflowPolicy policy);
+    // Выводит оставшиеся в очереди записи и останавливает поток вывода
+    void StopAsyncLogging();
+
     unsigned GetResponseResult(const Response& response);
     std::string_view GetResponseContentType(const Response& response);
 
+    using Severity = logging::trivial::severity_level;
+
+    // Настройка журналирования запросов, путь которых начинается с prefix
+    struct RouteLogRule {
+        std::string prefix;
+        // Выводится каждый sample_rate-й запрос маршрута, при 0 строки запросов не выводятся.
+        // Ответы с ошибками выводятся всегда
+        unsigned sample_rate = 1;
+        // Строки запроса и ответа с меньшей важностью не выводятся
+        Severity min_severity = Severity::info;
+        // Запросы учитываются в счётчиках маршрута, которые периодически выводятся одной строкой
+        bool aggregate = false;
+    };
+
+    // Разбирает правило вида <префикс>:sample=N,level=warning,aggregate.
+    // Без sample маршрут со счётчиками выводит из строк отдельных запросов только ответы с ошибками.
+    // Бросает std::invalid_argument при ошибке в правиле
+    RouteLogRule ParseRouteLogRule(std::string_view spec);
+    Severity ParseSeverity(std::string_view name);
+
+    // Решает, какие запросы выводить в журнал, и ведёт счётчики маршрутов.
+    // Используется одновременно из всех потоков сервера
+    class RequestLogPolicy {
+    private:
+        struct Route;
+
+    public:
+        static constexpr std::chrono::milliseconds DEFAULT_STATISTICS_PERIOD{10000};
+
+        // Решение по одному запросу, принимается до его обработки
+        struct Decision {
+            Route* route = nullptr;
+            bool is_sampled = true;
+            Severity min_severity = Severity::info;
+        };
+
+        explicit RequestLogPolicy(std::vector<RouteLogRule> rules = {}, Severity min_severity = Severity::info,
+                                  std::chrono::milliseconds statistics_period = DEFAULT_STATISTICS_PERIOD);
+        RequestLogPolicy(const RequestLogPolicy&) = delete;
+        RequestLogPolicy& operator=(const RequestLogPolicy&) = delete;
+
+        // Выбирает правило с самым длинным префиксом пути target
+        Decision Decide(std::string_view target);
+        // Предупреждения и ошибки выводятся независимо от выборки, но с учётом min_severity
+        static bool ShouldLog(const Decision& decision, Severity severity) {
+            return severity >= decision.min_severity && (decision.is_sampled || severity >= Severity::warning);
+        }
+        // Учитывает ответ в счётчиках маршрута и выводит их, если прошёл период
+        void CountResponse(const Decision& decision, unsigned code, int64_t response_time);
+        // Выводит накопленные счётчики всех маршрутов и обнуляет их
+        void FlushStatistics();
+
+    private:
+        struct Route {
+            explicit Route(RouteLogRule rule) : rule(std::move(rule)) {}
+
+            RouteLogRule rule;
+            std::atomic<uint64_t> seen{0};
+            std::atomic<uint64_t> requests{0};
+            // Ответы с кодами 2xx, 3xx, 4xx, 5xx
+            std::array<std::atomic<uint64_t>, 4> code_classes{};
+            std::atomic<int64_t> total_response_time{0};
+            std::atomic<int64_t> max_response_time{0};
+        };
+        using Clock = std::chrono::steady_clock;
+
+        std::vector<std::unique_ptr<Route>> routes_;
+        Severity min_severity_;
+        Clock::duration statistics_period_;
+        std::atomic<Clock::rep> last_flush_;
+    };
+
     /* Декоратор */
     template<class SomeRequestHandler>
     class LoggingRequestHandler {
     public:
-        explicit LoggingRequestHandler(std::shared_ptr<SomeRequestHandler> decorated_ptr) : decorated_ptr_(decorated_ptr) {}
+        explicit LoggingRequestHandler(std::shared_ptr<SomeRequestHandler> decorated_ptr,
+                                       std::shared_ptr<RequestLogPolicy> log_policy = std::make_shared<RequestLogPolicy>())
+            : decorated_ptr_(decorated_ptr)
+            , log_policy_(std::move(log_policy)) {}
 
-        static void InitLogging() {
+        static void InitLogging(LogOverflowPolicy policy = LogOverflowPolicy::BLOCK) {
             logging::add_common_attributes();
-            logging::add_console_log( 
-                std::cout,
-                keywords::format = &MyFormatter,
-                keywords::auto_flush = true
-            ); 
+            InitAsyncLogging(policy);
         }
 
         static void LogOnError(beast::error_code ec, std::string_view where_str) {
@@ -67,7 +168,13 @@ namespace server_log {
             BOOST_LOG_TRIVIAL(info) << logging::add_value(additional_data, start_data)
                     << "server started"sv;
         }
+        static void LogStateLoaded(const std::string& state_file, int64_t load_time_ms, int64_t peak_rss_kb) {
+            json::value load_data{{"file"s, state_file}, {"load_time_ms"s, load_time_ms}, {"peak_rss_kb"s, peak_rss_kb}};
+            BOOST_LOG_TRIVIAL(info) << logging::add_value(additional_data, load_data)
+                    << "state loaded"sv;
+        }
         void LogExitServer() {
+            log_policy_->FlushStatistics();
             json::value exit_data{{"code"s, 0}};
             BOOST_LOG_TRIVIAL(info) << logging::add_value(additional_data, exit_data)
                     << "server exited"sv;
@@ -83,27 +190,55 @@ namespace server_log {
             }
 
         }
-    public:
-        static void LogResponse(const Response& r, std::string client_ip, int64_t duration_response_time){
+
+        static void LogResponse(RequestLogPolicy& log_policy, const RequestLogPolicy::Decision& decision,
+                                const Response& r, const std::string& client_ip, int64_t duration_response_time) {
+            const auto code = GetResponseResult(r);
+            log_policy.CountResponse(decision, code, duration_response_time);
+            // Ошибки сервера и клиента выводятся с большей важностью, чем успешные ответы
+            const auto severity = code >= 500 ? Severity::error : code >= 400 ? Severity::warning : Severity::info;
+            if(!RequestLogPolicy::ShouldLog(decision, severity)) {
+                return;
+            }
             auto content_type = GetResponseContentType(r);
             json::value content_type_object;
             if(!content_type.empty()) {
                 content_type_object.emplace_string() = std::string(content_type);
             }
-            json::value response_data{{"ip"s, client_ip}, {"response_time"s, duration_response_time}, {"code"s, GetResponseResult(r)}, 
+            json::value response_data{{"ip"s, client_ip}, {"response_time"s, duration_response_time}, {"code"s, code}, 
                                       {"content_type"s, content_type_object}};
-                BOOST_LOG_TRIVIAL(info) << logging::add_value(additional_data, response_data)
+                BOOST_LOG_SEV(logging::trivial::logger::get(), severity) << logging::add_value(additional_data, response_data)
                     << "response sent"sv;
         }
 
+    public:
         template <typename Body, typename Allocator, typename Send>
         void operator()(http::request<Body, http::basic_fields<Allocator>>&& req, const std::string& client_ip, Send&& send) {
-            LogRequest(req, client_ip);
-            (*decorated_ptr_)(std::move(req), std::move(send));
+            const auto decision = log_policy_->Decide(req.target());
+            if(RequestLogPolicy::ShouldLog(decision, Severity::info)) {
+                LogRequest(req, client_ip);
+            }
+            auto start_response_time = std::chrono::high_resolution_clock::now();
+            (*decorated_ptr_)(std::move(req), [log_policy = log_policy_, decision, client_ip, start_response_time,
+                                               send = std::forward<Send>(send)](auto&& response) {
+                auto end_response_time = std::chrono::high_resolution_clock::now();
+                auto duration_response_time = std::chrono::duration_cast<std::chrono::microseconds>(end_response_time - start_response_time).count();
+                LogResponse(*log_policy, decision, response, client_ip, duration_response_time);
+                send(std::forward<decltype(response)>(response));
+            });
+        }
+
+        template <typename Socket, typename Body, typename Allocator>
+        void HandleUpgrade(Socket&& socket, http::request<Body, http::basic_fields<Allocator>>&& req, const std::string& client_ip) {
+            if(RequestLogPolicy::ShouldLog(log_policy_->Decide(req.target()), Severity::info)) {
+                LogRequest(req, client_ip);
+            }
+            decorated_ptr_->HandleUpgrade(std::move(socket), std::move(req));
         }
 
     private:
         //SomeRequestHandler& decorated_;
         std::shared_ptr<SomeRequestHandler> decorated_ptr_;
+        std::shared_ptr<RequestLogPolicy> log_policy_;
     };
 }
\ No newline at end of file
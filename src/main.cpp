@@ -10,6 +10,7 @@
 #include "http_server.h"
 #include "json_loader.h"
 #include "request_handler.h"
+#include "game_state_hub.h"
 #include "app.h"
 #include "extra_data.h"
 #include <boost/archive/binary_oarchive.hpp>
@@ -18,6 +19,7 @@
 #include "app_serialization.h"
 #include "infrastructure.h"
 #include <exception>
+#include <sys/resource.h>
 #include "connection_pool.h"
 
 
@@ -41,6 +43,23 @@ namespace {
 //     return config;
 // }
 
+// Пиковый объём резидентной памяти процесса в килобайтах
+long GetPeakRssKb() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Выводит счётчики фоновой записи ушедших на покой игроков в БД
+void LogRetiredPlayersStats(const postgres::RetiredPlayersWriter::Stats& stats) {
+    json::value stats_data{{"enqueued"s, stats.enqueued}, {"written"s, stats.written},
+                           {"batches"s, stats.batches}, {"failed_batches"s, stats.failed_batches},
+                           {"dropped"s, stats.dropped}, {"queue_size"s, stats.queue_size},
+                           {"max_queue_size"s, stats.max_queue_size}};
+    BOOST_LOG_TRIVIAL(info) << logging::add_value(additional_data, stats_data)
+            << "retired players statistics"sv;
+}
+
 // Запускает функцию fn на n потоках, включая текущий
 template <typename Fn>
 void RunWorkers(unsigned n, const Fn& fn) {
@@ -61,6 +80,14 @@ struct Args {
     std::string save_file;
     std::string save_period;
     bool is_randomize = false;
+    bool is_parallel_tick = false;
+    bool is_state_journal = false;
+    LogOverflowPolicy log_overflow = LogOverflowPolicy::BLOCK;
+    Severity log_level = Severity::info;
+    std::vector<RouteLogRule> log_routes;
+    std::chrono::milliseconds log_statistics_period = RequestLogPolicy::DEFAULT_STATISTICS_PERIOD;
+    std::size_t static_cache_size = http_handler::StaticFileCache::DEFAULT_CAPACITY;
+    bool is_static_cache_watch = false;
 };
 
 [[nodiscard]] std::optional<Args> ParseCommandLine(int argc, const char* const argv[]) {
@@ -69,6 +96,11 @@ struct Args {
     po::options_description desc{"Allowed options"s};
 
     Args args;
+    std::string log_overflow;
+    std::string log_level;
+    std::vector<std::string> log_routes;
+    uint64_t log_statistics_period = 0;
+    std::size_t static_cache_size_mb = 0;
     desc.add_options()
         ("help,h", "produce help message")
         ("tick-period,t", po::value(&args.tick_period)->value_name("milliseconds"s), "set tick period")
@@ -76,7 +108,17 @@ struct Args {
         ("www-root,w", po::value(&args.root_dir)->value_name("dir"s), "set static files root")
         ("state-file,s", po::value(&args.save_file)->value_name("state file"s), "set save file")
         ("save-state-period,p", po::value(&args.save_period)->value_name("milliseconds"s), "set save state period")
-        ("randomize-spawn-points", "spawn dogs at random positions");
+        ("randomize-spawn-points", "spawn dogs at random positions")
+        ("parallel-tick", "update game sessions of different maps in parallel")
+        ("state-journal", "append state changes to a journal instead of rewriting the state file")
+        ("log-overflow", po::value(&log_overflow)->value_name("drop|block"s), "drop log records or wait when the log queue is full")
+        ("log-level", po::value(&log_level)->value_name("level"s), "set minimal severity of request and response lines")
+        ("log-route", po::value(&log_routes)->value_name("prefix:options"s),
+            "set logging of routes starting with prefix, options are comma-separated "
+            "sample=N (log every N-th request), level=<level>, aggregate (log periodic route statistics)")
+        ("log-statistics-period", po::value(&log_statistics_period)->value_name("milliseconds"s), "set route statistics period")
+        ("static-cache-size", po::value(&static_cache_size_mb)->value_name("megabytes"s), "set static files cache size, 0 disables the cache")
+        ("static-cache-watch", "drop cached static files when files in the static root change");
 
     // variables_map хранит значения опций после разбора
     po::variables_map vm;
@@ -105,6 +147,37 @@ struct Args {
         args.is_randomize = true;
     }
 
+    if (vm.contains("parallel-tick"s)) {
+        args.is_parallel_tick = true;
+    }
+
+    if (vm.contains("state-journal"s)) {
+        args.is_state_journal = true;
+    }
+
+    if (log_overflow == "drop"s) {
+        args.log_overflow = LogOverflowPolicy::DROP;
+    } else if (!log_overflow.empty() && log_overflow != "block"s) {
+        throw std::runtime_error("Log overflow policy must be drop or block"s);
+    }
+
+    if (!log_level.empty()) {
+        args.log_level = ParseSeverity(log_level);
+    }
+    for (const auto& log_route : log_routes) {
+        args.log_routes.push_back(ParseRouteLogRule(log_route));
+    }
+    if (vm.contains("log-statistics-period"s)) {
+        args.log_statistics_period = std::chrono::milliseconds(log_statistics_period);
+    }
+
+    if (vm.contains("static-cache-size"s)) {
+        args.static_cache_size = static_cache_size_mb * 1024 * 1024;
+    }
+    if (vm.contains("static-cache-watch"s)) {
+        args.is_static_cache_watch = true;
+    }
+
     if (!vm.contains("state-file"s)) {
         args.save_period = {};
     }
@@ -117,9 +190,21 @@ class Ticker : public std::enable_shared_from_this<Ticker> {
 public:
     using Strand = net::strand<net::io_context::executor_type>;
     using Handler = std::function<void(std::chrono::milliseconds delta)>;
+    // Обработчик, который завершает работу асинхронно и сообщает об этом вызовом done внутри strand
+    using AsyncHandler = std::function<void(std::chrono::milliseconds delta, std::function<void()> done)>;
 
     // Функция handler будет вызываться внутри strand с интервалом period
     Ticker(Strand strand, std::chrono::milliseconds period, Handler handler)
+        : Ticker(strand, period, AsyncHandler{[handler = std::move(handler)](std::chrono::milliseconds delta,
+                                                                              std::function<void()> done) {
+            handler(delta);
+            done();
+        }}) {
+    }
+
+    // Следующий вызов handler планируется после того, как предыдущий вызовет done,
+    // поэтому вызовы не накладываются друг на друга
+    Ticker(Strand strand, std::chrono::milliseconds period, AsyncHandler handler)
         : strand_{strand}
         , period_{period}
         , handler_{std::move(handler)} {
@@ -150,10 +235,12 @@ private:
             auto delta = duration_cast<milliseconds>(this_tick - last_tick_);
             last_tick_ = this_tick;
             try {
-                handler_(delta);
+                handler_(delta, [self = shared_from_this()] {
+                    self->ScheduleTick();
+                });
             } catch (...) {
+                ScheduleTick();
             }
-            ScheduleTick();
         }
     }
 
@@ -162,7 +249,7 @@ private:
     Strand strand_;
     std::chrono::milliseconds period_;
     net::steady_timer timer_{strand_};
-    Handler handler_;
+    AsyncHandler handler_;
     std::chrono::steady_clock::time_point last_tick_;
 };
 
@@ -173,29 +260,26 @@ int main(int argc, const char* argv[]) {
         if (auto args_opt = ParseCommandLine(argc, argv)) {
             auto args = args_opt.value();
 
-            LoggingRequestHandler<http_handler::RequestHandler>::InitLogging(); 
+            LoggingRequestHandler<http_handler::RequestHandler>::InitLogging(args.log_overflow);
             // 1. Загружаем карту из файла и построить модель игры  
             model::Game game = json_loader::LoadGame(args.config_file.c_str());
             extra::ExtraData extra_data(args.config_file.c_str());
             app::Players players(game);
             app::PlayerTokens player_tokens;
-            std::filesystem::path state_file_path;
+            infra::SerializationListener seria_listener(game, players, player_tokens);
             //Проверка необходимо ли восстанавливать состояние игры
             if(!args.save_file.empty()) {
-                state_file_path = std::filesystem::weakly_canonical(args.save_file);
+                auto state_file_path = std::filesystem::weakly_canonical(args.save_file);
                 state_file_path = std::filesystem::absolute(state_file_path);
-                if(std::filesystem::exists(state_file_path)) {
-                    std::ifstream in{state_file_path, std::ios_base::binary};
-                    boost::archive::binary_iarchive ar{in};
-                    serialization::SessionsRepr sessions_repr{};
-                    serialization::PlayersRepr players_repr{};
-                    serialization::PlayerTokensRepr players_tokens_repr{};
-                    ar >> sessions_repr;
-                    ar >> players_repr;
-                    ar >> players_tokens_repr;
-                    game.SetSessions(sessions_repr.Restore(game));
-                    players.SetPlayers(players_repr.Restore());
-                    player_tokens.SetTokens(players_tokens_repr.Restore(players));
+                seria_listener.SetPathToStateFile(state_file_path);
+                seria_listener.SetIncremental(args.is_state_journal);
+                // Загружаем контрольную точку и изменения из журнала
+                const auto load_start = std::chrono::steady_clock::now();
+                if(seria_listener.LoadState()) {
+                    const auto load_time = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - load_start);
+                    LoggingRequestHandler<http_handler::RequestHandler>::LogStateLoaded(
+                        state_file_path.string(), load_time.count(), GetPeakRssKb());
                 }
             }
 
@@ -209,29 +293,34 @@ int main(int argc, const char* argv[]) {
             }
             postgres::DBParams db_params{10, std::string(db_url)};
 
+            // 2. Инициализируем io_context. strand сессий в Application используют службы ioc,
+            // поэтому ioc создаётся раньше Application и уничтожается после него
+            const unsigned num_threads = std::thread::hardware_concurrency();
+            net::io_context ioc(num_threads);
+
             app::Application app(game, players, player_tokens, extra_data, db_params);
-            infra::SerializationListener seria_listener(game, players, player_tokens);
-            
+            seria_listener.SetStateLocker([&app] { return app.LockStateForRead(); });
             if((!args.save_file.empty())) {
-                seria_listener.SetPathToStateFile(state_file_path);
                 if(game.IsGameAuto()) {
                     if(!(args.save_period.empty())) {
                         uint64_t save_period_milliseconds = std::stoll(args.save_period);
                         std::chrono::milliseconds save_period(save_period_milliseconds);
                         seria_listener.SetSavePeriod(save_period);
-                        app.SetApplicationListener(&seria_listener);
+                        app.AddApplicationListener(&seria_listener);
                     }
                 } else {
-                    app.SetApplicationListener(&seria_listener);
+                    app.AddApplicationListener(&seria_listener);
                 }
             }
 
-            // 2. Инициализируем io_context
-            const unsigned num_threads = std::thread::hardware_concurrency();
-            net::io_context ioc(num_threads);
+            // Команды игроков выполняются в strand их игровых сессий
+            app.EnableSessionStrands(ioc);
 
-            // strand для выполнения запросов к API
+            // strand для тиков, присоединения игроков и рассылки состояния по WebSocket
             auto api_strand = net::make_strand(ioc);
+            if(args.is_parallel_tick) {
+                app.EnableParallelTick(num_threads, api_strand);
+            }
 
             // 3. Добавляем асинхронный обработчик сигналов SIGINT и SIGTERM
             net::signal_set signals(ioc, SIGINT, SIGTERM);
@@ -248,16 +337,42 @@ int main(int argc, const char* argv[]) {
                 std::chrono::milliseconds tick_duration(milliseconds);
 
                 auto ticker = std::make_shared<Ticker>(api_strand, tick_duration,
-                    [&app](std::chrono::milliseconds delta) { app.TickTimeUseCase(delta.count()); }
+                    Ticker::AsyncHandler{[&app](std::chrono::milliseconds delta, std::function<void()> done) {
+                        app.TickTimeUseCase(delta.count(), std::move(done));
+                    }}
                 );
                 ticker->Start();
             }
 
+            // Счётчики записи в БД выводятся с периодом статистики маршрутов, если они изменились
+            if(args.log_statistics_period.count() > 0) {
+                auto db_stats_ticker = std::make_shared<Ticker>(api_strand, args.log_statistics_period,
+                    [&app, last_stats = postgres::RetiredPlayersWriter::Stats{}](std::chrono::milliseconds) mutable {
+                        const auto stats = app.GetRetiredPlayersStats();
+                        if(stats.enqueued != last_stats.enqueued || stats.dropped != last_stats.dropped
+                           || stats.failed_batches != last_stats.failed_batches || stats.written != last_stats.written) {
+                            LogRetiredPlayersStats(stats);
+                        }
+                        last_stats = stats;
+                    }
+                );
+                db_stats_ticker->Start();
+            }
+
             // 5. Создаём обработчик запросов в куче, управляемый shared_ptr
             auto handler = std::make_shared<http_handler::RequestHandler>(
                 api_strand, app, args.root_dir.c_str());
-
-            LoggingRequestHandler<http_handler::RequestHandler> LoggingDecorator(handler);
+            if(args.static_cache_size != 0) {
+                handler->EnableStaticCache(args.static_cache_size, args.is_static_cache_watch);
+            }
+            // WebSocket-клиенты получают состояние своей сессии после каждого тика
+            auto state_hub = std::make_shared<http_handler::GameStateHub>(api_strand, app);
+            app.AddApplicationListener(state_hub.get());
+            handler->SetGameStateHub(state_hub);
+
+            auto log_policy = std::make_shared<RequestLogPolicy>(
+                std::move(args.log_routes), args.log_level, args.log_statistics_period);
+            LoggingRequestHandler<http_handler::RequestHandler> LoggingDecorator(handler, log_policy);
             const auto address = net::ip::make_address("0.0.0.0");
             constexpr net::ip::port_type port = 8080;
 
@@ -273,25 +388,17 @@ int main(int argc, const char* argv[]) {
             });
 
             LoggingDecorator.LogExitServer();
+            // Выводим записи, оставшиеся в очереди журнала
+            StopAsyncLogging();
 
             // Если указан файл сохранения, необходимо сохранить состояние игры
             if(!args.save_file.empty()) {
-                //Сохраняем игровое состояние во временный файл
-                auto temp_path = state_file_path.string() + "_temp"s;
-                std::ofstream out{temp_path, std::ios_base::binary};
-                boost::archive::binary_oarchive ar{out};
-                serialization::SessionsRepr sessions_repr(game.GetSessions());
-                serialization::PlayersRepr players_repr{players};
-                serialization::PlayerTokensRepr players_tokens_repr{player_tokens};
-                ar << sessions_repr;
-                ar << players_repr;
-                ar << players_tokens_repr;
-                // Перезаписываем временный файл в целевой
-                std::filesystem::rename(temp_path, state_file_path);
+                seria_listener.SaveState();
             }
         }
         return EXIT_SUCCESS;
     } catch (const std::exception& ex) {
+        StopAsyncLogging();
         std::cerr << ex.what() << std::endl;
         return EXIT_FAILURE;
     }
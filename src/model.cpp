@@ -1,5 +1,6 @@
 #include "model.h"
 
+#include <algorithm>
 #include <stdexcept>
 
 namespace model {
@@ -73,18 +74,115 @@ double roundToOneDecimal(double value) {
     return std::round(value * 10.0) / 10.0;
 }
 
+void RoadGrid::Add(const limit_of_road& limit, size_t road_index) {
+    const Entry entry{limit, road_index};
+    for(auto cell_x = ToCell(limit.left_x_); cell_x <= ToCell(limit.right_x_); ++cell_x) {
+        for(auto cell_y = ToCell(limit.up_y_); cell_y <= ToCell(limit.down_y_); ++cell_y) {
+            auto& cell = cells_[{cell_x, cell_y}];
+            // Сохраняем порядок std::map, чтобы при пересечении дорог находилась та же дорога
+            auto it = std::upper_bound(cell.begin(), cell.end(), entry, [](const Entry& lhs, const Entry& rhs) {
+                return lhs.limit < rhs.limit;
+            });
+            cell.insert(it, entry);
+        }
+    }
+}
+
+const RoadGrid::Entry* RoadGrid::Find(coords point) const {
+    auto it = cells_.find({ToCell(point.x), ToCell(point.y)});
+    if(it == cells_.end()) {
+        return nullptr;
+    }
+    for(const auto& entry : it->second) {
+        if(entry.limit.IsInside(point)) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+namespace {
+
+void AddJunction(std::vector<double>& junctions, double coord) {
+    auto it = std::lower_bound(junctions.begin(), junctions.end(), coord);
+    if(it == junctions.end() || *it != coord) {
+        junctions.insert(it, coord);
+    }
+}
+
+// Возвращает интервал между соседними перекрёстками, содержащий coord.
+// Если coord совпадает с перекрёстком, интервал вырождается в точку.
+std::pair<double, double> JunctionInterval(const std::vector<double>& junctions, double coord) {
+    auto next = std::upper_bound(junctions.begin(), junctions.end(), coord);
+    if(next == junctions.begin() || next == junctions.end() || *std::prev(next) == coord) {
+        return {coord, coord};
+    }
+    return {std::nextafter(*std::prev(next), *next), std::nextafter(*next, *std::prev(next))};
+}
+
+}  // namespace
+
+void Map::InsertRoad(LimitToRoad& roads, RoadGrid& roads_index, const limit_of_road& limit,
+                     const Road& road, size_t road_index) {
+    auto [it, inserted] = roads.insert({limit, road});
+    if(inserted) {
+        roads_index.Add(it->first, road_index);
+        AddJunctions(road_index, it->first);
+    }
+}
+
+void Map::AddJunctions(size_t road_index, const limit_of_road& limit) {
+    // Координата перекрёстка берётся вдоль оси той дороги, к которой он относится
+    const auto junction_coords = [this](size_t index, const limit_of_road& other) {
+        return roads_.at(index).IsHorizontal() ? std::pair{other.left_x_, other.right_x_}
+                                               : std::pair{other.up_y_, other.down_y_};
+    };
+    road_limits_[road_index] = limit;
+    auto& node = road_graph_[road_index];
+    const auto [own_begin, own_end] = junction_coords(road_index, limit);
+    AddJunction(node.junctions, own_begin);
+    AddJunction(node.junctions, own_end);
+    for(size_t other_index = 0; other_index < road_limits_.size(); ++other_index) {
+        const auto& other_limit = road_limits_[other_index];
+        if(other_index == road_index || !other_limit || !other_limit->Intersects(limit)) {
+            continue;
+        }
+        auto& other_node = road_graph_[other_index];
+        node.adjacent_roads.push_back(other_index);
+        other_node.adjacent_roads.push_back(road_index);
+        const auto [cross_begin, cross_end] = junction_coords(road_index, *other_limit);
+        for(auto coord : {cross_begin, cross_end}) {
+            if(own_begin <= coord && coord <= own_end) {
+                AddJunction(node.junctions, coord);
+            }
+        }
+        const auto [other_begin, other_end] = junction_coords(other_index, *other_limit);
+        const auto [new_begin, new_end] = junction_coords(other_index, limit);
+        for(auto coord : {new_begin, new_end}) {
+            if(other_begin <= coord && coord <= other_end) {
+                AddJunction(other_node.junctions, coord);
+            }
+        }
+    }
+}
+
 void Map::AddRoad(const Road& road) {
     roads_.emplace_back(road);
+    road_limits_.emplace_back();
+    road_graph_.emplace_back();
+    const size_t road_index = roads_.size() - 1;
     if(road.IsHorizontal()) {
         try{
         if(road.GetStart().x < road.GetEnd().x) {
-            hor_roads_.insert({{roundToOneDecimal(road.GetStart().x - 0.4), roundToOneDecimal(road.GetEnd().x + 0.4),
-                                roundToOneDecimal(road.GetStart().y - 0.4), roundToOneDecimal(road.GetStart().y + 0.4)},
-                road});
+            InsertRoad(hor_roads_, hor_roads_index_,
+                {roundToOneDecimal(road.GetStart().x - 0.4), roundToOneDecimal(road.GetEnd().x + 0.4),
+                 roundToOneDecimal(road.GetStart().y - 0.4), roundToOneDecimal(road.GetStart().y + 0.4)},
+                road, road_index);
         } else if(road.GetStart().x > road.GetEnd().x) {
-            hor_roads_.insert({{roundToOneDecimal(road.GetEnd().x - 0.4), roundToOneDecimal(road.GetStart().x + 0.4),
-                roundToOneDecimal(road.GetStart().y - 0.4), roundToOneDecimal(road.GetStart().y + 0.4)},
-                road});
+            InsertRoad(hor_roads_, hor_roads_index_,
+                {roundToOneDecimal(road.GetEnd().x - 0.4), roundToOneDecimal(road.GetStart().x + 0.4),
+                 roundToOneDecimal(road.GetStart().y - 0.4), roundToOneDecimal(road.GetStart().y + 0.4)},
+                road, road_index);
         }
             auto start_coord_y = static_cast<double>(road.GetStart().y);
             auto start_coord_x = static_cast<double>(road.GetStart().x);
@@ -96,38 +194,55 @@ void Map::AddRoad(const Road& road) {
         }
     } else if (road.IsVertical()){
         if(road.GetStart().y < road.GetEnd().y) {
-            vert_roads_.insert({{roundToOneDecimal(road.GetStart().x - 0.4), roundToOneDecimal(road.GetStart().x + 0.4),
-                                    roundToOneDecimal(road.GetStart().y - 0.4), roundToOneDecimal(road.GetEnd().y + 0.4)},
-                road});
+            InsertRoad(vert_roads_, vert_roads_index_,
+                {roundToOneDecimal(road.GetStart().x - 0.4), roundToOneDecimal(road.GetStart().x + 0.4),
+                 roundToOneDecimal(road.GetStart().y - 0.4), roundToOneDecimal(road.GetEnd().y + 0.4)},
+                road, road_index);
         } else if (road.GetStart().y > road.GetEnd().y) {
-            vert_roads_.insert({{roundToOneDecimal(road.GetStart().x - 0.4), roundToOneDecimal(road.GetStart().x + 0.4),
-                                    roundToOneDecimal(road.GetEnd().y - 0.4), roundToOneDecimal(road.GetStart().y + 0.4)},
-                road});
+            InsertRoad(vert_roads_, vert_roads_index_,
+                {roundToOneDecimal(road.GetStart().x - 0.4), roundToOneDecimal(road.GetStart().x + 0.4),
+                 roundToOneDecimal(road.GetEnd().y - 0.4), roundToOneDecimal(road.GetStart().y + 0.4)},
+                road, road_index);
         }
 
     }
 }
 
 const Road* Map::FindHorRoad(double x_coord, double y_coord) const {
-    coords start_coords(x_coord, y_coord);
-    for(auto& road_items : hor_roads_) {
-        if(road_items.first.IsInside(start_coords)) {
-            return &road_items.second;
-        }
+    if(const auto entry = hor_roads_index_.Find({x_coord, y_coord})) {
+        return &roads_.at(entry->road_index);
     }
     return nullptr;
 }
 
 const Road* Map::FindVertRoad(double x_coord, double y_coord) const {
-    coords start_coords(x_coord, y_coord);
-    for(auto& road_items : vert_roads_) {
-        if(road_items.first.IsInside(start_coords)) {
-            return &road_items.second;
-        }
+    if(const auto entry = vert_roads_index_.Find({x_coord, y_coord})) {
+        return &roads_.at(entry->road_index);
     }
     return nullptr;
 }
 
+Map::RoadLocation Map::LocateRoads(double x_coord, double y_coord) const {
+    const coords point{x_coord, y_coord};
+    const auto hor_entry = hor_roads_index_.Find(point);
+    const auto vert_entry = vert_roads_index_.Find(point);
+    RoadLocation location{hor_entry ? &roads_.at(hor_entry->road_index) : nullptr,
+                          vert_entry ? &roads_.at(vert_entry->road_index) : nullptr,
+                          {x_coord, x_coord, y_coord, y_coord}};
+    // Все дороги, пересекающие полосу дороги, перекрывают её целиком по ширине,
+    // поэтому результат поиска меняется только на перекрёстках вдоль дороги
+    if(hor_entry != nullptr) {
+        location.bounds = hor_entry->limit;
+        std::tie(location.bounds.left_x_, location.bounds.right_x_)
+            = JunctionInterval(road_graph_.at(hor_entry->road_index).junctions, x_coord);
+    } else if(vert_entry != nullptr) {
+        location.bounds = vert_entry->limit;
+        std::tie(location.bounds.up_y_, location.bounds.down_y_)
+            = JunctionInterval(road_graph_.at(vert_entry->road_index).junctions, y_coord);
+    }
+    return location;
+}
+
 void Map::AddBuilding(const Building& building) {
     buildings_.emplace_back(building);
 }
@@ -150,6 +265,13 @@ void Dog::SetSpeed(std::string move_direction, double map_dog_speed) {
     }
 }
 
+const Map::RoadLocation& Dog::LocateRoads(const Map& map) {
+    if(!road_location_ || !road_location_->bounds.IsInside({coords_.x, coords_.y})) {
+        road_location_ = map.LocateRoads(coords_.x, coords_.y);
+    }
+    return *road_location_;
+}
+
 std::uint64_t GameSession::AddDog(std::string dog_name) {
     // Получаем случайное значение начальной координаты нового пса
     Dog::coords start_coords;
@@ -177,10 +299,19 @@ std::uint64_t GameSession::AddDog(std::string dog_name) {
     }
 
     auto created_dog = Dog(dog_name, start_coords);
-    auto last_index = dog_index_;
-    // формируем идентификатор
-    dogs_.insert({dog_index_++, created_dog});
-    return last_index;
+    // идентификатор формирует слот-карта, dog_index_ считает созданных псов
+    ++dog_index_;
+    const auto dog_id = dogs_.insert(created_dog);
+    MarkDogChanged(dog_id);
+    return dog_id;
+}
+
+void GameSession::RemoveDog(std::uint64_t dog_index) {
+    if(dogs_.erase(dog_index) != 0) {
+        pending_changes_.changed_dogs.erase(dog_index);
+        pending_changes_.removed_dogs.insert(dog_index);
+        ++state_version_;
+    }
 }
 
 void GameSession::AddLoot (loot_gen::LootGenerator::TimeInterval time_delta) {
@@ -211,21 +342,28 @@ void GameSession::AddLoot (loot_gen::LootGenerator::TimeInterval time_delta) {
             new_loot_type = 0;
         }
         auto created_loot = Loot(new_loot_type, coords);
-        loots_.insert({loot_index_++, created_loot});
+        pending_changes_.changed_loots.insert(loots_.insert(created_loot));
+        ++state_version_;
+        ++loot_index_;
     }
     //loot_count_ += new_loot_count;
 }
 
 void GameSession::HandleEvents(const std::vector<collision_detector::Gatherer>& gatherers) {
-    //auto& loots = GetLoots();
     const auto& offices = map_->GetOffices();
     const auto start_offices_index = loots_.size();
     const auto end_offices_index = start_offices_index + (offices.size() - 1);
     std::vector<collision_detector::Item> items;
-    std::vector<int> indexes_of_collected_loot;
+    // Идентификаторы трофеев в порядке предметов: при подборе трофея слот-карта
+    // переставляет элементы, поэтому номер предмета нельзя использовать как позицию в loots_
+    std::vector<IndexToLoot::Id> loot_ids;
+    std::vector<bool> is_loot_collected(loots_.size(), false);
+    items.reserve(loots_.size() + offices.size());
+    loot_ids.reserve(loots_.size());
     for(const auto& loot_items : loots_) {
         collision_detector::Item item({loot_items.second.GetCoords().x, loot_items.second.GetCoords().y},0);
         items.push_back(item);
+        loot_ids.push_back(loot_items.first);
     }
     for(const auto& office : offices) {
         collision_detector::Item item({static_cast<double>(office.GetPosition().x), static_cast<double>(office.GetPosition().y)}, 0.25);
@@ -234,31 +372,19 @@ void GameSession::HandleEvents(const std::vector<collision_detector::Gatherer>&
     collision_detector::VectorItemGathererProvider provider(items, gatherers);
     auto events = collision_detector::FindGatherEvents(provider);
     for(const auto& event : events) {
-        if((event.item_id < start_offices_index) && 
-            (std::find(indexes_of_collected_loot.begin(), indexes_of_collected_loot.end(), event.item_id) == indexes_of_collected_loot.end())) {
-            //auto dog_ptr = FindDog(event.gatherer_id);
-            auto it = dogs_.begin();
-            std::advance(it, event.gatherer_id);
-            auto dog_ptr = &((*it).second);
+        // Собиратели перечислены в порядке обхода dogs_, который за время обработки событий не меняется
+        auto dog_ptr = &((dogs_.begin() + event.gatherer_id)->second);
+        if((event.item_id < start_offices_index) && !is_loot_collected[event.item_id]) {
             if(dog_ptr->GetBag().size() < 3) {
-                int i = 0;
-                std::uint64_t key_of_deleted_loot = 0;
-                for(const auto& loot_items : loots_) {
-                    if(i == event.item_id) {
-                        dog_ptr->PutLootInTheBag(loot_items.first, loot_items.second);
-                        indexes_of_collected_loot.push_back(event.item_id);
-                        key_of_deleted_loot = loot_items.first;
-                        break;
-                    }
-                    i++;
-                } 
-                loots_.erase(key_of_deleted_loot);
+                const auto loot_id = loot_ids[event.item_id];
+                dog_ptr->PutLootInTheBag(loot_id, loots_.at(loot_id));
+                is_loot_collected[event.item_id] = true;
+                loots_.erase(loot_id);
+                MarkDogChanged((dogs_.begin() + event.gatherer_id)->first);
+                pending_changes_.changed_loots.erase(loot_id);
+                pending_changes_.removed_loots.insert(loot_id);
             }
         } else if ( (start_offices_index <= event.item_id) && (event.item_id <= end_offices_index) ) {
-            //auto dog_ptr = FindDog(event.gatherer_id);
-            auto it = dogs_.begin();
-            std::advance(it, event.gatherer_id);
-            auto dog_ptr = &((*it).second);
             const auto dog_bag = dog_ptr->GetBag();
             dog_ptr->ExtractAllLoot();
             if(!dog_bag.empty()) {
@@ -267,9 +393,53 @@ void GameSession::HandleEvents(const std::vector<collision_detector::Gatherer>&
                     value += map_->GetLootTypeValue(bag_items.second);
                 }
                 dog_ptr->AddScore(value);
+                MarkDogChanged((dogs_.begin() + event.gatherer_id)->first);
             }
         }
     }
 }
 
+void GameSession::CommitTick() {
+    changes_history_.emplace_back(++tick_, std::move(pending_changes_));
+    pending_changes_ = {};
+    if(changes_history_.size() > MAX_CHANGES_HISTORY) {
+        changes_history_.pop_front();
+    }
+}
+
+std::optional<SessionChanges> GameSession::GetChangesSince(std::uint64_t since) const {
+    if(since > tick_) {
+        return std::nullopt;
+    }
+    SessionChanges changes;
+    if(since == tick_) {
+        return changes;
+    }
+    // История должна содержать все тики с since + 1 по tick_
+    if(changes_history_.empty() || changes_history_.front().first > since + 1) {
+        return std::nullopt;
+    }
+    for(const auto& [tick, tick_changes] : changes_history_) {
+        if(tick <= since) {
+            continue;
+        }
+        changes.Merge(tick_changes);
+    }
+    return changes;
+}
+
+void SessionChanges::Merge(const SessionChanges& later) {
+    changed_dogs.insert(later.changed_dogs.begin(), later.changed_dogs.end());
+    removed_dogs.insert(later.removed_dogs.begin(), later.removed_dogs.end());
+    changed_loots.insert(later.changed_loots.begin(), later.changed_loots.end());
+    removed_loots.insert(later.removed_loots.begin(), later.removed_loots.end());
+    // Идентификаторы не используются повторно, поэтому удалённый элемент не может снова измениться
+    for(auto dog_index : later.removed_dogs) {
+        changed_dogs.erase(dog_index);
+    }
+    for(auto loot_index : later.removed_loots) {
+        changed_loots.erase(loot_index);
+    }
+}
+
 }  // namespace model
@@ -1,14 +1,20 @@
 #pragma once
 #include <string>
+#include <cmath>
+#include <cstdint>
 #include <random>
 #include <unordered_map>
 #include <vector>
 #include <map>
+#include <set>
+#include <deque>
+#include <optional>
 #include <iterator>
 #include <iostream>
 
 #include "tagged.h"
 #include "loot_generator.h"
+#include "slot_map.h"
 #include "collision_detector.h"
 
 namespace model {
@@ -137,6 +143,10 @@ struct limit_of_road {
         return (dog_coords.x <= right_x_) && (dog_coords.x >= left_x_) && 
                (dog_coords.y >= up_y_) && (dog_coords.y <= down_y_);
     }
+    bool Intersects(limit_of_road rhs) const {
+        return (left_x_ <= rhs.right_x_) && (rhs.left_x_ <= right_x_) &&
+               (up_y_ <= rhs.down_y_) && (rhs.up_y_ <= down_y_);
+    }
 
     double left_x_;
     double right_x_;
@@ -150,6 +160,41 @@ bool operator<(const coords& lhs, const limit_of_road& rhs);
 
 double roundToOneDecimal(double value);
 
+// Равномерная сетка для поиска дороги по координатам.
+// Каждая ячейка хранит границы дорог, которые её пересекают, в том же порядке,
+// в котором их перебирает std::map<limit_of_road, Road>, поэтому поиск
+// возвращает ту же дорогу, что и полный перебор.
+class RoadGrid {
+public:
+    struct Entry {
+        limit_of_road limit;
+        size_t road_index;
+    };
+
+    void Add(const limit_of_road& limit, size_t road_index);
+    const Entry* Find(coords point) const;
+
+private:
+    using CellKey = std::pair<std::int64_t, std::int64_t>;
+    struct CellKeyHasher {
+        size_t operator()(const CellKey& key) const {
+            size_t hash_value = std::hash<std::int64_t>()(key.first);
+            hash_value ^= std::hash<std::int64_t>()(key.second) + 0x9e3779b9 + (hash_value << 6) + (hash_value >> 2);
+            return hash_value;
+        }
+    };
+
+    // Сторона ячейки. Дороги заданы в целых координатах, ширина дороги 0.8,
+    // поэтому в ячейку попадает лишь несколько дорог.
+    constexpr static double CELL_SIZE = 10.0;
+
+    static std::int64_t ToCell(double coord) {
+        return static_cast<std::int64_t>(std::floor(coord / CELL_SIZE));
+    }
+
+    std::unordered_map<CellKey, std::vector<Entry>, CellKeyHasher> cells_;
+};
+
 class Map {
 public:
     using Id = util::Tagged<std::string, Map>;
@@ -157,6 +202,21 @@ public:
     using Buildings = std::vector<Building>;
     using Offices = std::vector<Office>;
 
+    // Дороги, на которых находится точка, и область вокруг неё,
+    // внутри которой результат поиска дорог не меняется
+    struct RoadLocation {
+        const Road* hor_road = nullptr;
+        const Road* vert_road = nullptr;
+        limit_of_road bounds;
+    };
+
+    // Вершина графа дорог: смежные дороги и отсортированные координаты перекрёстков
+    // вдоль дороги (границы пересекающих её дорог, включая концы самой дороги)
+    struct RoadNode {
+        std::vector<size_t> adjacent_roads;
+        std::vector<double> junctions;
+    };
+
     Map(Id id, std::string name) noexcept
         : id_(std::move(id))
         , name_(std::move(name)) {
@@ -220,6 +280,12 @@ public:
 
     const Road* FindVertRoad(double x_coord, double y_coord) const;
 
+    RoadLocation LocateRoads(double x_coord, double y_coord) const;
+
+    const RoadNode& GetRoadNode(size_t road_index) const {
+        return road_graph_.at(road_index);
+    }
+
     void AddBuilding(const Building& building);
 
     void AddOffice(Office office);
@@ -238,6 +304,11 @@ public:
 
 private:
     using OfficeIdToIndex = std::unordered_map<Office::Id, size_t, util::TaggedHasher<Office::Id>>;
+    using LimitToRoad = std::map<limit_of_road, Road, std::less<>>;
+
+    void InsertRoad(LimitToRoad& roads, RoadGrid& roads_index, const limit_of_road& limit,
+                    const Road& road, size_t road_index);
+    void AddJunctions(size_t road_index, const limit_of_road& limit);
 
     Id id_;
     std::string name_;
@@ -247,8 +318,13 @@ private:
     int bag_capacity_;
     Roads roads_;
     Buildings buildings_;
-    std::map<limit_of_road, Road, std::less<>> hor_roads_;
-    std::map<limit_of_road, Road, std::less<>> vert_roads_;
+    LimitToRoad hor_roads_;
+    LimitToRoad vert_roads_;
+    RoadGrid hor_roads_index_;
+    RoadGrid vert_roads_index_;
+    // Граница каждой проиндексированной дороги и граф перекрёстков, индексы совпадают с roads_
+    std::vector<std::optional<limit_of_road>> road_limits_;
+    std::vector<RoadNode> road_graph_;
     
     OfficeIdToIndex warehouse_id_to_index_;
     Offices offices_;
@@ -326,7 +402,7 @@ public:
         return score_;
     }
 
-    void PutLootInTheBag(int index, Loot loot){
+    void PutLootInTheBag(std::uint64_t index, Loot loot){
         bag_.insert({index, loot.GetLootType()});
     }
 
@@ -376,6 +452,10 @@ public:
         direction_ = direction;
     }
 
+    // Возвращает дороги под псом. К карте обращается, только когда пёс
+    // покинул участок дороги между перекрёстками, найденный при прошлом поиске
+    const Map::RoadLocation& LocateRoads(const Map& map);
+
     bool operator==(const Dog& rhs) const {
         return name_ == rhs.name_ && coords_ == rhs.coords_ &&
                speed_ == rhs.speed_ && direction_ == rhs.direction_ &&
@@ -392,6 +472,7 @@ private:
     int score_ = 0;
     std::chrono::milliseconds standby_time_{0};
     std::chrono::milliseconds in_game_time_{0};
+    std::optional<Map::RoadLocation> road_location_;
 };
 
 struct lootGeneratorConfig {
@@ -399,10 +480,22 @@ struct lootGeneratorConfig {
     double probability;
 };
 
+// Идентификаторы псов и трофеев, изменившихся или удалённых за один или несколько тиков
+struct SessionChanges {
+    std::set<std::uint64_t> changed_dogs;
+    std::set<std::uint64_t> removed_dogs;
+    std::set<std::uint64_t> changed_loots;
+    std::set<std::uint64_t> removed_loots;
+
+    // Добавляет изменения последующих тиков
+    void Merge(const SessionChanges& later);
+};
+
 class GameSession {
 public:
-    using IndexToDog = std::map<std::uint64_t, Dog>;
-    using IndexToLoot = std::map<std::uint64_t, Loot>;
+    // Идентификаторы псов и трофеев выдаёт слот-карта, они не меняются до удаления элемента
+    using IndexToDog = util::SlotMap<Dog>;
+    using IndexToLoot = util::SlotMap<Loot>;
     
     //GameSession() = default;
     explicit GameSession(const Map* map, bool is_randomize, lootGeneratorConfig loot_cong) : map_(map), is_randomize_(is_randomize), 
@@ -410,9 +503,34 @@ public:
 
     // Отношение композиции. Создаем собаку внутри сессии. Передаем имя
     std::uint64_t AddDog(std::string dog_name);
+    void RemoveDog(std::uint64_t dog_index);
     void AddLoot (loot_gen::LootGenerator::TimeInterval time_delta);
     void HandleEvents(const std::vector<collision_detector::Gatherer>& gatherers);
 
+    // Количество тиков, хранящихся в истории изменений
+    static constexpr size_t MAX_CHANGES_HISTORY = 256;
+
+    // Отмечает пса изменившимся в текущем тике
+    void MarkDogChanged(std::uint64_t dog_index) {
+        pending_changes_.changed_dogs.insert(dog_index);
+        ++state_version_;
+    }
+    // Завершает тик: изменения, накопленные с прошлого тика, попадают в историю под новым номером
+    void CommitTick();
+
+    std::uint64_t GetTick() const {
+        return tick_;
+    }
+
+    // Версия состояния псов и трофеев, увеличивается при каждом их изменении
+    std::uint64_t GetStateVersion() const {
+        return state_version_;
+    }
+
+    // Возвращает изменения после тика since по текущий тик включительно.
+    // Если история уже не содержит нужных тиков, возвращает std::nullopt
+    std::optional<SessionChanges> GetChangesSince(std::uint64_t since) const;
+
     Map::Id GetIDMap() const {
         return (*map_).GetId();
     }
@@ -481,6 +599,10 @@ private:
     IndexToLoot loots_;
     std::uint64_t dog_index_ = 0;
     std::uint64_t loot_index_ = 0;
+    std::uint64_t tick_ = 0;
+    std::uint64_t state_version_ = 0;
+    SessionChanges pending_changes_;
+    std::deque<std::pair<std::uint64_t, SessionChanges>> changes_history_;
 };
 
 class Game {
@@ -520,6 +642,9 @@ public:
     void SetSessions(const MapIdToSession& mapid_to_sessions){
         sessions_ = mapid_to_sessions;
     }
+    void SetSessions(MapIdToSession&& mapid_to_sessions){
+        sessions_ = std::move(mapid_to_sessions);
+    }
     bool IsGameAuto() const {
         return is_auto_tick_;
     }
@@ -565,6 +690,10 @@ public:
         return sessions_;
     }
 
+    const MapIdToSession& GetSessions() const {
+        return sessions_;
+    }
+
 private:
     using MapIdHasher = util::TaggedHasher<Map::Id>;
     using MapIdToIndex = std::unordered_map<Map::Id, size_t, MapIdHasher>;
@@ -155,12 +155,12 @@ public:
         /* Восстанавливаем dogs_ */
         for(const auto& dog_item : dogs_reprs_) {
             //model::Dog dog = dog_item.second.Restore();
-            dogs_.insert({dog_item.first, dog_item.second.Restore()});
+            dogs_.try_emplace(dog_item.first, dog_item.second.Restore());
         }
         session.SetDogs(dogs_);
         /* Восстанавливаем loots_ */
         for(const auto& loot_item : loots_reprs_) {
-            loots_.insert({loot_item.first, loot_item.second.Restore()});
+            loots_.try_emplace(loot_item.first, loot_item.second.Restore());
         }
         session.SetLoots(loots_);
         return session;
@@ -198,6 +198,102 @@ private:
 
 };
 
+// SessionChangesRepr - изменения сессии за несколько тиков, запись журнала состояния.
+// Хранит только изменившиеся и удалённые псы и трофеи
+class SessionChangesRepr {
+public:
+    using IndexToDogRepr = std::map<std::uint64_t, DogRepr>;
+    using IndexToLootRepr = std::map<std::uint64_t, LootRepr>;
+
+    SessionChangesRepr() = default;
+
+    SessionChangesRepr(const model::GameSession& session, const model::SessionChanges& changes)
+        : map_id_(*(session.GetIDMap()))
+        , removed_dogs_(changes.removed_dogs.begin(), changes.removed_dogs.end())
+        , removed_loots_(changes.removed_loots.begin(), changes.removed_loots.end())
+        , dog_index_(session.GetDogsIndex())
+        , loot_index_(session.GetLootsIndex()) {
+        const auto map_dog_speed = session.GetMapPtr()->GetDogSpeed();
+        for(auto dog_index : changes.changed_dogs) {
+            dogs_reprs_.emplace(dog_index, DogRepr(session.GetDogs().at(dog_index), map_dog_speed));
+        }
+        for(auto loot_index : changes.changed_loots) {
+            loots_reprs_.emplace(loot_index, LootRepr(session.GetLoots().at(loot_index)));
+        }
+    }
+
+    const std::string& GetMapId() const {
+        return map_id_;
+    }
+
+    const IndexToDogRepr& GetChangedDogs() const {
+        return dogs_reprs_;
+    }
+
+    const std::vector<std::uint64_t>& GetRemovedDogs() const {
+        return removed_dogs_;
+    }
+
+    // Применяет изменения к сессии игры, создавая её при необходимости.
+    // Возвращает nullptr, если карты сессии больше нет в игре
+    model::GameSession* Apply(model::Game& game) const {
+        const model::Map::Id map_id{map_id_};
+        auto session_ptr = game.FindSession(map_id);
+        if(session_ptr == nullptr) {
+            auto map_ptr = game.FindMap(map_id);
+            if(map_ptr == nullptr) {
+                return nullptr;
+            }
+            game.AddSession(model::GameSession{map_ptr, game.GetRandomize(), game.GetLootGeneratorConfig()});
+            session_ptr = game.FindSession(map_id);
+        }
+        auto& dogs = session_ptr->GetDogs();
+        auto& loots = session_ptr->GetLoots();
+        // Сначала удаляем: освободившийся слот мог занять новый элемент
+        for(auto dog_index : removed_dogs_) {
+            dogs.erase(dog_index);
+        }
+        for(auto loot_index : removed_loots_) {
+            loots.erase(loot_index);
+        }
+        for(const auto& [dog_index, dog_repr] : dogs_reprs_) {
+            auto [it, is_inserted] = dogs.try_emplace(dog_index, dog_repr.Restore());
+            if(!is_inserted) {
+                it->second = dog_repr.Restore();
+            }
+        }
+        for(const auto& [loot_index, loot_repr] : loots_reprs_) {
+            auto [it, is_inserted] = loots.try_emplace(loot_index, loot_repr.Restore());
+            if(!is_inserted) {
+                it->second = loot_repr.Restore();
+            }
+        }
+        session_ptr->SetDogsIndex(dog_index_);
+        session_ptr->SetLootsIndex(loot_index_);
+        return session_ptr;
+    }
+
+    template <typename Archive>
+    void serialize(Archive& ar, [[maybe_unused]] const unsigned version) {
+        ar& map_id_;
+        ar& dogs_reprs_;
+        ar& removed_dogs_;
+        ar& loots_reprs_;
+        ar& removed_loots_;
+        ar& dog_index_;
+        ar& loot_index_;
+    }
+
+private:
+    std::string map_id_;
+    IndexToDogRepr dogs_reprs_;
+    std::vector<std::uint64_t> removed_dogs_;
+    IndexToLootRepr loots_reprs_;
+    std::vector<std::uint64_t> removed_loots_;
+    std::uint64_t dog_index_ = 0;
+    std::uint64_t loot_index_ = 0;
+};
+
 class SessionsRepr {
 public:
     SessionsRepr() = default;
@@ -5,6 +5,13 @@
 #include <pqxx/zview.hxx>
 #include "connection_pool.h"
 #include "model.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
 
 namespace postgres {
 
@@ -46,16 +53,25 @@ public:
         }
     }
 
-    void SetDogToDB(const model::Dog& dog) const {
+    // Записывает пакет игроков одним многострочным INSERT в одной транзакции
+    void SetRetiredPlayersToDB(const std::vector<PlayerRetireInfo>& players) const {
+        if(players.empty()) {
+            return;
+        }
         auto conn = conn_pool_.GetConnection();
         {
-            auto time_game = dog.GetInGameTime();
-            double seconds = static_cast<double>(time_game.count()) / 1000;
             pqxx::work work{*conn};
-            work.exec_params(R"(
-            INSERT INTO retired_players (name, score, playTime) 
-            VALUES ($1, $2, $3);
-            )"_zv, dog.GetName(), dog.GetScore(), seconds);
+            std::string query = "INSERT INTO retired_players (name, score, playTime) VALUES "s;
+            bool is_first = true;
+            for(const auto& player : players) {
+                if(!is_first) {
+                    query += ", "s;
+                }
+                is_first = false;
+                query += "("s + work.quote(player.name) + ", "s + work.quote(player.score) + ", "s + work.quote(player.playTime) + ")"s;
+            }
+            query += ";"s;
+            work.exec(query);
             work.commit();
         }
     }
@@ -82,4 +98,137 @@ private:
     mutable ConnectionPool conn_pool_;
 };
 
-}
\ No newline at end of file
+// Фоновая запись ушедших на покой игроков.
+// Игроки накапливаются в ограниченной очереди и записываются пакетами по MAX_BATCH_SIZE
+// или раз в FLUSH_INTERVAL, поэтому медленная БД не задерживает тики и запросы к API.
+// Push никогда не блокируется: когда очередь заполнена, игрок отбрасывается.
+// Пакет, который не удалось записать за MAX_BATCH_ATTEMPTS попыток, тоже отбрасывается.
+// Отброшенные игроки учитываются в Stats::dropped.
+// Деструктор дожидается записи всех принятых игроков
+class RetiredPlayersWriter {
+public:
+    static constexpr size_t DEFAULT_QUEUE_CAPACITY = 4096;
+    static constexpr size_t MAX_BATCH_SIZE = 256;
+    static constexpr std::chrono::milliseconds FLUSH_INTERVAL{100};
+    // Перед каждой следующей попыткой пауза удваивается: 100, 200, 400, 800 мс
+    static constexpr unsigned MAX_BATCH_ATTEMPTS = 5;
+
+    struct Stats {
+        // Принято в очередь
+        std::uint64_t enqueued = 0;
+        // Записано в БД
+        std::uint64_t written = 0;
+        std::uint64_t batches = 0;
+        // Неудачные попытки записи пакета
+        std::uint64_t failed_batches = 0;
+        // Не записано в БД: очередь была заполнена или пакет не удалось записать
+        std::uint64_t dropped = 0;
+        size_t queue_size = 0;
+        size_t max_queue_size = 0;
+    };
+
+    explicit RetiredPlayersWriter(const Database& db, size_t queue_capacity = DEFAULT_QUEUE_CAPACITY)
+        : db_(db)
+        , queue_capacity_(std::max<size_t>(queue_capacity, 1))
+        , worker_([this] { Run(); }) {
+    }
+
+    RetiredPlayersWriter(const RetiredPlayersWriter&) = delete;
+    RetiredPlayersWriter& operator=(const RetiredPlayersWriter&) = delete;
+
+    ~RetiredPlayersWriter() {
+        {
+            std::lock_guard lock{mutex_};
+            stop_ = true;
+        }
+        has_work_.notify_one();
+        worker_.join();
+    }
+
+    // Возвращает false, если очередь заполнена и игрок отброшен
+    bool Push(PlayerRetireInfo player) {
+        std::lock_guard lock{mutex_};
+        if(queue_.size() >= queue_capacity_) {
+            ++stats_.dropped;
+            return false;
+        }
+        queue_.push_back(std::move(player));
+        ++stats_.enqueued;
+        stats_.max_queue_size = std::max(stats_.max_queue_size, queue_.size());
+        if(queue_.size() >= MAX_BATCH_SIZE) {
+            has_work_.notify_one();
+        }
+        return true;
+    }
+
+    Stats GetStats() const {
+        std::lock_guard lock{mutex_};
+        auto stats = stats_;
+        stats.queue_size = queue_.size();
+        return stats;
+    }
+
+private:
+    void Run() {
+        std::vector<PlayerRetireInfo> batch;
+        unsigned failed_attempts = 0;
+        std::unique_lock lock{mutex_};
+        while(true) {
+            // После ошибки записи повтор выполняется с увеличивающейся паузой
+            const auto wait_time = failed_attempts == 0 ? FLUSH_INTERVAL : FLUSH_INTERVAL * (1 << (failed_attempts - 1));
+            has_work_.wait_for(lock, wait_time, [this, &batch] {
+                return stop_ || (batch.empty() && queue_.size() >= MAX_BATCH_SIZE);
+            });
+            // Пакет, не записанный из-за ошибки, отправляется повторно
+            if(batch.empty()) {
+                const auto batch_size = std::min(queue_.size(), MAX_BATCH_SIZE);
+                batch.assign(std::make_move_iterator(queue_.begin()),
+                             std::make_move_iterator(queue_.begin() + batch_size));
+                queue_.erase(queue_.begin(), queue_.begin() + batch_size);
+            }
+            if(batch.empty()) {
+                if(stop_) {
+                    return;
+                }
+                continue;
+            }
+            lock.unlock();
+            bool is_written = true;
+            try {
+                db_.SetRetiredPlayersToDB(batch);
+            } catch (const std::exception& e) {
+                std::cerr << "Failed to write retired players: "sv << e.what() << std::endl;
+                is_written = false;
+            }
+            lock.lock();
+            if(is_written) {
+                stats_.written += batch.size();
+                ++stats_.batches;
+                failed_attempts = 0;
+                batch.clear();
+                continue;
+            }
+            ++stats_.failed_batches;
+            // При завершении работы не ждём восстановления БД
+            if(++failed_attempts >= MAX_BATCH_ATTEMPTS || stop_) {
+                std::cerr << "Dropped "sv << batch.size() << " retired players after "sv
+                          << failed_attempts << " failed attempts"sv << std::endl;
+                stats_.dropped += batch.size();
+                failed_attempts = 0;
+                batch.clear();
+            }
+        }
+    }
+
+    const Database& db_;
+    const size_t queue_capacity_;
+    mutable std::mutex mutex_;
+    std::condition_variable has_work_;
+    std::deque<PlayerRetireInfo> queue_;
+    Stats stats_;
+    bool stop_ = false;
+    // Поток объявлен последним, чтобы запускаться после инициализации остальных полей
+    std::thread worker_;
+};
+
+}
@@ -1,4 +1,5 @@
 #include "request_handler.h"
+#include "game_state_hub.h"
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/json_parser.hpp>
 #include <vector>
@@ -12,66 +13,86 @@ namespace http_handler {
 
     using namespace std::literals;
 
-    Response MakeValidMapsResponse(http::verb method, http::status status, unsigned http_version, const model::Game::Maps& maps = {},
-                                const model::Map* map_ptr = nullptr, const boost::json::object& extra_data = {}) {
+    StringResponse MakeNotModifiedResponse(unsigned http_version, std::string_view etag) {
+        StringResponse response(http::status::not_modified, http_version);
+        response.set(http::field::etag, etag);
+        return response;
+    }
 
-        StringResponse response(status, http_version);
-        std::string json_string;
-        boost::json::object obj;
+    template <typename Fields>
+    RequestValidators GetRequestValidators(const Fields& fields) {
+        return {fields[http::field::if_none_match], fields[http::field::if_modified_since]};
+    }
 
-        response.set(http::field::content_type, ContentType::JSON);
-        if(map_ptr == nullptr) {
-            // формирование тела ответа на запрос списка карт
-            boost::json::array arr;
-            for(const auto& map : maps) {
-                obj["id"] = *(map.GetId());
-                obj["name"] = map.GetName();
-                arr.push_back(obj);
-            }
-            json_string = boost::json::serialize(arr);
-        } else {
-            // формирование тела ответа на запрос описания карты
-            std::string map_id = *(map_ptr->GetId());
-            obj["id"] = map_id;
-            obj["name"] = map_ptr->GetName();
-
-            boost::json::array roads_arr;
-            for(const auto& road : map_ptr->GetRoads()) { 
-                // Добавление данных о дорогах
-                if(road.IsHorizontal()){
-                    roads_arr.push_back({{"x0", road.GetStart().x}, {"y0", road.GetStart().y}, {"x1", road.GetEnd().x}});
-                } else {
-                    roads_arr.push_back({{"x0", road.GetStart().x}, {"y0", road.GetStart().y}, {"y1", road.GetEnd().y}});
-                }
-            }
-            obj["roads"] = roads_arr;
-
-            boost::json::array buildings_arr;
-            for(const auto& building : map_ptr->GetBuildings()) {
-                // Добавление данных о зданиях
-                auto bounds = building.GetBounds();
-                buildings_arr.push_back({{"x", bounds.position.x}, {"y", bounds.position.y}, 
-                                            {"w", bounds.size.width}, {"h", bounds.size.height}});
-            }
-            obj["buildings"] = buildings_arr;
-
-            boost::json::array offices_arr;
-            for(const auto& office : map_ptr->GetOffices()) {
-                // Добавление данных об офисах
-                offices_arr.push_back({{"id", *(office.GetId())}, {"x", office.GetPosition().x}, 
-                                        {"y", office.GetPosition().y}, {"offsetX", office.GetOffset().dx}, 
-                                        {"offsetY", office.GetOffset().dy}});
-            }
-            obj["offices"] = offices_arr;
-            obj["lootTypes"] = extra_data.at(map_id);
+    std::string MakeMapsListJson(const model::Game::Maps& maps) {
+        boost::json::array arr;
+        for(const auto& map : maps) {
+            arr.push_back({{"id", *(map.GetId())}, {"name", map.GetName()}});
+        }
+        return boost::json::serialize(arr);
+    }
 
-            json_string = boost::json::serialize(obj);
+    std::string MakeMapJson(const model::Map& map, const boost::json::object& extra_data) {
+        boost::json::object obj;
+        std::string map_id = *(map.GetId());
+        obj["id"] = map_id;
+        obj["name"] = map.GetName();
+
+        boost::json::array roads_arr;
+        for(const auto& road : map.GetRoads()) { 
+            // Добавление данных о дорогах
+            if(road.IsHorizontal()){
+                roads_arr.push_back({{"x0", road.GetStart().x}, {"y0", road.GetStart().y}, {"x1", road.GetEnd().x}});
+            } else {
+                roads_arr.push_back({{"x0", road.GetStart().x}, {"y0", road.GetStart().y}, {"y1", road.GetEnd().y}});
+            }
+        }
+        obj["roads"] = roads_arr;
+
+        boost::json::array buildings_arr;
+        for(const auto& building : map.GetBuildings()) {
+            // Добавление данных о зданиях
+            auto bounds = building.GetBounds();
+            buildings_arr.push_back({{"x", bounds.position.x}, {"y", bounds.position.y}, 
+                                        {"w", bounds.size.width}, {"h", bounds.size.height}});
+        }
+        obj["buildings"] = buildings_arr;
+
+        boost::json::array offices_arr;
+        for(const auto& office : map.GetOffices()) {
+            // Добавление данных об офисах
+            offices_arr.push_back({{"id", *(office.GetId())}, {"x", office.GetPosition().x}, 
+                                    {"y", office.GetPosition().y}, {"offsetX", office.GetOffset().dx}, 
+                                    {"offsetY", office.GetOffset().dy}});
         }
+        obj["offices"] = offices_arr;
+        obj["lootTypes"] = extra_data.at(map_id);
 
+        return boost::json::serialize(obj);
+    }
+
+    PrecomputedBody MakePrecomputedBody(std::string data) {
+        auto etag = MakeContentETag(data);
+        return {std::make_shared<const std::string>(std::move(data)), std::move(etag)};
+    }
+
+    Response MakeValidMapsResponse(http::verb method, unsigned http_version, std::string_view if_none_match,
+                                   const PrecomputedBody& body) {
+        // Описание карт не меняется, пока работает сервер, поэтому клиент может проверить
+        // свою копию по ETag и получить пустой ответ 304
+        if(IsETagMatched(if_none_match, body.etag)) {
+            auto not_modified = MakeNotModifiedResponse(http_version, body.etag);
+            not_modified.set(http::field::cache_control, "no-cache");
+            return not_modified;
+        }
+        SharedStringResponse response(http::status::ok, http_version);
+        response.set(http::field::content_type, ContentType::JSON);
+        response.set(http::field::etag, body.etag);
+        // Тело ответа ссылается на общий буфер без копирования
         if(method == http::verb::get) {
-            response.body() = json_string;
+            response.body() = body.data;
         }
-        response.content_length(json_string.size());
+        response.content_length(body.data->size());
         response.set(http::field::cache_control, "no-cache");
         return response;
     }
@@ -157,7 +178,9 @@ namespace http_handler {
         return ContentType::UNKNOWN;
     }
 
-    Response RequestHandler::MakeValidFileResponse(http::status status, unsigned http_version, const fs::path path) const {
+    Response RequestHandler::MakeValidFileResponse(http::status status, unsigned http_version, const fs::path path,
+                                                   std::string_view accept_encoding,
+                                                   const RequestValidators& validators) const {
 
         using namespace http;
         std::string_view content_type = GetContentType(std::string(path));
@@ -167,11 +190,46 @@ namespace http_handler {
         res.result(status);
         res.insert(field::content_type, content_type);
 
+        // Предварительно сжатый вариант отдаётся, если клиент его принимает
+        const bool has_gzip = HasEncodedSibling(path, ContentEncoding::GZIP);
+        const bool has_brotli = HasEncodedSibling(path, ContentEncoding::BROTLI);
+        const auto encoding = ChooseContentEncoding(accept_encoding, has_gzip, has_brotli);
+        auto file_path = path;
+        if(encoding != ContentEncoding::IDENTITY) {
+            file_path += GetEncodingExtension(encoding);
+            res.insert(field::content_encoding, GetEncodingName(encoding));
+        }
+        if(has_gzip || has_brotli) {
+            res.insert(field::vary, "Accept-Encoding"sv);
+        }
+
+        // Валидаторы совпадают с теми, что выдаёт кэш статических файлов
+        std::error_code ec;
+        const auto write_time = fs::last_write_time(path, ec);
+        const auto size = ec ? 0 : fs::file_size(path, ec);
+        if(!ec) {
+            const auto modification_time = std::chrono::file_clock::to_sys(write_time);
+            const auto etag = MakeEncodedETag(MakeFileETag(modification_time.time_since_epoch().count(), size), encoding);
+            const auto modified_time = std::chrono::system_clock::to_time_t(
+                std::chrono::time_point_cast<std::chrono::system_clock::duration>(modification_time));
+            const auto last_modified = FormatHttpDate(modified_time);
+            if(IsNotModified(validators, etag, modified_time)) {
+                auto not_modified = MakeNotModifiedResponse(http_version, etag);
+                not_modified.set(field::last_modified, last_modified);
+                if(has_gzip || has_brotli) {
+                    not_modified.set(field::vary, "Accept-Encoding"sv);
+                }
+                return not_modified;
+            }
+            res.insert(field::etag, etag);
+            res.insert(field::last_modified, last_modified);
+        }
+
         file_body::value_type file;
 
-        if (sys::error_code ec; file.open(path.string().c_str(), beast::file_mode::read, ec), ec) {
-            std::cout << "Failed to open file "sv << path << std::endl;
-            throw std::runtime_error("Ошибка открытия файла: " + std::string(path));
+        if (sys::error_code ec; file.open(file_path.string().c_str(), beast::file_mode::read, ec), ec) {
+            std::cout << "Failed to open file "sv << file_path << std::endl;
+            throw std::runtime_error("Ошибка открытия файла: " + std::string(file_path));
         }
 
         res.body() = std::move(file);
@@ -181,6 +239,38 @@ namespace http_handler {
         return res;
     }
 
+    Response MakeCachedFileResponse(const CachedFile& file, unsigned http_version, std::string_view accept_encoding,
+                                    const RequestValidators& validators) {
+        const auto encoding = ChooseContentEncoding(accept_encoding, file.gzip_data != nullptr, file.brotli_data != nullptr);
+        const auto& data = file.GetData(encoding);
+        const auto etag = file.GetETag(encoding);
+
+        if(IsNotModified(validators, etag, file.modified_time)) {
+            auto not_modified = MakeNotModifiedResponse(http_version, etag);
+            not_modified.set(http::field::last_modified, file.last_modified);
+            if(file.HasEncodings()) {
+                not_modified.set(http::field::vary, "Accept-Encoding"sv);
+            }
+            return not_modified;
+        }
+
+        SharedStringResponse response(http::status::ok, http_version);
+        response.set(http::field::content_type, file.content_type);
+        if(encoding != ContentEncoding::IDENTITY) {
+            response.set(http::field::content_encoding, GetEncodingName(encoding));
+        }
+        // Ответ зависит от Accept-Encoding, только если у файла есть сжатые варианты
+        if(file.HasEncodings()) {
+            response.set(http::field::vary, "Accept-Encoding"sv);
+        }
+        response.set(http::field::etag, etag);
+        response.set(http::field::last_modified, file.last_modified);
+        // Тело ответа ссылается на содержимое файла в кэше
+        response.body() = data;
+        response.content_length(data->size());
+        return response;
+    }
+
     Response RequestHandler::MakeInValidFileResponse(http::status status, unsigned http_version,
                                     std::string_view content_type = ContentType::TEXT_PLAIN) const {
         StringResponse response(status, http_version);
@@ -243,7 +333,7 @@ namespace http_handler {
     }
 
     Response MakeValidPlayerListResponse(http::verb method, http::status status, unsigned http_version, 
-                                         const std::vector<app::Player*>& session_players) {
+                                         const std::vector<app::Player>& session_players) {
         StringResponse response(status, http_version);
         std::string json_string;
         boost::json::object obj;
@@ -256,8 +346,8 @@ namespace http_handler {
         // }
         for(const auto& player : session_players) {
             boost::json::object internal_obj;
-            internal_obj["name"] = player->GetName();
-            obj[std::to_string(*(player->GetPlayerId()))] = internal_obj;
+            internal_obj["name"] = player.GetName();
+            obj[std::to_string(*(player.GetPlayerId()))] = internal_obj;
         }
 
         json_string = boost::json::serialize(obj);
@@ -301,14 +391,54 @@ namespace http_handler {
         return std::round(value * 10.0) / 10.0;
     }
 
-    Response MakeValidGetGameStateResponse(http::verb method, http::status status, unsigned http_version, const model::GameSession* session_ptr) {
-        StringResponse response(status, http_version);
-        std::string json_string;
-        boost::json::object obj;
+    boost::json::object MakeDogStateJson(const model::Dog& dog) {
+        boost::json::object internal_obj;
+        boost::json::array coords_arr;
+        coords_arr.push_back((dog.GetCoords().x));
+        coords_arr.push_back((dog.GetCoords().y));
+        internal_obj["pos"] = coords_arr;
+        boost::json::array speed_arr;
+        speed_arr.push_back((dog.GetSpeed().h_s));
+        speed_arr.push_back((dog.GetSpeed().v_s));
+        internal_obj["speed"] = speed_arr;
+        const auto& dir = dog.GetDirection();
+        if(dir == model::Dog::Direction::EAST){
+            internal_obj["dir"] = "R";
+        } else if (dir == model::Dog::Direction::NORTH) {
+            internal_obj["dir"] = "U";
+        } else if (dir == model::Dog::Direction::SOUTH) {
+            internal_obj["dir"] = "D";
+        } else if (dir == model::Dog::Direction::WEST) {
+            internal_obj["dir"] = "L";
+        }
+        boost::json::array loots_arr;
+        const auto& loots = dog.GetBag();
+        for(const auto& loot_items : loots) {
+            boost::json::object loot_info;
+            loot_info["id"] = loot_items.first;
+            loot_info["type"] = loot_items.second;
+            loots_arr.push_back(loot_info);
+        }
+        internal_obj["bag"] = loots_arr;
+        internal_obj["score"] = dog.GetScore();
+        return internal_obj;
+    }
 
-        response.set(http::field::content_type, ContentType::JSON);
+    boost::json::object MakeLootStateJson(const model::Loot& loot) {
+        boost::json::object internal_obj;
+        boost::json::array coords_arr;
+        internal_obj["type"] = loot.GetLootType();
+        coords_arr.push_back((loot.GetCoords().x));
+        coords_arr.push_back((loot.GetCoords().y));
+        internal_obj["pos"] = coords_arr;
+        return internal_obj;
+    }
+
+    // Полное состояние сессии: все псы и все потерянные предметы
+    boost::json::object MakeGameStateJson(const model::GameSession* session_ptr) {
+        boost::json::object obj;
         boost::json::object players;
-        const auto dogs = session_ptr->GetDogs();
+        const auto& dogs = session_ptr->GetDogs();
         // for(auto i = 0U; i < dogs.size(); i++) {
         //     boost::json::object internal_obj;
         //     boost::json::array coords_arr;
@@ -341,57 +471,100 @@ namespace http_handler {
         //     internal_obj["score"] = dogs.at(i).GetScore();
         //     players[std::to_string(i)] = internal_obj;
         // }
-        int i = 0;
         for(const auto& dog : dogs) {
-            boost::json::object internal_obj;
-            boost::json::array coords_arr;
-            coords_arr.push_back((dog.second.GetCoords().x));
-            coords_arr.push_back((dog.second.GetCoords().y));
-            internal_obj["pos"] = coords_arr;
-            boost::json::array speed_arr;
-            speed_arr.push_back((dog.second.GetSpeed().h_s));
-            speed_arr.push_back((dog.second.GetSpeed().v_s));
-            internal_obj["speed"] = speed_arr;
-            const auto& dir = dog.second.GetDirection();
-            if(dir == model::Dog::Direction::EAST){
-                internal_obj["dir"] = "R";
-            } else if (dir == model::Dog::Direction::NORTH) {
-                internal_obj["dir"] = "U";
-            } else if (dir == model::Dog::Direction::SOUTH) {
-                internal_obj["dir"] = "D";
-            } else if (dir == model::Dog::Direction::WEST) {
-                internal_obj["dir"] = "L";
-            }
-            boost::json::array loots_arr;
-            const auto& loots = dog.second.GetBag();
-            for(const auto& loot_items : loots) {
-                boost::json::object loot_info;
-                loot_info["id"] = loot_items.first;
-                loot_info["type"] = loot_items.second;
-                loots_arr.push_back(loot_info);
-            }
-            internal_obj["bag"] = loots_arr;
-            internal_obj["score"] = dog.second.GetScore();
-            players[std::to_string(dog.first)] = internal_obj;
-            i++;
+            players[std::to_string(dog.first)] = MakeDogStateJson(dog.second);
         }
         obj["players"] = players;
 
         boost::json::object loots_obj;
-        const auto loots = session_ptr->GetLoots();
-        //for(auto i = 0U; i < loots.size(); i++) { 
+        const auto& loots = session_ptr->GetLoots();
         for(const auto& loot_item : loots) {
-            boost::json::object internal_obj;
-            boost::json::array coords_arr;
-            //auto loot = loots.at(i);
-            internal_obj["type"] = loot_item.second.GetLootType();
-            coords_arr.push_back((loot_item.second.GetCoords().x));
-            coords_arr.push_back((loot_item.second.GetCoords().y));
-            internal_obj["pos"] = coords_arr;
-            //loots_obj[std::to_string(i)] = internal_obj;
-            loots_obj[std::to_string(loot_item.first)] = internal_obj;
+            loots_obj[std::to_string(loot_item.first)] = MakeLootStateJson(loot_item.second);
+        }
+        obj["lostObjects"] = loots_obj;
+        return obj;
+    }
+
+    Response MakeValidGetGameStateResponse(http::verb method, http::status status, unsigned http_version, const model::GameSession* session_ptr,
+                                           std::optional<std::uint64_t> tick = std::nullopt) {
+        StringResponse response(status, http_version);
+        std::string json_string;
+        boost::json::object obj = MakeGameStateJson(session_ptr);
+
+        response.set(http::field::content_type, ContentType::JSON);
+        if(tick) {
+            // Клиент запросил изменения, но история их уже не содержит: отдаём полный снимок
+            obj["tick"] = *tick;
+            obj["full"] = true;
+        }
+
+        json_string = boost::json::serialize(obj);
+        if(method == http::verb::get) {
+            response.body() = json_string;
+        }
+        response.content_length(json_string.size());
+        response.set(http::field::cache_control, "no-cache");
+
+        return response;
+    }
+
+    Response MakeSharedGetGameStateResponse(http::verb method, http::status status, unsigned http_version,
+                                            const std::shared_ptr<const std::string>& json_string) {
+        SharedStringResponse response(status, http_version);
+
+        response.set(http::field::content_type, ContentType::JSON);
+        // Тело ответа ссылается на общий буфер без копирования
+        if(method == http::verb::get) {
+            response.body() = json_string;
+        }
+        response.content_length(json_string->size());
+        response.set(http::field::cache_control, "no-cache");
+
+        return response;
+    }
+
+    // Изменения состояния сессии после тика, к которому относится changes
+    boost::json::object MakeGameStateDeltaJson(const model::GameSession* session_ptr, const model::SessionChanges& changes) {
+        boost::json::object obj;
+        obj["tick"] = session_ptr->GetTick();
+        // Изменившиеся и новые псы и трофеи
+        boost::json::object players;
+        const auto& dogs = session_ptr->GetDogs();
+        for(auto dog_index : changes.changed_dogs) {
+            if(auto it = dogs.find(dog_index); it != dogs.end()) {
+                players[std::to_string(dog_index)] = MakeDogStateJson(it->second);
+            }
+        }
+        obj["players"] = players;
+        boost::json::object loots_obj;
+        const auto& loots = session_ptr->GetLoots();
+        for(auto loot_index : changes.changed_loots) {
+            if(auto it = loots.find(loot_index); it != loots.end()) {
+                loots_obj[std::to_string(loot_index)] = MakeLootStateJson(it->second);
+            }
         }
         obj["lostObjects"] = loots_obj;
+        // Удалённые псы и трофеи
+        boost::json::array removed_players;
+        for(auto dog_index : changes.removed_dogs) {
+            removed_players.push_back(dog_index);
+        }
+        obj["removedPlayers"] = removed_players;
+        boost::json::array removed_loots;
+        for(auto loot_index : changes.removed_loots) {
+            removed_loots.push_back(loot_index);
+        }
+        obj["removedLostObjects"] = removed_loots;
+        return obj;
+    }
+
+    Response MakeDeltaGetGameStateResponse(http::verb method, http::status status, unsigned http_version,
+                                           const model::GameSession* session_ptr, const model::SessionChanges& changes) {
+        StringResponse response(status, http_version);
+        std::string json_string;
+        boost::json::object obj = MakeGameStateDeltaJson(session_ptr, changes);
+
+        response.set(http::field::content_type, ContentType::JSON);
 
         json_string = boost::json::serialize(obj);
         if(method == http::verb::get) {
@@ -417,6 +590,9 @@ namespace http_handler {
                 obj["code"] = "unknownToken";
                 obj["message"] = "Player token has not been found";
             }
+        } else if (status == http::status::bad_request) {
+            obj["code"] = "invalidArgument";
+            obj["message"] = "Invalid since parameter";
         } else if (status == http::status::method_not_allowed) {
             response.set(http::field::allow, "GET, HEAD");
             obj["code"] = "invalidMethod";
@@ -556,18 +732,6 @@ namespace http_handler {
         return response;
     }
 
-    std::vector<std::string> split(std::string &str, char delim) {
-        size_t start;
-        size_t end = 0;
-        std::vector<std::string> out;
-    
-        while ((start = str.find_first_not_of(delim, end)) != std::string::npos) {
-            end = str.find(delim, start);
-            out.push_back(str.substr(start, end - start));
-        }
-        return out;
-    }
-
     bool is_hex_digit(char c) {
         return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f');
     }
@@ -626,6 +790,62 @@ namespace http_handler {
         return true;
     }
 
+    std::optional<std::vector<std::pair<std::string, std::string>>> ExtractUrlParams(const std::string& url) {
+        std::vector<std::pair<std::string, std::string>> params;
+        // Поиск начала параметров 
+        size_t start = url.find("?");
+        if (start == std::string::npos) {
+            return std::nullopt; // Если параметров нет, возвращаем пустой вектор
+        }
+        // Извлечение части строки с параметрами
+        std::string query = url.substr(start + 1);
+
+        // Разделение параметров по разделителю '&'
+        for (auto it = query.begin(); it != query.end(); ) {
+            // Ищем следующий разделитель или конец строки
+            auto end = std::find(it, query.end(), '&');
+
+            // Извлекаем параметр
+            std::string param = std::string(it, end);
+            it = end;
+            if (it != query.end()) {
+                ++it; // Переходим к следующему символу
+            }
+
+            // Разделение параметра на ключ и значение
+            size_t eqPos = param.find('=');
+            if (eqPos != std::string::npos) {
+                std::string key = param.substr(0, eqPos);
+                std::string value = param.substr(eqPos + 1);
+                params.push_back(std::make_pair(key, value));
+            } else {
+                return std::nullopt;
+            }
+        }
+        return params;
+    }
+
+    std::optional<std::uint64_t> ParseSinceParam(const std::string& url) {
+        auto params = ExtractUrlParams(url);
+        if(!params) {
+            return std::nullopt;
+        }
+        for(const auto& [key, value] : *params) {
+            if(key != "since"s) {
+                continue;
+            }
+            if(value.empty() || !std::all_of(value.begin(), value.end(), [](unsigned char c) { return std::isdigit(c); })) {
+                return std::nullopt;
+            }
+            try {
+                return std::stoull(value);
+            } catch (const std::out_of_range&) {
+                return std::nullopt;
+            }
+        }
+        return std::nullopt;
+    }
+
     Response ApiHandler::Join(const StringRequest& req) const {
         if(req.method() == http::verb::post) {
             std::string body = req.body();
@@ -681,8 +901,23 @@ namespace http_handler {
             if (req.find(http::field::authorization) != req.end()) {   
                 try{
                     //const auto dogs = app_.GetGameStateUseCase(req.at(http::field::authorization));
-                    const auto session_ptr = app_.GetGameStateUseCase(req.at(http::field::authorization));
-                    return MakeValidGetGameStateResponse(req_method, http::status::ok, req.version(), session_ptr);
+                    // Сессия не изменяется, пока формируется ответ
+                    const auto session_view = app_.GetGameStateUseCase(req.at(http::field::authorization));
+                    const auto session_ptr = session_view.session;
+                    std::string trg =  static_cast<std::string>(req.target());
+                    if(trg.find('?') == std::string::npos) {
+                        return MakeSharedGetGameStateResponse(req_method, http::status::ok, req.version(),
+                                                              GetSerializedGameState(session_ptr));
+                    }
+                    // Параметр since - номер тика, после которого клиенту нужны изменения
+                    auto since = ParseSinceParam(DecodeURI(trg));
+                    if(!since) {
+                        return MakeInValidGetGameStateResponse(http::status::bad_request, req.version());
+                    }
+                    if(auto changes = session_ptr->GetChangesSince(*since)) {
+                        return MakeDeltaGetGameStateResponse(req_method, http::status::ok, req.version(), session_ptr, *changes);
+                    }
+                    return MakeValidGetGameStateResponse(req_method, http::status::ok, req.version(), session_ptr, session_ptr->GetTick());
                 } catch (const app::GetGameStateError& ec) {
                     auto reason = ec.What();
                     if(reason == app::GetGameStateError::GetGameStateErrorReason::INVALID_AUTH_FIELD) {
@@ -697,6 +932,28 @@ namespace http_handler {
         return MakeInValidGetGameStateResponse(http::status::method_not_allowed, req.version());
     }
     
+    std::shared_ptr<const std::string> ApiHandler::GetSerializedGameState(const model::GameSession* session_ptr) const {
+        const auto state_version = session_ptr->GetStateVersion();
+        {
+            std::lock_guard lock{game_state_cache_mutex_};
+            const auto& cached_state = game_state_cache_[session_ptr->GetIDMap()];
+            if(cached_state.json && cached_state.state_version == state_version) {
+                return cached_state.json;
+            }
+        }
+        // Состояние изменилось с прошлой сериализации: формируем новый буфер вне блокировки кэша,
+        // чтобы не задерживать запросы к другим сессиям. Ответы, которые ещё отправляют старый буфер,
+        // продолжают владеть им
+        auto json = std::make_shared<const std::string>(boost::json::serialize(MakeGameStateJson(session_ptr)));
+        std::lock_guard lock{game_state_cache_mutex_};
+        auto& cached_state = game_state_cache_[session_ptr->GetIDMap()];
+        if(cached_state.state_version <= state_version) {
+            cached_state.json = json;
+            cached_state.state_version = state_version;
+        }
+        return json;
+    }
+
     Response ApiHandler::MovePlayers(const StringRequest& req) const {
         auto req_method = req.method();
         if(req_method != http::verb::post) {
@@ -766,64 +1023,24 @@ namespace http_handler {
         return MakeInValidMovePlayerResponse(http::status::bad_request, req.version(), true);  
     }
 
-    Response ApiHandler::GetMapsInfo(const StringRequest& req) const {
-        std::string trg =  static_cast<std::string>(req.target());
+    Response ApiHandler::GetMapsInfo(const StringRequest& req, std::string_view map_id) const {
         if(req.method() == http::verb::get || req.method() == http::verb::head) {
             // Сцерий вывода информации о игровых картах
-            std::vector<std::string> targets_items = split(trg, '/');
-            if(trg == "/api/v1/maps"s) {
+            if(map_id.empty()) {
                 // Возвращаем список карт
-                const auto& maps = app_.ListMapsUseCase();
-                return MakeValidMapsResponse(req.method(), http::status::ok, req.version(), maps);
-            } else if ((trg.find("/api/v1/maps"s) != std::string::npos) && targets_items.size() == 4) {
-                // Возвращаем информацию по карте
-                auto map_ptr = app_.GetMapUseCase(targets_items.at(3));
-                if(map_ptr != nullptr) {
-                    return MakeValidMapsResponse(req.method(), http::status::ok, req.version(), {}, map_ptr, app_.GetExtraData().GetData());
-                }
-                return MakeInValidMapsResponse(http::status::not_found, req.version());
+                return MakeValidMapsResponse(req.method(), req.version(), req[http::field::if_none_match], maps_list_body_);
             }
-            return MakeInValidMapsResponse(http::status::bad_request, req.version());
+            // Возвращаем информацию по карте
+            const auto map_body = map_bodies_.find(model::Map::Id{std::string(map_id)});
+            if(map_body != map_bodies_.end()) {
+                return MakeValidMapsResponse(req.method(), req.version(), req[http::field::if_none_match], map_body->second);
+            }
+            return MakeInValidMapsResponse(http::status::not_found, req.version());
         }
         //return MakeInvalidStringResponse(http::status::method_not_allowed, req.version());
         return MakeInValidMapsResponse(http::status::method_not_allowed, req.version());
     }
 
-    std::optional<std::vector<std::pair<std::string, std::string>>> ExtractUrlParams(const std::string& url) {
-        std::vector<std::pair<std::string, std::string>> params;
-        // Поиск начала параметров 
-        size_t start = url.find("?");
-        if (start == std::string::npos) {
-            return std::nullopt; // Если параметров нет, возвращаем пустой вектор
-        }
-        // Извлечение части строки с параметрами
-        std::string query = url.substr(start + 1);
-
-        // Разделение параметров по разделителю '&'
-        for (auto it = query.begin(); it != query.end(); ) {
-            // Ищем следующий разделитель или конец строки
-            auto end = std::find(it, query.end(), '&');
-
-            // Извлекаем параметр
-            std::string param = std::string(it, end);
-            it = end;
-            if (it != query.end()) {
-                ++it; // Переходим к следующему символу
-            }
-
-            // Разделение параметра на ключ и значение
-            size_t eqPos = param.find('=');
-            if (eqPos != std::string::npos) {
-                std::string key = param.substr(0, eqPos);
-                std::string value = param.substr(eqPos + 1);
-                params.push_back(std::make_pair(key, value));
-            } else {
-                return std::nullopt;
-            }
-        }
-        return params;
-    }
-
     Response ApiHandler::ListRetirePlayers(const StringRequest& req) const {
         std::string trg =  static_cast<std::string>(req.target());
         if(req.method() == http::verb::get) {
@@ -841,36 +1058,123 @@ namespace http_handler {
         return MakeInValidListRetirePlayersResponse(http::status::method_not_allowed, req.version());
     }
 
+    namespace {
+
+    // Ответ 405 в формате, принятом у конечной точки
+    Response MakeApiMethodNotAllowedResponse(ApiEndpoint endpoint, unsigned http_version) {
+        constexpr auto status = http::status::method_not_allowed;
+        switch(endpoint) {
+            case ApiEndpoint::JOIN:
+                return MakeInValidJoinResponse(status, http_version);
+            case ApiEndpoint::PLAYERS:
+                return MakeInValidPlayerListResponse(status, http_version);
+            case ApiEndpoint::GAME_STATE:
+                return MakeInValidGetGameStateResponse(status, http_version);
+            case ApiEndpoint::PLAYER_ACTION:
+                return MakeInValidMovePlayerResponse(status, http_version);
+            case ApiEndpoint::TICK:
+                return MakeInValidTimeControlResponse(status, http_version);
+            case ApiEndpoint::MAPS:
+            case ApiEndpoint::MAP:
+                return MakeInValidMapsResponse(status, http_version);
+            case ApiEndpoint::RECORDS:
+                return MakeInValidListRetirePlayersResponse(status, http_version);
+        }
+        return MakeInvalidInputPointResponse(http::status::bad_request, http_version);
+    }
+
+    }  // namespace
+
+    ApiHandler::ApiHandler(app::Application& app)
+        : app_(app)
+        , maps_list_body_(MakePrecomputedBody(MakeMapsListJson(app.ListMapsUseCase()))) {
+        for(const auto& map : app.ListMapsUseCase()) {
+            map_bodies_.emplace(map.GetId(), MakePrecomputedBody(MakeMapJson(map, app.GetExtraData().GetData())));
+        }
+    }
+
+    ApiExecution ApiHandler::GetApiExecution(std::string_view target, http::verb method) {
+        const auto match = API_ROUTES.Find(target, method);
+        // Ответы об ошибках маршрутизации не обращаются к состоянию игры
+        if(match.route == nullptr || !match.is_method_allowed) {
+            return ApiExecution::ANY_THREAD;
+        }
+        return match.route->execution;
+    }
+
+    const app::SessionStrand* ApiHandler::FindSessionStrand(const StringRequest& req) const {
+        const auto authorization = req.find(http::field::authorization);
+        if(authorization == req.end()) {
+            return nullptr;
+        }
+        const auto map_id = app_.FindPlayerMapUseCase(authorization->value());
+        return map_id ? app_.FindSessionStrand(*map_id) : nullptr;
+    }
+
     Response ApiHandler::HandleApiRequest(const StringRequest& req) const {
-        std::string trg =  static_cast<std::string>(req.target());
-        if(trg == "/api/v1/game/join"s) {
-            return Join(req);
-        } else if(trg == "/api/v1/game/players"s) {
-            return ListPlayers(req);
-        } else if(trg == "/api/v1/game/state"s) {
-            return GetGameState(req);  
-        } else if(trg == "/api/v1/game/player/action"s) {
-            return MovePlayers(req);
-        } else if (trg == "/api/v1/game/tick"s) {
-            return TickTime(req);
-        } else if (trg.find("/api/v1/maps") != std::string::npos) {
-            return GetMapsInfo(req);
-        } else if (trg.find("/api/v1/game/records"s) != std::string::npos) {
-            return ListRetirePlayers(req);
+        const auto match = API_ROUTES.Find(req.target(), req.method());
+        if(match.route == nullptr) {
+            return MakeInvalidInputPointResponse(http::status::bad_request, req.version());
+        }
+        if(!match.is_method_allowed) {
+            return MakeApiMethodNotAllowedResponse(match.route->endpoint, req.version());
+        }
+        switch(match.route->endpoint) {
+            case ApiEndpoint::JOIN:
+                return Join(req);
+            case ApiEndpoint::PLAYERS:
+                return ListPlayers(req);
+            case ApiEndpoint::GAME_STATE:
+                return GetGameState(req);
+            case ApiEndpoint::PLAYER_ACTION:
+                return MovePlayers(req);
+            case ApiEndpoint::TICK:
+                return TickTime(req);
+            case ApiEndpoint::MAPS:
+                return GetMapsInfo(req, {});
+            case ApiEndpoint::MAP:
+                return GetMapsInfo(req, match.params[0]);
+            case ApiEndpoint::RECORDS:
+                return ListRetirePlayers(req);
         }
         return MakeInvalidInputPointResponse(http::status::bad_request, req.version());
     }
 
+    void RequestHandler::EnableStaticCache(std::size_t capacity, bool watch_changes) {
+        static_cache_ = std::make_unique<StaticFileCache>(capacity);
+        if(watch_changes) {
+            static_cache_->WatchDirectory(root_dir_path_);
+        }
+    }
+
+    void RequestHandler::HandleUpgrade(net::ip::tcp::socket&& socket, StringRequest&& req) {
+        if(state_hub_ == nullptr) {
+            beast::error_code ec;
+            socket.shutdown(net::ip::tcp::socket::shutdown_both, ec);
+            return;
+        }
+        state_hub_->Accept(std::move(socket), std::move(req));
+    }
+
     Response RequestHandler::HandleFileRequest(const StringRequest& req) const {
-        const auto file_response = [&req, this](http::status status, const fs::path path = ""s) {
+        const auto accept_encoding = req[http::field::accept_encoding];
+        const auto validators = GetRequestValidators(req);
+        const auto file_response = [&req, accept_encoding, &validators, this](http::status status, const fs::path path = ""s) {
             if(status == http::status::ok) {
-                return MakeValidFileResponse(status, req.version(), path);
+                return MakeValidFileResponse(status, req.version(), path, accept_encoding, validators);
             }
             return MakeInValidFileResponse(status, req.version());
         };
         std::string trg =  static_cast<std::string>(req.target());
         if(req.method() == http::verb::get ) {
-            fs::path decoded_target = DecodeURI(trg).substr(1);
+            const std::string decoded_uri = DecodeURI(trg);
+            // Файл из кэша отдаётся без обращений к файловой системе
+            if(static_cache_) {
+                if(auto cached_file = static_cache_->Find(decoded_uri)) {
+                    return MakeCachedFileResponse(*cached_file, req.version(), accept_encoding, validators);
+                }
+            }
+            fs::path decoded_target = decoded_uri.substr(1);
             if(decoded_target != ""s) {                
                 decoded_target = fs::weakly_canonical(root_dir_path_/decoded_target);
             } else {
@@ -881,6 +1185,12 @@ namespace http_handler {
                     decoded_target += "/index.html"s;
                 }
                 if (fs::exists(decoded_target)) {
+                    if(static_cache_) {
+                        if(auto cached_file = static_cache_->Load(decoded_uri, decoded_target, GetContentType(decoded_target))) {
+                            return MakeCachedFileResponse(*cached_file, req.version(), accept_encoding, validators);
+                        }
+                    }
+                    // Файл слишком велик для кэша или кэш выключен
                     return file_response(http::status::ok, decoded_target);
                 } else {
                     return file_response(http::status::not_found);
@@ -10,8 +10,14 @@
 #include  <boost/json.hpp>
 #include  <filesystem>
 #include "model.h"
+#include "shared_body.h"
 #include "app.h"
+#include "static_cache.h"
+#include "api_routes.h"
 #include  <variant>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <iostream>
 
 namespace http_handler {
@@ -27,7 +33,9 @@ using StringRequest = http::request<http::string_body>;
 // Ответ, тело которого представлено в виде строки
 using StringResponse = http::response<http::string_body>;
 using FileResponse = http::response<http::file_body>;
-using Response = std::variant<StringResponse, FileResponse>;
+// Ответ, тело которого разделяется между несколькими ответами без копирования
+using SharedStringResponse = http::response<http_body::SharedStringBody>;
+using Response = std::variant<StringResponse, FileResponse, SharedStringResponse>;
 
 struct ContentType {
 ContentType() = delete;
@@ -50,22 +58,58 @@ ContentType() = delete;
     // При необходимости внутрь ContentType можно добавить и другие типы контента
 };
 
+// JSON полного состояния игровой сессии и её изменений, общий для HTTP API и WebSocket-канала
+boost::json::object MakeGameStateJson(const model::GameSession* session_ptr);
+boost::json::object MakeGameStateDeltaJson(const model::GameSession* session_ptr, const model::SessionChanges& changes);
+// Разбирает параметры запроса вида ?key1=value1&key2=value2
+std::optional<std::vector<std::pair<std::string, std::string>>> ExtractUrlParams(const std::string& url);
+
+class GameStateHub;
+
+// Тело ответа, сформированное заранее. Буфер разделяется всеми ответами, а его ETag
+// и размер не вычисляются заново для каждого запроса
+struct PrecomputedBody {
+    std::shared_ptr<const std::string> data;
+    std::string etag;
+};
+
 class ApiHandler {
 public:
-    ApiHandler(app::Application& app) : 
-               app_(app) {}
+    // Описания карт неизменны после загрузки игры, поэтому их JSON формируется один раз
+    explicit ApiHandler(app::Application& app);
 
+    static ApiExecution GetApiExecution(std::string_view target, http::verb method);
+    // Находит по токену игрока strand его сессии. nullptr, если игрок не найден:
+    // ответ об ошибке авторизации не требует strand
+    const app::SessionStrand* FindSessionStrand(const StringRequest& req) const;
     Response HandleApiRequest(const StringRequest& request) const;
 
 private:
+    // Сериализованное состояние сессии и версия состояния, для которой оно получено
+    struct CachedGameState {
+        std::uint64_t state_version = 0;
+        std::shared_ptr<const std::string> json;
+    };
+    using MapIdHasher = util::TaggedHasher<model::Map::Id>;
+
+    // Возвращает JSON состояния сессии. Сессия сериализуется заново, только если
+    // её состояние изменилось, иначе все запросы получают один и тот же буфер
+    std::shared_ptr<const std::string> GetSerializedGameState(const model::GameSession* session_ptr) const;
+
     app::Application& app_;
+    PrecomputedBody maps_list_body_;
+    std::unordered_map<model::Map::Id, PrecomputedBody, MapIdHasher> map_bodies_;
+    // Запросы состояния выполняются параллельно, поэтому кэш защищён мьютексом
+    mutable std::mutex game_state_cache_mutex_;
+    mutable std::unordered_map<model::Map::Id, CachedGameState, MapIdHasher> game_state_cache_;
 
     Response Join(const StringRequest& req) const;
     Response ListPlayers(const StringRequest& req) const;
     Response GetGameState(const StringRequest& req) const;
     Response MovePlayers(const StringRequest& req) const;
     Response TickTime(const StringRequest& req) const;
-    Response GetMapsInfo(const StringRequest& req) const;
+    // Пустой map_id - запрос списка карт
+    Response GetMapsInfo(const StringRequest& req, std::string_view map_id) const;
     Response ListRetirePlayers(const StringRequest& req) const;
 };
 
@@ -92,23 +136,37 @@ public:
     RequestHandler(const RequestHandler&) = delete;
     RequestHandler& operator=(const RequestHandler&) = delete;
 
+    // Включает приём WebSocket-подключений, через которые клиенты получают состояние игры
+    void SetGameStateHub(std::shared_ptr<GameStateHub> state_hub) {
+        state_hub_ = std::move(state_hub);
+    }
+
+    // Включает кэширование статических файлов в памяти. При watch_changes кэш очищается,
+    // когда файлы в корневом каталоге меняются
+    void EnableStaticCache(std::size_t capacity, bool watch_changes);
+
+    // Запрос на установку WebSocket-соединения. Сокет переходит под управление GameStateHub
+    void HandleUpgrade(net::ip::tcp::socket&& socket, StringRequest&& req);
+
     template <typename Body, typename Allocator, typename Send>
     void operator()(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send) {
-        std::string trg =  static_cast<std::string>(req.target());
         try {
-            if (trg.find("/api/") != std::string::npos) {
-                auto handle = [self = shared_from_this(), this, send,
-                                req = std::forward<decltype(req)>(req)] {
-                    try {
-                        // Этот assert не выстрелит, так как лямбда-функция будет выполняться внутри strand
-                        assert(self->api_strand_.running_in_this_thread());
-                        auto res = api_handler_.HandleApiRequest(req);
-                        return send(res);
-                    } catch (...) {
-                        //send(self->ReportServerError());
-                    }
-                };
-                return net::dispatch(api_strand_, handle);
+            if (req.target().starts_with("/api/")) {
+                switch (ApiHandler::GetApiExecution(req.target(), req.method())) {
+                    case ApiExecution::API_STRAND:
+                        return DispatchApiRequest(api_strand_, std::move(req), std::forward<Send>(send));
+                    case ApiExecution::SESSION_STRAND:
+                        // Команды игроков разных карт не ждут друг друга
+                        if (const auto strand = api_handler_.FindSessionStrand(req)) {
+                            return DispatchApiRequest(*strand, std::move(req), std::forward<Send>(send));
+                        }
+                        break;
+                    case ApiExecution::ANY_THREAD:
+                    case ApiExecution::SHARED_READ:
+                        break;
+                }
+                auto res = api_handler_.HandleApiRequest(req);
+                return send(res);
             }
             auto res = HandleFileRequest(req);
             send(std::forward<decltype(res)>(res));
@@ -118,15 +176,34 @@ public:
     }
 
 private:
+    template <typename Request, typename Send>
+    void DispatchApiRequest(const Strand& strand, Request&& req, Send&& send) {
+        auto handle = [self = shared_from_this(), this, strand, send = std::forward<Send>(send),
+                        req = std::forward<Request>(req)] {
+            try {
+                // Этот assert не выстрелит, так как лямбда-функция будет выполняться внутри strand
+                assert(strand.running_in_this_thread());
+                auto res = api_handler_.HandleApiRequest(req);
+                return send(res);
+            } catch (...) {
+                //send(self->ReportServerError());
+            }
+        };
+        net::dispatch(strand, handle);
+    }
+
     Response HandleFileRequest(const StringRequest& req) const;
     Response MakeValidFileResponse(http::status status, unsigned http_version, 
-                                    const fs::path path) const;
+                                    const fs::path path, std::string_view accept_encoding,
+                                    const RequestValidators& validators) const;
     Response MakeInValidFileResponse(http::status status, unsigned http_version,
                                     std::string_view content_type) const;
 
     Strand api_strand_;
     ApiHandler api_handler_;
     fs::path root_dir_path_;
+    std::shared_ptr<GameStateHub> state_hub_;
+    std::unique_ptr<StaticFileCache> static_cache_;
 };
 
 }  // namespace http_handler
@@ -0,0 +1,193 @@
+#pragma once
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace util {
+
+/**
+ * Слот-карта: контейнер с устойчивыми 64-битными идентификаторами и плотным хранением элементов.
+ * Старшие 32 бита идентификатора - поколение слота, младшие - номер слота.
+ * Элементы лежат подряд в векторе, поэтому обход контейнера не прыгает по памяти,
+ * а поиск, вставка и удаление выполняются за O(1).
+ * При удалении на место удалённого элемента переносится последний, так что порядок обхода
+ * совпадает с порядком вставки только до первого удаления.
+ * Поколение освободившегося слота увеличивается, поэтому идентификатор удалённого элемента
+ * не совпадёт с идентификатором элемента, который займёт этот слот позже.
+ */
+template <typename T>
+class SlotMap {
+public:
+    using Id = std::uint64_t;
+    using value_type = std::pair<Id, T>;
+    using iterator = typename std::vector<value_type>::iterator;
+    using const_iterator = typename std::vector<value_type>::const_iterator;
+
+    // Добавляет элемент в свободный слот и возвращает его идентификатор
+    Id insert(T value) {
+        std::uint32_t slot;
+        if (!free_slots_.empty()) {
+            slot = free_slots_.back();
+            free_slots_.pop_back();
+        } else {
+            slot = static_cast<std::uint32_t>(slots_.size());
+            slots_.push_back({});
+        }
+        const Id id = MakeId(slots_[slot].generation, slot);
+        slots_[slot].dense_index = static_cast<std::uint32_t>(values_.size());
+        values_.emplace_back(id, std::move(value));
+        return id;
+    }
+
+    // Добавляет элемент с заранее известным идентификатором, например при восстановлении состояния.
+    // Если элемент с таким идентификатором уже есть, контейнер не изменяется
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(Id id, Args&&... args) {
+        const auto slot = SlotOf(id);
+        if (slot >= slots_.size()) {
+            // Недостающие слоты считаем свободными
+            for (auto free_slot = static_cast<std::uint32_t>(slots_.size()); free_slot < slot; ++free_slot) {
+                free_slots_.push_back(free_slot);
+            }
+            slots_.resize(static_cast<size_t>(slot) + 1);
+        } else if (slots_[slot].dense_index != FREE) {
+            if (values_[slots_[slot].dense_index].first == id) {
+                return {values_.begin() + slots_[slot].dense_index, false};
+            }
+            throw std::invalid_argument("Slot is occupied by an element of another generation");
+        } else {
+            std::erase(free_slots_, slot);
+        }
+        slots_[slot].generation = GenerationOf(id);
+        slots_[slot].dense_index = static_cast<std::uint32_t>(values_.size());
+        values_.emplace_back(std::piecewise_construct, std::forward_as_tuple(id),
+                             std::forward_as_tuple(std::forward<Args>(args)...));
+        return {std::prev(values_.end()), true};
+    }
+
+    // Удаляет элемент и возвращает количество удалённых элементов (0 или 1)
+    size_t erase(Id id) {
+        const auto dense_index = DenseIndexOf(id);
+        if (dense_index == FREE) {
+            return 0;
+        }
+        if (dense_index + 1 != values_.size()) {
+            values_[dense_index] = std::move(values_.back());
+            slots_[SlotOf(values_[dense_index].first)].dense_index = dense_index;
+        }
+        values_.pop_back();
+        auto& slot = slots_[SlotOf(id)];
+        slot.dense_index = FREE;
+        ++slot.generation;
+        free_slots_.push_back(SlotOf(id));
+        return 1;
+    }
+
+    iterator find(Id id) {
+        const auto dense_index = DenseIndexOf(id);
+        return dense_index == FREE ? values_.end() : values_.begin() + dense_index;
+    }
+
+    const_iterator find(Id id) const {
+        const auto dense_index = DenseIndexOf(id);
+        return dense_index == FREE ? values_.end() : values_.begin() + dense_index;
+    }
+
+    T& at(Id id) {
+        const auto it = find(id);
+        if (it == values_.end()) {
+            throw std::out_of_range("SlotMap has no element with the given id");
+        }
+        return it->second;
+    }
+
+    const T& at(Id id) const {
+        const auto it = find(id);
+        if (it == values_.end()) {
+            throw std::out_of_range("SlotMap has no element with the given id");
+        }
+        return it->second;
+    }
+
+    size_t count(Id id) const {
+        return DenseIndexOf(id) == FREE ? 0 : 1;
+    }
+
+    bool contains(Id id) const {
+        return count(id) != 0;
+    }
+
+    size_t size() const noexcept {
+        return values_.size();
+    }
+
+    bool empty() const noexcept {
+        return values_.empty();
+    }
+
+    void reserve(size_t capacity) {
+        values_.reserve(capacity);
+        slots_.reserve(capacity);
+    }
+
+    void clear() {
+        values_.clear();
+        slots_.clear();
+        free_slots_.clear();
+    }
+
+    iterator begin() noexcept {
+        return values_.begin();
+    }
+
+    iterator end() noexcept {
+        return values_.end();
+    }
+
+    const_iterator begin() const noexcept {
+        return values_.begin();
+    }
+
+    const_iterator end() const noexcept {
+        return values_.end();
+    }
+
+private:
+    static constexpr std::uint32_t FREE = std::numeric_limits<std::uint32_t>::max();
+
+    struct Slot {
+        std::uint32_t generation = 0;
+        std::uint32_t dense_index = FREE;
+    };
+
+    static Id MakeId(std::uint32_t generation, std::uint32_t slot) noexcept {
+        return (static_cast<Id>(generation) << 32) | slot;
+    }
+
+    static std::uint32_t SlotOf(Id id) noexcept {
+        return static_cast<std::uint32_t>(id);
+    }
+
+    static std::uint32_t GenerationOf(Id id) noexcept {
+        return static_cast<std::uint32_t>(id >> 32);
+    }
+
+    // Возвращает позицию элемента в values_ или FREE, если элемента нет
+    std::uint32_t DenseIndexOf(Id id) const noexcept {
+        const auto slot = SlotOf(id);
+        if (slot >= slots_.size() || slots_[slot].generation != GenerationOf(id)) {
+            return FREE;
+        }
+        return slots_[slot].dense_index;
+    }
+
+    std::vector<value_type> values_;
+    std::vector<Slot> slots_;
+    std::vector<std::uint32_t> free_slots_;
+};
+
+}  // namespace util
@@ -0,0 +1,455 @@
+#include "state_file.h"
+
+#include <boost/crc.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+
+namespace state_file {
+
+using namespace std::literals;
+
+namespace {
+
+constexpr std::string_view MAGIC = "DOGSTATE"sv;
+
+constexpr size_t SESSION_HEADER_SIZE = 32;
+constexpr size_t DOG_RECORD_SIZE = 56;
+constexpr size_t BAG_ITEM_RECORD_SIZE = 16;
+constexpr size_t LOOT_RECORD_SIZE = 32;
+constexpr size_t PLAYER_RECORD_SIZE = 16;
+constexpr size_t TOKEN_RECORD_SIZE = 8;
+
+// Дописывает числа в буфер в порядке little-endian независимо от порядка байтов платформы
+class Writer {
+public:
+    void U32(std::uint32_t value) {
+        char bytes[4];
+        for(int i = 0; i < 4; ++i) {
+            bytes[i] = static_cast<char>(value >> (8 * i));
+        }
+        buffer_.append(bytes, sizeof(bytes));
+    }
+
+    void U64(std::uint64_t value) {
+        char bytes[8];
+        for(int i = 0; i < 8; ++i) {
+            bytes[i] = static_cast<char>(value >> (8 * i));
+        }
+        buffer_.append(bytes, sizeof(bytes));
+    }
+
+    void I32(std::int32_t value) {
+        U32(static_cast<std::uint32_t>(value));
+    }
+
+    void F64(double value) {
+        U64(std::bit_cast<std::uint64_t>(value));
+    }
+
+    void Bytes(std::string_view bytes) {
+        buffer_.append(bytes);
+    }
+
+    const std::string& GetBuffer() const {
+        return buffer_;
+    }
+
+private:
+    std::string buffer_;
+};
+
+// Читает числа из отображённого в память файла, проверяя выход за границы данных
+class Reader {
+public:
+    explicit Reader(std::string_view data) : data_(data) {}
+
+    std::uint32_t U32() {
+        const auto bytes = Take(4);
+        std::uint32_t value = 0;
+        for(int i = 0; i < 4; ++i) {
+            value |= static_cast<std::uint32_t>(static_cast<unsigned char>(bytes[i])) << (8 * i);
+        }
+        return value;
+    }
+
+    std::uint64_t U64() {
+        const auto bytes = Take(8);
+        std::uint64_t value = 0;
+        for(int i = 0; i < 8; ++i) {
+            value |= static_cast<std::uint64_t>(static_cast<unsigned char>(bytes[i])) << (8 * i);
+        }
+        return value;
+    }
+
+    std::int32_t I32() {
+        return static_cast<std::int32_t>(U32());
+    }
+
+    double F64() {
+        return std::bit_cast<double>(U64());
+    }
+
+    std::string_view Bytes(size_t size) {
+        return Take(size);
+    }
+
+    // Проверяет, что впереди есть count записей размера record_size
+    void Expect(size_t count, size_t record_size) const {
+        if(count > (data_.size() - position_) / record_size) {
+            throw std::runtime_error("State file is truncated");
+        }
+    }
+
+    bool AtEnd() const {
+        return position_ == data_.size();
+    }
+
+private:
+    std::string_view Take(size_t size) {
+        if(size > data_.size() - position_) {
+            throw std::runtime_error("State file is truncated");
+        }
+        const auto bytes = data_.substr(position_, size);
+        position_ += size;
+        return bytes;
+    }
+
+    std::string_view data_;
+    size_t position_ = 0;
+};
+
+// Таблица строк: одинаковые строки записываются один раз
+class StringTable {
+public:
+    std::uint32_t Add(const std::string& str) {
+        const auto [it, is_inserted] = indexes_.emplace(str, static_cast<std::uint32_t>(strings_.size()));
+        if(is_inserted) {
+            strings_.push_back(&it->first);
+        }
+        return it->second;
+    }
+
+    void Write(Writer& writer) const {
+        writer.U32(static_cast<std::uint32_t>(strings_.size()));
+        for(const auto str : strings_) {
+            writer.U32(static_cast<std::uint32_t>(str->size()));
+            writer.Bytes(*str);
+        }
+    }
+
+private:
+    std::unordered_map<std::string, std::uint32_t> indexes_;
+    std::vector<const std::string*> strings_;
+};
+
+std::vector<std::string_view> ReadStrings(Reader& reader) {
+    const auto count = reader.U32();
+    // Каждая строка занимает хотя бы 4 байта длины
+    reader.Expect(count, 4);
+    std::vector<std::string_view> strings;
+    strings.reserve(count);
+    for(std::uint32_t i = 0; i < count; ++i) {
+        strings.push_back(reader.Bytes(reader.U32()));
+    }
+    return strings;
+}
+
+std::string_view GetString(const std::vector<std::string_view>& strings, std::uint32_t index) {
+    if(index >= strings.size()) {
+        throw std::runtime_error("State file refers to a missing string");
+    }
+    return strings[index];
+}
+
+// Возвращает элементы слот-карты в порядке номеров слотов (младшие 32 бита идентификатора).
+// В таком порядке слот-карта при загрузке только дописывает слоты в конец
+template <typename SlotMap>
+std::vector<const typename SlotMap::value_type*> SortBySlot(const SlotMap& slot_map) {
+    std::vector<const typename SlotMap::value_type*> items;
+    items.reserve(slot_map.size());
+    for(const auto& item : slot_map) {
+        items.push_back(&item);
+    }
+    std::sort(items.begin(), items.end(), [](const auto* lhs, const auto* rhs) {
+        return static_cast<std::uint32_t>(lhs->first) < static_cast<std::uint32_t>(rhs->first);
+    });
+    return items;
+}
+
+void WriteSessions(Writer& writer, StringTable& strings, const model::Game::MapIdToSession& sessions) {
+    writer.U32(static_cast<std::uint32_t>(sessions.size()));
+    for(const auto& [map_id, session] : sessions) {
+        const auto dogs = SortBySlot(session.GetDogs());
+        const auto loots = SortBySlot(session.GetLoots());
+        size_t bag_item_count = 0;
+        for(const auto* dog_item : dogs) {
+            bag_item_count += dog_item->second.GetBag().size();
+        }
+        writer.U32(strings.Add(*map_id));
+        writer.U32(static_cast<std::uint32_t>(dogs.size()));
+        writer.U32(static_cast<std::uint32_t>(loots.size()));
+        writer.U32(static_cast<std::uint32_t>(bag_item_count));
+        writer.U64(session.GetDogsIndex());
+        writer.U64(session.GetLootsIndex());
+        for(const auto* dog_item : dogs) {
+            const auto& dog = dog_item->second;
+            writer.U64(dog_item->first);
+            writer.U32(strings.Add(dog.GetName()));
+            writer.U32(static_cast<std::uint32_t>(dog.GetDirection()));
+            writer.F64(dog.GetCoords().x);
+            writer.F64(dog.GetCoords().y);
+            writer.F64(dog.GetSpeed().h_s);
+            writer.F64(dog.GetSpeed().v_s);
+            writer.I32(dog.GetScore());
+            writer.U32(static_cast<std::uint32_t>(dog.GetBag().size()));
+        }
+        for(const auto* dog_item : dogs) {
+            for(const auto& [loot_id, loot_type] : dog_item->second.GetBag()) {
+                writer.U64(loot_id);
+                writer.U64(loot_type);
+            }
+        }
+        for(const auto* loot_item : loots) {
+            const auto& loot = loot_item->second;
+            writer.U64(loot_item->first);
+            writer.I32(loot.GetLootType());
+            writer.U32(0);
+            writer.F64(loot.GetCoords().x);
+            writer.F64(loot.GetCoords().y);
+        }
+    }
+}
+
+model::Game::MapIdToSession ReadSessions(Reader& reader, const std::vector<std::string_view>& strings,
+                                         const model::Game& game) {
+    model::Game::MapIdToSession sessions;
+    const auto session_count = reader.U32();
+    reader.Expect(session_count, SESSION_HEADER_SIZE);
+    for(std::uint32_t session_idx = 0; session_idx < session_count; ++session_idx) {
+        const model::Map::Id map_id{std::string(GetString(strings, reader.U32()))};
+        const auto dog_count = reader.U32();
+        const auto loot_count = reader.U32();
+        const auto bag_item_count = reader.U32();
+        const auto dog_index = reader.U64();
+        const auto loot_index = reader.U64();
+        reader.Expect(dog_count, DOG_RECORD_SIZE);
+
+        // Сессии карт, которых больше нет в конфигурации, пропускаются
+        const auto map_ptr = game.FindMap(map_id);
+        if(map_ptr == nullptr) {
+            reader.Bytes(static_cast<size_t>(dog_count) * DOG_RECORD_SIZE);
+            reader.Expect(bag_item_count, BAG_ITEM_RECORD_SIZE);
+            reader.Bytes(static_cast<size_t>(bag_item_count) * BAG_ITEM_RECORD_SIZE);
+            reader.Expect(loot_count, LOOT_RECORD_SIZE);
+            reader.Bytes(static_cast<size_t>(loot_count) * LOOT_RECORD_SIZE);
+            continue;
+        }
+        model::GameSession session{map_ptr, game.GetRandomize(), game.GetLootGeneratorConfig()};
+        auto& dogs = session.GetDogs();
+        dogs.reserve(dog_count);
+        std::vector<std::uint32_t> bag_sizes;
+        bag_sizes.reserve(dog_count);
+        size_t bag_size_sum = 0;
+        for(std::uint32_t i = 0; i < dog_count; ++i) {
+            const auto id = reader.U64();
+            const auto name = GetString(strings, reader.U32());
+            const auto direction = reader.U32();
+            if(direction > static_cast<std::uint32_t>(model::Dog::Direction::EAST)) {
+                throw std::runtime_error("State file contains an invalid dog direction");
+            }
+            model::Dog::coords coords;
+            coords.x = reader.F64();
+            coords.y = reader.F64();
+            model::Dog::speed speed;
+            speed.h_s = reader.F64();
+            speed.v_s = reader.F64();
+            const auto [it, is_inserted] = dogs.try_emplace(id, std::string(name), coords);
+            if(!is_inserted) {
+                throw std::runtime_error("State file contains duplicate dogs");
+            }
+            auto& dog = it->second;
+            dog.SetSpeedOnly(speed);
+            dog.SetDirection(static_cast<model::Dog::Direction>(direction));
+            dog.AddScore(reader.I32());
+            bag_sizes.push_back(reader.U32());
+            bag_size_sum += bag_sizes.back();
+        }
+        if(bag_size_sum != bag_item_count) {
+            throw std::runtime_error("State file contains inconsistent bag records");
+        }
+        // Псы добавлялись без удалений, поэтому лежат в слот-карте в порядке записей
+        reader.Expect(bag_item_count, BAG_ITEM_RECORD_SIZE);
+        for(std::uint32_t i = 0; i < dog_count; ++i) {
+            auto& dog = (dogs.begin() + i)->second;
+            for(std::uint32_t item = 0; item < bag_sizes[i]; ++item) {
+                const auto loot_id = reader.U64();
+                const auto loot_type = reader.U64();
+                dog.PutLootInTheBag(loot_id, model::Loot(static_cast<int>(loot_type), {0.0, 0.0}));
+            }
+        }
+        reader.Expect(loot_count, LOOT_RECORD_SIZE);
+        auto& loots = session.GetLoots();
+        loots.reserve(loot_count);
+        for(std::uint32_t i = 0; i < loot_count; ++i) {
+            const auto id = reader.U64();
+            const auto loot_type = reader.I32();
+            reader.U32();
+            model::Loot::coords coords;
+            coords.x = reader.F64();
+            coords.y = reader.F64();
+            loots.try_emplace(id, loot_type, coords);
+        }
+        session.SetDogsIndex(dog_index);
+        session.SetLootsIndex(loot_index);
+        sessions.emplace(map_id, std::move(session));
+    }
+    return sessions;
+}
+
+}  // namespace
+
+void Save(const std::filesystem::path& path, const model::Game& game, const app::Players& players,
+          const app::PlayerTokens& player_tokens, CheckpointInfo info) {
+    StringTable strings;
+    Writer records;
+    WriteSessions(records, strings, game.GetSessions());
+
+    // Токены ссылаются на игроков по номеру записи
+    const auto& players_map = players.GetPlayers();
+    std::unordered_map<const app::Player*, std::uint32_t> player_records;
+    player_records.reserve(players_map.size());
+    records.U32(static_cast<std::uint32_t>(players_map.size()));
+    for(const auto& [key, player] : players_map) {
+        player_records.emplace(&player, static_cast<std::uint32_t>(player_records.size()));
+        records.U64(*(player.GetPlayerId()));
+        records.U32(strings.Add(*(player.GetMapId())));
+        records.U32(strings.Add(player.GetName()));
+    }
+    Writer token_records;
+    std::uint32_t token_count = 0;
+    player_tokens.ForEachToken([&](const app::Token& token, const app::Player& player) {
+        token_records.U32(strings.Add(*token));
+        token_records.U32(player_records.at(&player));
+        ++token_count;
+    });
+    records.U32(token_count);
+    records.Bytes(token_records.GetBuffer());
+
+    Writer string_table;
+    strings.Write(string_table);
+
+    boost::crc_32_type crc;
+    crc.process_bytes(string_table.GetBuffer().data(), string_table.GetBuffer().size());
+    crc.process_bytes(records.GetBuffer().data(), records.GetBuffer().size());
+
+    Writer header;
+    header.Bytes(MAGIC);
+    header.U32(FORMAT_VERSION);
+    header.U32(HEADER_SIZE);
+    header.U64(info.checkpoint_id);
+    header.U64(info.journal_offset);
+    header.U64(string_table.GetBuffer().size() + records.GetBuffer().size());
+    header.U32(crc.checksum());
+    header.U32(0);
+
+    std::ofstream out{path, std::ios_base::binary | std::ios_base::trunc};
+    out.write(header.GetBuffer().data(), header.GetBuffer().size());
+    out.write(string_table.GetBuffer().data(), string_table.GetBuffer().size());
+    out.write(records.GetBuffer().data(), records.GetBuffer().size());
+    out.close();
+    if(!out) {
+        throw std::runtime_error("Failed to write state file "s + path.string());
+    }
+}
+
+bool IsStateFile(const std::filesystem::path& path) {
+    std::ifstream in{path, std::ios_base::binary};
+    char magic[MAGIC.size()];
+    return in.read(magic, sizeof(magic)) && std::string_view(magic, sizeof(magic)) == MAGIC;
+}
+
+CheckpointInfo Load(const std::filesystem::path& path, model::Game& game, app::Players& players,
+                    app::PlayerTokens& player_tokens) {
+    namespace ipc = boost::interprocess;
+    const ipc::file_mapping mapping{path.c_str(), ipc::read_only};
+    const ipc::mapped_region region{mapping, ipc::read_only};
+    const std::string_view file{static_cast<const char*>(region.get_address()), region.get_size()};
+
+    Reader header{file};
+    if(header.Bytes(MAGIC.size()) != MAGIC) {
+        throw std::runtime_error("Not a game state file");
+    }
+    const auto version = header.U32();
+    if(version > FORMAT_VERSION) {
+        throw std::runtime_error("State file format version is not supported");
+    }
+    const auto header_size = header.U32();
+    CheckpointInfo info;
+    info.checkpoint_id = header.U64();
+    info.journal_offset = header.U64();
+    const auto payload_size = header.U64();
+    const auto payload_crc = header.U32();
+    if(header_size < HEADER_SIZE || header_size > file.size() || payload_size != file.size() - header_size) {
+        throw std::runtime_error("State file is truncated");
+    }
+    const auto payload = file.substr(header_size);
+    boost::crc_32_type crc;
+    crc.process_bytes(payload.data(), payload.size());
+    if(crc.checksum() != payload_crc) {
+        throw std::runtime_error("State file checksum mismatch");
+    }
+
+    Reader reader{payload};
+    const auto strings = ReadStrings(reader);
+    auto sessions = ReadSessions(reader, strings, game);
+
+    const auto player_count = reader.U32();
+    reader.Expect(player_count, PLAYER_RECORD_SIZE);
+    app::Players::DogIdMapIdToPlayer players_map;
+    players_map.reserve(player_count);
+    std::vector<std::pair<std::uint64_t, model::Map::Id>> player_keys;
+    player_keys.reserve(player_count);
+    for(std::uint32_t i = 0; i < player_count; ++i) {
+        const auto player_id = reader.U64();
+        model::Map::Id map_id{std::string(GetString(strings, reader.U32()))};
+        const auto name = GetString(strings, reader.U32());
+        player_keys.emplace_back(player_id, map_id);
+        players_map.emplace(player_keys.back(), app::Player(std::string(name), player_id, std::move(map_id)));
+    }
+
+    const auto token_count = reader.U32();
+    reader.Expect(token_count, TOKEN_RECORD_SIZE);
+    std::vector<std::pair<app::Token, std::uint32_t>> token_records;
+    token_records.reserve(token_count);
+    for(std::uint32_t i = 0; i < token_count; ++i) {
+        app::Token token{std::string(GetString(strings, reader.U32()))};
+        const auto player_record = reader.U32();
+        if(player_record >= player_keys.size()) {
+            throw std::runtime_error("State file refers to a missing player");
+        }
+        token_records.emplace_back(std::move(token), player_record);
+    }
+    if(!reader.AtEnd()) {
+        throw std::runtime_error("State file has unexpected trailing data");
+    }
+
+    game.SetSessions(std::move(sessions));
+    players.SetPlayers(std::move(players_map));
+    // Указатели на игроков берутся после того, как игроки заняли своё место в players
+    app::PlayerTokens::TokenToPlayerPtr tokens;
+    tokens.reserve(token_count);
+    for(auto& [token, player_record] : token_records) {
+        const auto& [player_id, map_id] = player_keys[player_record];
+        tokens.emplace(std::move(token), players.FindByPlayerIdAndMapId(player_id, map_id));
+    }
+    player_tokens.SetTokens(std::move(tokens));
+    return info;
+}
+
+}  // namespace state_file
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+
+#include "app.h"
+
+namespace state_file {
+
+/*
+ * Двоичный формат файла состояния игры. Все числа хранятся в порядке little-endian,
+ * числа с плавающей точкой - как 64-битное представление IEEE 754.
+ *
+ * Заголовок (HEADER_SIZE байт):
+ *   magic[8] "DOGSTATE", u32 версия формата, u32 размер заголовка,
+ *   u64 номер контрольной точки, u64 позиция в журнале прежней точки,
+ *   u64 размер данных, u32 CRC-32 данных, u32 резерв.
+ * Данные:
+ *   таблица строк: u32 количество, затем для каждой строки u32 длина и байты.
+ *     Имена псов и игроков, идентификаторы карт и токены хранятся как индексы в этой таблице;
+ *   u32 количество сессий, для каждой сессии:
+ *     u32 карта, u32 псов, u32 трофеев, u32 предметов в рюкзаках, u64 счётчик псов, u64 счётчик трофеев;
+ *     записи псов: u64 id, u32 имя, u32 направление, f64 x, f64 y, f64 vx, f64 vy, i32 очки, u32 предметов;
+ *     предметы рюкзаков подряд в порядке псов: u64 id трофея, u64 тип;
+ *     записи трофеев: u64 id, i32 тип, u32 резерв, f64 x, f64 y;
+ *   u32 количество игроков, записи: u64 id, u32 карта, u32 имя;
+ *   u32 количество токенов, записи: u32 токен, u32 номер записи игрока.
+ * Записи каждого вида имеют фиксированный размер, поэтому границы массивов
+ * проверяются один раз до разбора. Псы и трофеи записываются в порядке номеров слотов,
+ * чтобы при загрузке слот-карты заполнялись без поиска свободных слотов.
+ */
+inline constexpr std::uint32_t FORMAT_VERSION = 1;
+inline constexpr std::uint32_t HEADER_SIZE = 48;
+
+// Сведения о контрольной точке, которые хранятся вместе с состоянием
+struct CheckpointInfo {
+    std::uint64_t checkpoint_id = 0;
+    std::uint64_t journal_offset = 0;
+};
+
+// Записывает состояние игры в файл path
+void Save(const std::filesystem::path& path, const model::Game& game, const app::Players& players,
+          const app::PlayerTokens& player_tokens, CheckpointInfo info);
+
+// Проверяет, записан ли файл в этом формате. Прежние сохранения - архивы boost::serialization
+bool IsStateFile(const std::filesystem::path& path);
+
+// Отображает файл в память и восстанавливает из него сессии, игроков и токены.
+// Бросает std::runtime_error, если файл повреждён или записан более новой версией
+CheckpointInfo Load(const std::filesystem::path& path, model::Game& game, app::Players& players,
+                    app::PlayerTokens& player_tokens);
+
+}  // namespace state_file
@@ -0,0 +1,366 @@
+#include "static_cache.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+
+namespace http_handler {
+
+namespace fs = std::filesystem;
+namespace io = boost::iostreams;
+using namespace std::literals;
+
+namespace {
+
+constexpr std::uint32_t WATCH_MASK = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE
+                                     | IN_DELETE_SELF | IN_MOVED_FROM | IN_MOVED_TO | IN_MOVE_SELF;
+
+// Читает предварительно сжатый вариант файла, если он не старше самого файла
+std::shared_ptr<const std::string> ReadEncodedSibling(const fs::path& path, fs::file_time_type write_time,
+                                                      ContentEncoding encoding) {
+    auto sibling_path = path;
+    sibling_path += GetEncodingExtension(encoding);
+    std::error_code ec;
+    const auto sibling_write_time = fs::last_write_time(sibling_path, ec);
+    if(ec || sibling_write_time < write_time) {
+        return nullptr;
+    }
+    const auto size = fs::file_size(sibling_path, ec);
+    if(ec) {
+        return nullptr;
+    }
+    std::string data(size, '\0');
+    std::ifstream in{sibling_path, std::ios_base::binary};
+    if(!in.read(data.data(), data.size())) {
+        return nullptr;
+    }
+    return std::make_shared<const std::string>(std::move(data));
+}
+
+// Вес q кодировки из элемента Accept-Encoding, например "gzip;q=0.5"
+double ParseQuality(std::string_view params) {
+    const auto q_pos = params.find("q="sv);
+    if(q_pos == std::string_view::npos) {
+        return 1.0;
+    }
+    const auto value = params.substr(q_pos + 2);
+    double quality = 0;
+    const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), quality);
+    return ec == std::errc{} ? quality : 0.0;
+}
+
+bool EqualsIgnoreCase(std::string_view lhs, std::string_view rhs) {
+    return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](char l, char r) {
+        return std::tolower(static_cast<unsigned char>(l)) == std::tolower(static_cast<unsigned char>(r));
+    });
+}
+
+}  // namespace
+
+std::string_view GetEncodingName(ContentEncoding encoding) {
+    switch(encoding) {
+        case ContentEncoding::GZIP:
+            return "gzip"sv;
+        case ContentEncoding::BROTLI:
+            return "br"sv;
+        default:
+            return "identity"sv;
+    }
+}
+
+std::string_view GetEncodingExtension(ContentEncoding encoding) {
+    switch(encoding) {
+        case ContentEncoding::GZIP:
+            return ".gz"sv;
+        case ContentEncoding::BROTLI:
+            return ".br"sv;
+        default:
+            return {};
+    }
+}
+
+ContentEncoding ChooseContentEncoding(std::string_view accept_encoding, bool has_gzip, bool has_brotli) {
+    double gzip_quality = -1;
+    double brotli_quality = -1;
+    double any_quality = -1;
+    while(!accept_encoding.empty()) {
+        const auto comma = accept_encoding.find(',');
+        const auto item = accept_encoding.substr(0, comma);
+        accept_encoding = comma == std::string_view::npos ? std::string_view{} : accept_encoding.substr(comma + 1);
+        const auto semicolon = item.find(';');
+        const auto coding = Trim(item.substr(0, semicolon));
+        const auto quality = semicolon == std::string_view::npos ? 1.0 : ParseQuality(item.substr(semicolon + 1));
+        if(EqualsIgnoreCase(coding, "gzip"sv) || EqualsIgnoreCase(coding, "x-gzip"sv)) {
+            gzip_quality = quality;
+        } else if(EqualsIgnoreCase(coding, "br"sv)) {
+            brotli_quality = quality;
+        } else if(coding == "*"sv) {
+            any_quality = quality;
+        }
+    }
+    // Не перечисленные явно кодировки принимаются с весом "*"
+    if(gzip_quality < 0) {
+        gzip_quality = any_quality;
+    }
+    if(brotli_quality < 0) {
+        brotli_quality = any_quality;
+    }
+    if(has_brotli && brotli_quality > 0 && (!has_gzip || brotli_quality >= gzip_quality)) {
+        return ContentEncoding::BROTLI;
+    }
+    if(has_gzip && gzip_quality > 0) {
+        return ContentEncoding::GZIP;
+    }
+    return ContentEncoding::IDENTITY;
+}
+
+bool HasEncodedSibling(const fs::path& path, ContentEncoding encoding) {
+    auto sibling_path = path;
+    sibling_path += GetEncodingExtension(encoding);
+    std::error_code ec;
+    const auto sibling_write_time = fs::last_write_time(sibling_path, ec);
+    if(ec) {
+        return false;
+    }
+    const auto write_time = fs::last_write_time(path, ec);
+    return !ec && sibling_write_time >= write_time;
+}
+
+bool IsCompressible(std::string_view content_type) {
+    return content_type.starts_with("text/"sv) || content_type == "application/json"sv
+        || content_type == "application/xml"sv || content_type == "image/svg+xml"sv;
+}
+
+std::shared_ptr<const std::string> GzipCompress(const std::string& data) {
+    std::string compressed;
+    {
+        io::filtering_ostream out;
+        out.push(io::gzip_compressor(io::gzip_params(io::gzip::best_compression)));
+        out.push(io::back_inserter(compressed));
+        out.write(data.data(), data.size());
+    }
+    if(compressed.size() >= data.size()) {
+        return nullptr;
+    }
+    return std::make_shared<const std::string>(std::move(compressed));
+}
+
+std::string MakeEncodedETag(std::string_view etag, ContentEncoding encoding) {
+    if(encoding == ContentEncoding::IDENTITY) {
+        return std::string(etag);
+    }
+    // Суффикс кодировки добавляется внутрь кавычек
+    std::string encoded_etag{etag.substr(0, etag.size() - 1)};
+    encoded_etag += '-';
+    encoded_etag += GetEncodingName(encoding);
+    encoded_etag += '"';
+    return encoded_etag;
+}
+
+std::string CachedFile::GetETag(ContentEncoding encoding) const {
+    return MakeEncodedETag(etag, encoding);
+}
+
+std::size_t CachedFile::GetTotalSize() const {
+    return data->size() + (gzip_data ? gzip_data->size() : 0) + (brotli_data ? brotli_data->size() : 0);
+}
+
+StaticFileCache::StaticFileCache(std::size_t capacity, std::size_t max_file_size)
+    : capacity_(capacity)
+    , max_file_size_(max_file_size != 0 ? max_file_size : capacity / 4) {
+}
+
+StaticFileCache::~StaticFileCache() {
+    if(watcher_.joinable()) {
+        const std::uint64_t stop = 1;
+        [[maybe_unused]] auto written = write(stop_fd_, &stop, sizeof(stop));
+        watcher_.join();
+    }
+    if(inotify_fd_ >= 0) {
+        close(inotify_fd_);
+    }
+    if(stop_fd_ >= 0) {
+        close(stop_fd_);
+    }
+}
+
+std::shared_ptr<const CachedFile> StaticFileCache::Find(const std::string& key) {
+    std::lock_guard lock{mutex_};
+    const auto it = index_.find(key);
+    if(it == index_.end()) {
+        return nullptr;
+    }
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return it->second->file;
+}
+
+std::shared_ptr<const CachedFile> StaticFileCache::Load(const std::string& key, const fs::path& path,
+                                                        std::string_view content_type) {
+    // Файл, изменившийся во время чтения, не должен остаться в кэше после очистки
+    std::uint64_t generation = 0;
+    {
+        std::lock_guard lock{mutex_};
+        generation = generation_;
+    }
+    std::error_code ec;
+    const auto size = fs::file_size(path, ec);
+    if(ec || size > max_file_size_) {
+        return nullptr;
+    }
+    const auto write_time = fs::last_write_time(path, ec);
+    if(ec) {
+        return nullptr;
+    }
+
+    std::string data(size, '\0');
+    std::ifstream in{path, std::ios_base::binary};
+    if(!in.read(data.data(), data.size())) {
+        return nullptr;
+    }
+
+    auto file = std::make_shared<CachedFile>();
+    file->brotli_data = ReadEncodedSibling(path, write_time, ContentEncoding::BROTLI);
+    file->gzip_data = ReadEncodedSibling(path, write_time, ContentEncoding::GZIP);
+    if(!file->gzip_data && IsCompressible(content_type) && size >= MIN_COMPRESSED_SIZE) {
+        file->gzip_data = GzipCompress(data);
+    }
+    file->data = std::make_shared<const std::string>(std::move(data));
+    file->content_type = content_type;
+    const auto modification_time = std::chrono::file_clock::to_sys(write_time);
+    file->etag = MakeFileETag(modification_time.time_since_epoch().count(), size);
+    file->modified_time = std::chrono::system_clock::to_time_t(
+        std::chrono::time_point_cast<std::chrono::system_clock::duration>(modification_time));
+    file->last_modified = FormatHttpDate(file->modified_time);
+    Insert(key, file, generation);
+    return file;
+}
+
+void StaticFileCache::Insert(const std::string& key, std::shared_ptr<const CachedFile> file, std::uint64_t generation) {
+    std::lock_guard lock{mutex_};
+    if(generation != generation_) {
+        return;
+    }
+    if(const auto it = index_.find(key); it != index_.end()) {
+        size_ -= it->second->file->GetTotalSize();
+        entries_.erase(it->second);
+        index_.erase(it);
+    }
+    size_ += file->GetTotalSize();
+    entries_.push_front({key, std::move(file)});
+    index_.emplace(key, entries_.begin());
+    while(size_ > capacity_) {
+        auto& oldest = entries_.back();
+        size_ -= oldest.file->GetTotalSize();
+        index_.erase(oldest.key);
+        entries_.pop_back();
+    }
+}
+
+void StaticFileCache::Clear() {
+    std::lock_guard lock{mutex_};
+    ++generation_;
+    entries_.clear();
+    index_.clear();
+    size_ = 0;
+}
+
+std::size_t StaticFileCache::GetSize() const {
+    std::lock_guard lock{mutex_};
+    return size_;
+}
+
+void StaticFileCache::WatchDirectory(const fs::path& root) {
+    if(watcher_.joinable()) {
+        throw std::logic_error("Static file cache is already watching a directory");
+    }
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(inotify_fd_ < 0) {
+        throw std::system_error(errno, std::generic_category(), "inotify_init1");
+    }
+    stop_fd_ = eventfd(0, EFD_CLOEXEC);
+    if(stop_fd_ < 0) {
+        throw std::system_error(errno, std::generic_category(), "eventfd");
+    }
+    AddWatchTree(root);
+    // Файлы, прочитанные до начала наблюдения, могли уже измениться
+    Clear();
+    watcher_ = std::thread([this] { WatchEvents(); });
+}
+
+void StaticFileCache::AddWatchTree(const fs::path& root) {
+    // inotify не следит за подкаталогами, каждый каталог добавляется отдельно
+    AddWatch(root);
+    std::error_code ec;
+    for(fs::recursive_directory_iterator it{root, fs::directory_options::skip_permission_denied, ec}, end;
+        !ec && it != end; it.increment(ec)) {
+        if(it->is_directory(ec)) {
+            AddWatch(it->path());
+        }
+    }
+}
+
+void StaticFileCache::AddWatch(const fs::path& dir) {
+    const int wd = inotify_add_watch(inotify_fd_, dir.c_str(), WATCH_MASK);
+    if(wd < 0) {
+        std::cerr << "Failed to watch static directory "sv << dir << ": "sv << std::strerror(errno) << std::endl;
+        return;
+    }
+    watched_dirs_[wd] = dir;
+}
+
+void StaticFileCache::WatchEvents() {
+    std::array<pollfd, 2> fds{{{inotify_fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}}};
+    alignas(inotify_event) char buffer[16 * 1024];
+    while(true) {
+        if(poll(fds.data(), fds.size(), -1) < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            std::cerr << "Static directory watch stopped: "sv << std::strerror(errno) << std::endl;
+            return;
+        }
+        if(fds[1].revents != 0) {
+            return;
+        }
+        bool is_changed = false;
+        ssize_t length = 0;
+        while((length = read(inotify_fd_, buffer, sizeof(buffer))) > 0) {
+            is_changed = true;
+            for(char* ptr = buffer; ptr < buffer + length;) {
+                const auto* event = reinterpret_cast<const inotify_event*>(ptr);
+                // Созданные и перенесённые в каталог подкаталоги тоже нужно наблюдать
+                if((event->mask & (IN_CREATE | IN_MOVED_TO)) && (event->mask & IN_ISDIR) && event->len > 0) {
+                    if(const auto dir_it = watched_dirs_.find(event->wd); dir_it != watched_dirs_.end()) {
+                        AddWatchTree(dir_it->second / event->name);
+                    }
+                }
+                if(event->mask & IN_IGNORED) {
+                    watched_dirs_.erase(event->wd);
+                }
+                ptr += sizeof(inotify_event) + event->len;
+            }
+        }
+        // Ключи кэша - пути запросов, которые могут вести к файлу через подкаталоги и index.html,
+        // поэтому при любом изменении кэш очищается целиком
+        if(is_changed) {
+            Clear();
+        }
+    }
+}
+
+}  // namespace http_handler
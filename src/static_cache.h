@@ -0,0 +1,141 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#include "http_validators.h"
+
+namespace http_handler {
+
+// Кодировка, в которой статический файл отправляется клиенту
+enum class ContentEncoding {
+    IDENTITY,
+    GZIP,
+    BROTLI
+};
+
+// Значение заголовка Content-Encoding и расширение предварительно сжатого файла
+std::string_view GetEncodingName(ContentEncoding encoding);
+std::string_view GetEncodingExtension(ContentEncoding encoding);
+// Выбирает кодировку по заголовку Accept-Encoding среди доступных вариантов файла.
+// Brotli предпочтительнее gzip при равных весах q
+ContentEncoding ChooseContentEncoding(std::string_view accept_encoding, bool has_gzip, bool has_brotli);
+// ETag варианта файла в кодировке encoding: у каждого варианта он свой,
+// иначе кэши смешают сжатое и несжатое содержимое
+std::string MakeEncodedETag(std::string_view etag, ContentEncoding encoding);
+// Есть ли рядом с файлом path его сжатый вариант не старше самого файла
+bool HasEncodedSibling(const std::filesystem::path& path, ContentEncoding encoding);
+// Сжатие gzip имеет смысл для текстовых форматов, изображения и архивы уже сжаты
+bool IsCompressible(std::string_view content_type);
+// Сжатый в памяти вариант файла, если сжатие уменьшает его размер
+std::shared_ptr<const std::string> GzipCompress(const std::string& data);
+
+// Статический файл, загруженный в память
+struct CachedFile {
+    // Содержимое отдаётся в ответах без копирования
+    std::shared_ptr<const std::string> data;
+    // Сжатые варианты содержимого, nullptr - варианта нет.
+    // Берутся из файлов <файл>.gz и <файл>.br, gzip при их отсутствии сжимается при загрузке
+    std::shared_ptr<const std::string> gzip_data;
+    std::shared_ptr<const std::string> brotli_data;
+    std::string_view content_type;
+    // Строгий ETag вида "<время изменения>-<размер>" в шестнадцатеричной записи
+    std::string etag;
+    // Время изменения файла в формате HTTP-date и в секундах для сравнения с If-Modified-Since
+    std::string last_modified;
+    std::time_t modified_time = 0;
+
+    const std::shared_ptr<const std::string>& GetData(ContentEncoding encoding) const {
+        switch(encoding) {
+            case ContentEncoding::GZIP:
+                return gzip_data;
+            case ContentEncoding::BROTLI:
+                return brotli_data;
+            default:
+                return data;
+        }
+    }
+    std::string GetETag(ContentEncoding encoding) const;
+    bool HasEncodings() const {
+        return gzip_data || brotli_data;
+    }
+    std::size_t GetTotalSize() const;
+};
+
+// Кэш статических файлов с ключом - раскодированным путём запроса.
+// Попадание в кэш не требует обращений к файловой системе. Общий размер файлов ограничен,
+// при переполнении вытесняются давно запрошенные файлы (LRU).
+// Без наблюдения за каталогом файлы считаются неизменными. При наблюдении через inotify
+// любое изменение в каталоге очищает кэш.
+// Методы можно вызывать из любого потока
+class StaticFileCache {
+public:
+    static constexpr std::size_t DEFAULT_CAPACITY = 64 * 1024 * 1024;
+    // Файлы меньше этого размера не сжимаются: выигрыш не окупает заголовок gzip
+    static constexpr std::size_t MIN_COMPRESSED_SIZE = 1024;
+
+    // Файлы больше max_file_size не кэшируются, по умолчанию - четверть ёмкости
+    explicit StaticFileCache(std::size_t capacity = DEFAULT_CAPACITY, std::size_t max_file_size = 0);
+    StaticFileCache(const StaticFileCache&) = delete;
+    StaticFileCache& operator=(const StaticFileCache&) = delete;
+    // Останавливает наблюдение за каталогом
+    ~StaticFileCache();
+
+    std::shared_ptr<const CachedFile> Find(const std::string& key);
+    // Читает файл path и кэширует его под ключом key. Возвращает nullptr,
+    // если файл слишком велик для кэша или не читается
+    std::shared_ptr<const CachedFile> Load(const std::string& key, const std::filesystem::path& path,
+                                           std::string_view content_type);
+    void Clear();
+
+    // Начинает наблюдение за каталогом и его подкаталогами через inotify.
+    // Бросает std::system_error, если inotify недоступен
+    void WatchDirectory(const std::filesystem::path& root);
+
+    std::size_t GetSize() const;
+    std::size_t GetCapacity() const {
+        return capacity_;
+    }
+
+private:
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const CachedFile> file;
+    };
+    using EntryList = std::list<Entry>;
+
+    // Не кэширует файл, если после начала его чтения кэш был очищен
+    void Insert(const std::string& key, std::shared_ptr<const CachedFile> file, std::uint64_t generation);
+    void AddWatchTree(const std::filesystem::path& root);
+    void AddWatch(const std::filesystem::path& dir);
+    void WatchEvents();
+
+    const std::size_t capacity_;
+    const std::size_t max_file_size_;
+
+    mutable std::mutex mutex_;
+    // В начале списка - недавно запрошенные файлы
+    EntryList entries_;
+    std::unordered_map<std::string, EntryList::iterator> index_;
+    std::size_t size_ = 0;
+    // Увеличивается при каждой очистке кэша
+    std::uint64_t generation_ = 0;
+
+    int inotify_fd_ = -1;
+    // Наблюдаемые каталоги. После запуска наблюдения используются только его потоком
+    std::unordered_map<int, std::filesystem::path> watched_dirs_;
+    // Дескриптор, через который поток наблюдения получает сигнал остановки
+    int stop_fd_ = -1;
+    std::thread watcher_;
+};
+
+}  // namespace http_handler
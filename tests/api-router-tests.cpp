@@ -0,0 +1,142 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <string>
+
+#include "../src/api_routes.h"
+
+using namespace http_handler;
+using namespace std::literals;
+namespace {
+
+// Маршрутизация сравнением строк, которая была в ApiHandler до таблицы маршрутов
+int RouteByStringCompare(std::string_view target) {
+    std::string trg = static_cast<std::string>(target);
+    if(trg == "/api/v1/game/join"s) {
+        return 0;
+    } else if(trg == "/api/v1/game/players"s) {
+        return 1;
+    } else if(trg == "/api/v1/game/state"s || trg.starts_with("/api/v1/game/state?"s)) {
+        return 2;
+    } else if(trg == "/api/v1/game/player/action"s) {
+        return 3;
+    } else if (trg == "/api/v1/game/tick"s) {
+        return 4;
+    } else if (trg.find("/api/v1/maps") != std::string::npos) {
+        return 5;
+    } else if (trg.find("/api/v1/game/records"s) != std::string::npos) {
+        return 6;
+    }
+    return -1;
+}
+
+// Проверка шаблонов выполняется при компиляции
+static_assert(IsValidRoutePattern("/api/v1/maps/{}"sv));
+static_assert(!IsValidRoutePattern("api/v1/maps"sv));
+static_assert(!IsValidRoutePattern("/api//maps"sv));
+static_assert(!IsValidRoutePattern("/api/v1/maps/"sv));
+static_assert(!IsValidRoutePattern("/api/v1/maps/{id}"sv));
+static_assert(!IsValidRoutePattern("/{}/{}/{}"sv));
+static_assert(API_ROUTES.Find("/api/v1/maps/map1"sv, http::verb::get).route->endpoint == ApiEndpoint::MAP);
+
+}  // namespace
+
+SCENARIO("API route table") {
+    WHEN("routes are looked up with their methods") {
+        THEN("each endpoint has its methods and execution mode") {
+            const auto check_route = [](std::string_view target, http::verb method, ApiEndpoint endpoint,
+                                        ApiExecution execution) {
+                const auto match = API_ROUTES.Find(target, method);
+                REQUIRE(match.route);
+                CHECK(match.route->endpoint == endpoint);
+                CHECK(match.route->execution == execution);
+                CHECK(match.is_method_allowed);
+            };
+            check_route("/api/v1/game/join"sv, http::verb::post, ApiEndpoint::JOIN, ApiExecution::API_STRAND);
+            check_route("/api/v1/game/players"sv, http::verb::get, ApiEndpoint::PLAYERS, ApiExecution::SHARED_READ);
+            check_route("/api/v1/game/players"sv, http::verb::head, ApiEndpoint::PLAYERS, ApiExecution::SHARED_READ);
+            check_route("/api/v1/game/state?since=5"sv, http::verb::get, ApiEndpoint::GAME_STATE, ApiExecution::SHARED_READ);
+            check_route("/api/v1/game/player/action"sv, http::verb::post, ApiEndpoint::PLAYER_ACTION,
+                        ApiExecution::SESSION_STRAND);
+            check_route("/api/v1/game/tick"sv, http::verb::post, ApiEndpoint::TICK, ApiExecution::API_STRAND);
+            check_route("/api/v1/maps"sv, http::verb::head, ApiEndpoint::MAPS, ApiExecution::ANY_THREAD);
+            check_route("/api/v1/maps/map1"sv, http::verb::get, ApiEndpoint::MAP, ApiExecution::ANY_THREAD);
+            check_route("/api/v1/game/records"sv, http::verb::get, ApiEndpoint::RECORDS, ApiExecution::ANY_THREAD);
+        }
+
+        THEN("commands do not accept read methods") {
+            CHECK_FALSE(API_ROUTES.Find("/api/v1/game/join"sv, http::verb::get).is_method_allowed);
+            CHECK_FALSE(API_ROUTES.Find("/api/v1/game/player/action"sv, http::verb::get).is_method_allowed);
+            CHECK_FALSE(API_ROUTES.Find("/api/v1/game/tick"sv, http::verb::head).is_method_allowed);
+            CHECK_FALSE(API_ROUTES.Find("/api/v1/game/records"sv, http::verb::head).is_method_allowed);
+            CHECK_FALSE(API_ROUTES.Find("/api/v1/maps/map1"sv, http::verb::post).is_method_allowed);
+        }
+    }
+
+
+    WHEN("a target matches a literal route") {
+        const auto match = API_ROUTES.Find("/api/v1/game/join"sv, http::verb::post);
+
+        THEN("the route is found and the method is allowed") {
+            REQUIRE(match.route);
+            CHECK(match.route->endpoint == ApiEndpoint::JOIN);
+            CHECK(match.is_method_allowed);
+        }
+    }
+
+    WHEN("a target has a query string") {
+        const auto match = API_ROUTES.Find("/api/v1/game/records?start=0&maxItems=10"sv, http::verb::get);
+
+        THEN("the query is not matched") {
+            REQUIRE(match.route);
+            CHECK(match.route->endpoint == ApiEndpoint::RECORDS);
+        }
+    }
+
+    WHEN("a target matches a route with a parameter") {
+        const std::string target = "/api/v1/maps/map1?x=1"s;
+        const auto match = API_ROUTES.Find(target, http::verb::head);
+
+        THEN("the parameter refers to the target") {
+            REQUIRE(match.route);
+            CHECK(match.route->endpoint == ApiEndpoint::MAP);
+            CHECK(match.params[0] == "map1"sv);
+            CHECK(match.params[0].data() == target.data() + "/api/v1/maps/"s.size());
+            CHECK(match.is_method_allowed);
+        }
+    }
+
+    WHEN("the method is not in the route mask") {
+        const auto match = API_ROUTES.Find("/api/v1/game/state"sv, http::verb::post);
+
+        THEN("the route is found, but the method is not allowed") {
+            REQUIRE(match.route);
+            CHECK(match.route->endpoint == ApiEndpoint::GAME_STATE);
+            CHECK_FALSE(match.is_method_allowed);
+        }
+    }
+
+    WHEN("a target matches no route") {
+        THEN("no route is returned") {
+            CHECK(API_ROUTES.Find("/api/v1/game"sv, http::verb::get).route == nullptr);
+            CHECK(API_ROUTES.Find("/api/v1/maps/"sv, http::verb::get).route == nullptr);
+            CHECK(API_ROUTES.Find("/api/v1/maps/map1/roads"sv, http::verb::get).route == nullptr);
+            CHECK(API_ROUTES.Find("/api/v1/game/join/"sv, http::verb::post).route == nullptr);
+            CHECK(API_ROUTES.Find(""sv, http::verb::get).route == nullptr);
+        }
+    }
+}
+
+// Скрыт от обычного запуска, запускается явно: game_server_tests "[benchmark]"
+TEST_CASE("API routing cost per request", "[.][benchmark]") {
+    // Худший случай для цепочки сравнений - один из последних маршрутов
+    const std::string target = "/api/v1/game/records?start=0&maxItems=100"s;
+    REQUIRE(RouteByStringCompare(target) == 6);
+    REQUIRE(API_ROUTES.Find(target, http::verb::get).route->endpoint == ApiEndpoint::RECORDS);
+
+    BENCHMARK("String compare chain") {
+        return RouteByStringCompare(target);
+    };
+    BENCHMARK("RouteTable::Find") {
+        return API_ROUTES.Find(target, http::verb::get).route;
+    };
+}
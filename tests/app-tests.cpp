@@ -0,0 +1,195 @@
+#include <catch2/catch_test_macros.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/strand.hpp>
+#include <chrono>
+#include <future>
+#include <string>
+
+#include "../src/app.h"
+
+using namespace model;
+using namespace app;
+using namespace std::literals;
+namespace net = boost::asio;
+
+namespace {
+
+// Запоминает тики и проверяет, что они завершаются в strand тиков
+class TickCounter : public ApplicationListener {
+public:
+    explicit TickCounter(const SessionStrand* tick_strand = nullptr)
+        : tick_strand_(tick_strand) {}
+
+    void OnTick([[maybe_unused]] std::chrono::milliseconds time_delta) override {
+        ++ticks;
+        if(tick_strand_ && !tick_strand_->running_in_this_thread()) {
+            ++ticks_outside_strand;
+        }
+    }
+
+    int ticks = 0;
+    int ticks_outside_strand = 0;
+
+private:
+    const SessionStrand* tick_strand_;
+};
+
+Map MakeMap(std::string id) {
+    Map map(Map::Id{id}, id);
+    map.AddRoad(Road(Road::HORIZONTAL, {0, 0}, 30));
+    map.SetDogSpeed(1.0);
+    return map;
+}
+
+std::string Bearer(const Token& token) {
+    return "Bearer "s + *token;
+}
+
+double GetDogX(const Application& app, const JoinGameResult& player) {
+    const auto view = app.GetGameStateUseCase(Bearer(player.player_token));
+    return view.session->GetDogs().at(*player.player_id).GetCoords().x;
+}
+
+}  // namespace
+
+SCENARIO("Application ticks") {
+    GIVEN("players on two maps") {
+        // strand сессий приложения должны быть уничтожены раньше ioc
+        net::io_context ioc;
+        Game game;
+        game.AddMap(MakeMap("map1"s));
+        game.AddMap(MakeMap("map2"s));
+        game.SetLootGeneratorConfig(loot_gen::LootGenerator::TimeInterval{1000}, 0.0);
+        Players players(game);
+        PlayerTokens player_tokens;
+        extra::ExtraData extra_data;
+        Application app(game, players, player_tokens, extra_data);
+
+        const auto scooby = app.JoinGameUseCase("Scooby Doo"s, Map::Id{"map1"s});
+        const auto hatiko = app.JoinGameUseCase("Hatiko"s, Map::Id{"map2"s});
+        const double scooby_start_x = GetDogX(app, scooby);
+        const double hatiko_start_x = GetDogX(app, hatiko);
+
+        app.EnableSessionStrands(ioc);
+        auto api_strand = net::make_strand(ioc);
+
+        WHEN("sessions are updated sequentially") {
+            TickCounter counter;
+            app.AddApplicationListener(&counter);
+            bool is_completed = false;
+            app.TickTimeUseCase(1000, [&is_completed] {
+                is_completed = true;
+            });
+
+            THEN("the tick completes before returning") {
+                CHECK(is_completed);
+                CHECK(counter.ticks == 1);
+            }
+        }
+
+        WHEN("sessions are updated in their strands on a single thread") {
+            app.EnableParallelTick(2, api_strand);
+            TickCounter counter(&api_strand);
+            app.AddApplicationListener(&counter);
+
+            // Команда поступила в strand сессии раньше тика
+            const auto scooby_map = app.FindPlayerMapUseCase(Bearer(scooby.player_token));
+            REQUIRE(scooby_map == Map::Id{"map1"s});
+            const auto scooby_strand = app.FindSessionStrand(*scooby_map);
+            REQUIRE(scooby_strand != nullptr);
+            net::post(*scooby_strand, [&app, &scooby] {
+                app.MovePlayersUseCase(Bearer(scooby.player_token), "R"s);
+            });
+
+            bool is_completed = false;
+            bool is_completed_in_strand = false;
+            net::post(api_strand, [&] {
+                app.TickTimeUseCase(1000, [&] {
+                    is_completed = true;
+                    is_completed_in_strand = api_strand.running_in_this_thread();
+                });
+            });
+            // Выполняются команда и запуск тика: тик не ждёт сессии в занятом им потоке
+            ioc.run_one();
+            ioc.run_one();
+            CHECK_FALSE(is_completed);
+            CHECK(counter.ticks == 0);
+
+            ioc.run();
+
+            THEN("the tick is finished in the tick strand after all sessions") {
+                CHECK(is_completed);
+                CHECK(is_completed_in_strand);
+                CHECK(counter.ticks == 1);
+                CHECK(counter.ticks_outside_strand == 0);
+            }
+
+            THEN("commands received before the tick are applied first") {
+                CHECK(GetDogX(app, scooby) > scooby_start_x);
+                CHECK(GetDogX(app, hatiko) == hatiko_start_x);
+            }
+        }
+
+        WHEN("dogs retire during a parallel tick") {
+            game.SetDogRetirementTime(1000ms);
+            app.EnableParallelTick(2, api_strand);
+            net::post(api_strand, [&app] {
+                app.TickTimeUseCase(1500, [] {});
+            });
+            ioc.run();
+
+            THEN("their players and tokens are removed") {
+                CHECK(player_tokens.FindPlayerByToken(scooby.player_token) == nullptr);
+                CHECK(player_tokens.FindPlayerByToken(hatiko.player_token) == nullptr);
+                CHECK_FALSE(app.FindPlayerMapUseCase(Bearer(hatiko.player_token)));
+                CHECK(players.GetPlayers().empty());
+            }
+        }
+    }
+}
+
+SCENARIO("Shared reads of the game state") {
+    GIVEN("players on two maps") {
+        Game game;
+        game.AddMap(MakeMap("map1"s));
+        game.AddMap(MakeMap("map2"s));
+        Players players(game);
+        PlayerTokens player_tokens;
+        extra::ExtraData extra_data;
+        Application app(game, players, player_tokens, extra_data);
+
+        const auto scooby = app.JoinGameUseCase("Scooby Doo"s, Map::Id{"map1"s});
+        const auto pluto = app.JoinGameUseCase("Pluto"s, Map::Id{"map1"s});
+        const auto hatiko = app.JoinGameUseCase("Hatiko"s, Map::Id{"map2"s});
+
+        WHEN("a state view of one session is held") {
+            auto view = app.GetGameStateUseCase(Bearer(scooby.player_token));
+            REQUIRE(view.session != nullptr);
+
+            THEN("other reads of the session proceed") {
+                auto players_list = std::async(std::launch::async, [&app, &pluto] {
+                    return app.ListPlayersUseCase(pluto.player_token);
+                });
+                REQUIRE(players_list.wait_for(5s) == std::future_status::ready);
+                CHECK(players_list.get().size() == 2);
+            }
+
+            THEN("commands of another session proceed") {
+                auto move = std::async(std::launch::async, [&app, &hatiko] {
+                    app.MovePlayersUseCase(Bearer(hatiko.player_token), "L"s);
+                });
+                CHECK(move.wait_for(5s) == std::future_status::ready);
+            }
+
+            THEN("commands of the viewed session wait for the view") {
+                auto move = std::async(std::launch::async, [&app, &pluto] {
+                    app.MovePlayersUseCase(Bearer(pluto.player_token), "R"s);
+                });
+                CHECK(move.wait_for(50ms) == std::future_status::timeout);
+                view.lock.unlock();
+                CHECK(move.wait_for(5s) == std::future_status::ready);
+            }
+        }
+    }
+}
@@ -2,6 +2,7 @@
 
 #include <cmath>
 #include <functional>
+#include <random>
 #include <sstream>
 
 #include <catch2/catch_test_macros.hpp>
@@ -178,4 +179,100 @@ SCENARIO("Collision detection") {
             CHECK(events.empty());
         }
     }
+}
+
+// Эталон: полный перебор всех пар собиратель-предмет
+std::vector<collision_detector::GatheringEvent> FindGatherEventsBruteForce(
+    const collision_detector::ItemGathererProvider& provider) {
+    std::vector<collision_detector::GatheringEvent> detected_events;
+    for (size_t g = 0; g < provider.GatherersCount(); ++g) {
+        auto gatherer = provider.GetGatherer(g);
+        if (gatherer.start_pos == gatherer.end_pos) {
+            continue;
+        }
+        for (size_t i = 0; i < provider.ItemsCount(); ++i) {
+            auto item = provider.GetItem(i);
+            auto collect_result
+                = collision_detector::TryCollectPoint(gatherer.start_pos, gatherer.end_pos, item.position);
+            if (collect_result.IsCollected(gatherer.width + item.width)) {
+                detected_events.push_back({i, g, collect_result.sq_distance, collect_result.proj_ratio});
+            }
+        }
+    }
+    std::sort(detected_events.begin(), detected_events.end(),
+              [](const collision_detector::GatheringEvent& e_l, const collision_detector::GatheringEvent& e_r) {
+                  return e_l.time < e_r.time;
+              });
+    return detected_events;
+}
+
+SCENARIO("Broad-phase collision detection") {
+    GIVEN("many gatherers and items on a road grid") {
+        std::mt19937 generator(42);
+        std::uniform_int_distribution<int> road(0, 10);
+        std::uniform_real_distribution<double> along(0.0, 100.0);
+        std::uniform_real_distribution<double> shift(-0.4, 0.4);
+        std::uniform_real_distribution<double> step(-3.0, 3.0);
+
+        // Предметы и собиратели лежат на горизонтальных и вертикальных дорогах с шагом 10
+        const auto random_point = [&] {
+            return (generator() % 2 == 0) ? geom::Point2D{along(generator), road(generator) * 10.0 + shift(generator)}
+                                          : geom::Point2D{road(generator) * 10.0 + shift(generator), along(generator)};
+        };
+        std::vector<collision_detector::Item> items;
+        for (int i = 0; i < 2000; ++i) {
+            items.push_back({random_point(), (i % 10 == 0) ? 0.25 : 0.0});
+        }
+        std::vector<collision_detector::Gatherer> gatherers;
+        for (int i = 0; i < 2000; ++i) {
+            auto start = random_point();
+            auto end = (i % 2 == 0) ? geom::Point2D{start.x + step(generator), start.y}
+                                    : geom::Point2D{start.x, start.y + step(generator)};
+            gatherers.push_back({start, (i % 50 == 0) ? start : end, 0.3});
+        }
+        // Один собиратель проходит через всю карту
+        gatherers.push_back({{-5, 50}, {105, 50}, 0.3});
+        collision_detector::VectorItemGathererProvider provider{items, gatherers};
+
+        THEN("events are the same as in a brute force search") {
+            auto events = collision_detector::FindGatherEvents(provider);
+            auto expected = FindGatherEventsBruteForce(provider);
+            CHECK(!expected.empty());
+            CHECK_THAT(events, EqualsRange(expected, CompareEvents()));
+        }
+    }
+}
+
+SCENARIO("Batch collection kernel") {
+    GIVEN("a batch of random items") {
+        std::mt19937 generator(7);
+        std::uniform_real_distribution<double> coord(-100.0, 100.0);
+        collision_detector::ItemsBatch batch;
+        // Размер не кратен ширине SIMD-регистра, чтобы проверить и обработку остатка
+        for (int i = 0; i < 1003; ++i) {
+            batch.Add({{coord(generator), coord(generator)}, 0.0});
+        }
+        const geom::Point2D a{coord(generator), coord(generator)};
+        const geom::Point2D b{coord(generator), coord(generator)};
+
+        WHEN("the batch is processed") {
+            collision_detector::CollectionResults simd_results;
+            collision_detector::CollectionResults scalar_results;
+            collision_detector::TryCollectPoints(a, b, batch, simd_results);
+            collision_detector::TryCollectPointsScalar(a, b, batch, scalar_results);
+
+            THEN("results match the scalar path") {
+                REQUIRE(simd_results.sq_distance.size() == batch.Size());
+                REQUIRE(scalar_results.sq_distance.size() == batch.Size());
+                for (size_t i = 0; i < batch.Size(); ++i) {
+                    auto expected = collision_detector::TryCollectPoint(a, b, {batch.x[i], batch.y[i]});
+                    INFO("item: " << i);
+                    CHECK(std::abs(simd_results.sq_distance[i] - expected.sq_distance) <= 1e-9 * std::max(1.0, expected.sq_distance));
+                    CHECK(std::abs(simd_results.proj_ratio[i] - expected.proj_ratio) <= 1e-12 * std::max(1.0, std::abs(expected.proj_ratio)));
+                    CHECK(scalar_results.sq_distance[i] == simd_results.sq_distance[i]);
+                    CHECK(scalar_results.proj_ratio[i] == simd_results.proj_ratio[i]);
+                }
+            }
+        }
+    }
 }
\ No newline at end of file
@@ -0,0 +1,338 @@
+#include <catch2/catch_test_macros.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/json.hpp>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/game_state_hub.h"
+
+using namespace model;
+using namespace app;
+using namespace std::literals;
+using http_handler::GameStateHub;
+using http_handler::GameStateSubscriber;
+using http_handler::WebSocketSession;
+namespace net = boost::asio;
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace json = boost::json;
+
+namespace {
+
+// Запоминает кадры, полученные от хаба
+class FrameRecorder : public GameStateSubscriber {
+public:
+    void Send(std::shared_ptr<const std::string> frame) override {
+        frames.push_back(std::move(frame));
+    }
+
+    void Close() override {
+        ++close_calls;
+    }
+
+    std::vector<std::shared_ptr<const std::string>> frames;
+    int close_calls = 0;
+};
+
+Map MakeMap(std::string id) {
+    Map map(Map::Id{id}, id);
+    map.AddRoad(Road(Road::HORIZONTAL, {0, 0}, 30));
+    map.SetDogSpeed(1.0);
+    return map;
+}
+
+std::string Bearer(const Token& token) {
+    return "Bearer "s + *token;
+}
+
+json::object ParseFrame(const std::string& frame) {
+    return json::parse(frame).as_object();
+}
+
+// Выполняет action внутри strand и дожидается его завершения
+template <typename Action>
+void RunInStrand(net::io_context& ioc, GameStateHub::Strand& strand, Action&& action) {
+    net::post(strand, std::forward<Action>(action));
+    ioc.restart();
+    ioc.run();
+}
+
+// Выполняет обработчики ioc в отдельном потоке, пока существует
+class BackgroundRunner {
+public:
+    explicit BackgroundRunner(net::io_context& ioc)
+        : ioc_(ioc)
+        , work_(net::make_work_guard(ioc))
+        , thread_([&ioc] {
+            ioc.run();
+        }) {
+    }
+
+    ~BackgroundRunner() {
+        work_.reset();
+        ioc_.stop();
+        thread_.join();
+    }
+
+private:
+    net::io_context& ioc_;
+    net::executor_work_guard<net::io_context::executor_type> work_;
+    std::thread thread_;
+};
+
+http_handler::StringRequest MakeUpgradeRequest() {
+    http_handler::StringRequest req{http::verb::get, "/api/v1/game/ws"s, 11};
+    req.set(http::field::host, "localhost"s);
+    req.set(http::field::upgrade, "websocket"s);
+    req.set(http::field::connection, "upgrade"s);
+    req.set(http::field::sec_websocket_key, "dGhlIHNhbXBsZSBub25jZQ=="s);
+    req.set(http::field::sec_websocket_version, "13"s);
+    return req;
+}
+
+}  // namespace
+
+SCENARIO("Game state frames") {
+    GIVEN("a session after two ticks") {
+        const Map::Id map_id{"map1"s};
+        Game game;
+        game.AddMap(MakeMap(*map_id));
+        game.SetLootGeneratorConfig(loot_gen::LootGenerator::TimeInterval{1000}, 0.0);
+        Players players(game);
+        const auto scooby_id = *players.Add(map_id, "Scooby Doo"s).GetPlayerId();
+        const auto pluto_id = *players.Add(map_id, "Pluto"s).GetPlayerId();
+        const auto hatiko_id = *players.Add(map_id, "Hatiko"s).GetPlayerId();
+        auto session = game.FindSession(map_id);
+        session->CommitTick();
+
+        session->FindDog(scooby_id)->SetSpeed("R"s, 1);
+        session->MarkDogChanged(scooby_id);
+        session->RemoveDog(hatiko_id);
+        session->CommitTick();
+
+        WHEN("a full frame is built") {
+            const auto frame = ParseFrame(http_handler::MakeFullStateFrame(session));
+
+            THEN("it contains every dog and is marked as full") {
+                CHECK(frame.at("full").as_bool());
+                CHECK(frame.at("tick").as_int64() == 2);
+                const auto& dogs = frame.at("players").as_object();
+                CHECK(dogs.size() == 2);
+                CHECK(dogs.contains(std::to_string(scooby_id)));
+                CHECK(dogs.contains(std::to_string(pluto_id)));
+                CHECK(frame.contains("lostObjects"));
+            }
+        }
+
+        WHEN("a delta frame is built") {
+            const auto frame = ParseFrame(http_handler::MakeDeltaStateFrame(session));
+
+            THEN("it contains only the changes of the last tick") {
+                CHECK_FALSE(frame.contains("full"));
+                CHECK(frame.at("tick").as_int64() == 2);
+                const auto& dogs = frame.at("players").as_object();
+                CHECK(dogs.size() == 1);
+                CHECK(dogs.contains(std::to_string(scooby_id)));
+                const auto& removed_dogs = frame.at("removedPlayers").as_array();
+                REQUIRE(removed_dogs.size() == 1);
+                CHECK(removed_dogs.begin()->as_int64() == static_cast<std::int64_t>(hatiko_id));
+            }
+        }
+    }
+}
+
+SCENARIO("Game state hub") {
+    GIVEN("subscribed players on two maps") {
+        // strand хаба должен быть уничтожен раньше ioc
+        net::io_context ioc;
+        Game game;
+        game.AddMap(MakeMap("map1"s));
+        game.AddMap(MakeMap("map2"s));
+        game.SetLootGeneratorConfig(loot_gen::LootGenerator::TimeInterval{1000}, 0.0);
+        Players players(game);
+        PlayerTokens player_tokens;
+        extra::ExtraData extra_data;
+        Application app(game, players, player_tokens, extra_data);
+        auto api_strand = net::make_strand(ioc);
+        auto hub = std::make_shared<GameStateHub>(api_strand, app);
+        app.AddApplicationListener(hub.get());
+
+        const auto scooby = app.JoinGameUseCase("Scooby Doo"s, Map::Id{"map1"s});
+        const auto pluto = app.JoinGameUseCase("Pluto"s, Map::Id{"map1"s});
+        const auto hatiko = app.JoinGameUseCase("Hatiko"s, Map::Id{"map2"s});
+
+        auto scooby_frames = std::make_shared<FrameRecorder>();
+        auto pluto_frames = std::make_shared<FrameRecorder>();
+        auto hatiko_frames = std::make_shared<FrameRecorder>();
+        RunInStrand(ioc, api_strand, [&] {
+            hub->AddSubscriber(scooby_frames, Bearer(scooby.player_token));
+            hub->AddSubscriber(pluto_frames, Bearer(pluto.player_token));
+            hub->AddSubscriber(hatiko_frames, Bearer(hatiko.player_token));
+        });
+
+        const auto tick = [&](std::uint64_t time_delta) {
+            RunInStrand(ioc, api_strand, [&app, time_delta] {
+                app.TickTimeUseCase(time_delta);
+            });
+        };
+        const auto get_subscribers_count = [&] {
+            size_t count = 0;
+            RunInStrand(ioc, api_strand, [&] {
+                count = hub->GetSubscribersCount();
+            });
+            return count;
+        };
+
+        WHEN("the game ticks twice") {
+            app.MovePlayersUseCase(Bearer(scooby.player_token), "R"s);
+            tick(100);
+            tick(100);
+
+            THEN("a subscriber gets a full frame and then a delta frame") {
+                REQUIRE(scooby_frames->frames.size() == 2);
+                const auto full_frame = ParseFrame(*scooby_frames->frames[0]);
+                CHECK(full_frame.at("full").as_bool());
+                CHECK(full_frame.at("players").as_object().size() == 2);
+                const auto delta_frame = ParseFrame(*scooby_frames->frames[1]);
+                CHECK_FALSE(delta_frame.contains("full"));
+                CHECK(delta_frame.at("tick").as_int64() == full_frame.at("tick").as_int64() + 1);
+                CHECK(delta_frame.at("players").as_object().contains(std::to_string(*scooby.player_id)));
+            }
+
+            THEN("frames of a session are built once and shared by its subscribers") {
+                REQUIRE(pluto_frames->frames.size() == 2);
+                CHECK(pluto_frames->frames[0] == scooby_frames->frames[0]);
+                CHECK(pluto_frames->frames[1] == scooby_frames->frames[1]);
+                REQUIRE(hatiko_frames->frames.size() == 2);
+                CHECK(hatiko_frames->frames[0] != scooby_frames->frames[0]);
+                CHECK(scooby_frames->close_calls == 0);
+            }
+        }
+
+        WHEN("a subscription has an unknown or missing token") {
+            auto stranger_frames = std::make_shared<FrameRecorder>();
+            RunInStrand(ioc, api_strand, [&] {
+                CHECK_THROWS_AS(hub->AddSubscriber(stranger_frames, "Bearer "s + std::string(32, '0')), GetGameStateError);
+                CHECK_THROWS_AS(hub->AddSubscriber(stranger_frames, ""s), GetGameStateError);
+            });
+
+            THEN("it is not subscribed") {
+                CHECK(get_subscribers_count() == 3);
+                tick(100);
+                CHECK(stranger_frames->frames.empty());
+            }
+        }
+
+        WHEN("a subscriber is destroyed") {
+            pluto_frames.reset();
+            tick(100);
+
+            THEN("it is removed from the subscribers") {
+                CHECK(get_subscribers_count() == 2);
+                CHECK(scooby_frames->frames.size() == 1);
+                CHECK(hatiko_frames->frames.size() == 1);
+            }
+        }
+
+        WHEN("subscribed players retire") {
+            game.SetDogRetirementTime(1000ms);
+            tick(1500);
+
+            THEN("their subscriptions are closed once and removed") {
+                CHECK(scooby_frames->close_calls == 1);
+                CHECK(pluto_frames->close_calls == 1);
+                CHECK(hatiko_frames->close_calls == 1);
+                CHECK(scooby_frames->frames.empty());
+                CHECK(get_subscribers_count() == 0);
+                tick(100);
+                CHECK(scooby_frames->close_calls == 1);
+            }
+        }
+
+        WHEN("a WebSocket client does not read its frames") {
+            net::ip::tcp::acceptor acceptor(ioc, {net::ip::address_v4::loopback(), 0});
+            net::ip::tcp::socket client(ioc);
+            client.connect(acceptor.local_endpoint());
+            auto ws_session = std::make_shared<WebSocketSession>(acceptor.accept(), hub);
+            const auto frame = std::make_shared<const std::string>("{}"s);
+            // Рукопожатие не начато, поэтому все кадры остаются в очереди соединения
+            for (size_t i = 0; i < GameStateHub::MAX_PENDING_FRAMES; ++i) {
+                ws_session->Send(frame);
+            }
+            ioc.restart();
+            ioc.run();
+
+            THEN("the connection is closed when the queue overflows") {
+                char byte = 0;
+                boost::system::error_code ec;
+                client.non_blocking(true);
+                client.read_some(net::buffer(&byte, 1), ec);
+                CHECK(ec == net::error::would_block);
+
+                ws_session->Send(frame);
+                ioc.restart();
+                ioc.run();
+                client.non_blocking(false);
+                client.read_some(net::buffer(&byte, 1), ec);
+                CHECK(ec == net::error::eof);
+            }
+        }
+    }
+}
+
+SCENARIO("WebSocket session") {
+    GIVEN("an accepted WebSocket connection") {
+        net::io_context ioc;
+        Game game;
+        Players players(game);
+        PlayerTokens player_tokens;
+        extra::ExtraData extra_data;
+        Application app(game, players, player_tokens, extra_data);
+        auto hub = std::make_shared<GameStateHub>(net::make_strand(ioc), app);
+
+        net::ip::tcp::acceptor acceptor(ioc, {net::ip::address_v4::loopback(), 0});
+        net::io_context client_ioc;
+        net::ip::tcp::socket client(client_ioc);
+        client.connect(acceptor.local_endpoint());
+        auto ws_session = std::make_shared<WebSocketSession>(acceptor.accept(), hub);
+        const std::weak_ptr<WebSocketSession> weak_session = ws_session;
+        // Запрос на подключение уже прочитан сервером, клиенту остаётся получить ответ
+        ws_session->Start(MakeUpgradeRequest(), {});
+        BackgroundRunner runner(ioc);
+
+        beast::flat_buffer client_buffer;
+        http::response<http::empty_body> upgrade_response;
+        http::read(client, client_buffer, upgrade_response);
+        REQUIRE(upgrade_response.result() == http::status::switching_protocols);
+
+        WHEN("reading fails while a frame is being written") {
+            // Кадр больше буферов сокета: запись не завершится, пока клиент его не читает
+            auto frame = std::make_shared<const std::string>(32 * 1024 * 1024, 'x');
+            const std::weak_ptr<const std::string> weak_frame = frame;
+            ws_session->Send(std::move(frame));
+            ws_session.reset();
+            // Буферы сокетов заполняются, и запись останавливается. Затем чтение сервера
+            // завершается ошибкой из-за закрытия соединения клиентом на запись
+            std::this_thread::sleep_for(200ms);
+            client.shutdown(net::ip::tcp::socket::shutdown_send);
+            std::this_thread::sleep_for(200ms);
+
+            THEN("the frame stays alive until its write completes and the session is released") {
+                CHECK_FALSE(weak_frame.expired());
+                std::vector<char> data(64 * 1024);
+                boost::system::error_code ec;
+                while (!ec) {
+                    client.read_some(net::buffer(data), ec);
+                }
+                CHECK(ec == net::error::eof);
+                CHECK(weak_frame.expired());
+                CHECK(weak_session.expired());
+            }
+        }
+    }
+}
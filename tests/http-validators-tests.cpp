@@ -0,0 +1,87 @@
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+
+#include "../src/http_validators.h"
+
+using namespace http_handler;
+using namespace std::literals;
+
+SCENARIO("Header values") {
+    THEN("optional whitespace is trimmed") {
+        CHECK(Trim(" \tgzip;q=0.5 "sv) == "gzip;q=0.5"sv);
+        CHECK(Trim("br"sv) == "br"sv);
+        CHECK(Trim(" \t "sv).empty());
+    }
+}
+
+SCENARIO("HTTP dates") {
+    GIVEN("a time") {
+        const std::time_t time = 784111777;
+
+        THEN("it is formatted as IMF-fixdate and parsed back") {
+            CHECK(FormatHttpDate(time) == "Sun, 06 Nov 1994 08:49:37 GMT"s);
+            CHECK(ParseHttpDate("Sun, 06 Nov 1994 08:49:37 GMT"sv) == time);
+        }
+
+        THEN("malformed dates are rejected") {
+            CHECK_FALSE(ParseHttpDate(""sv));
+            CHECK_FALSE(ParseHttpDate("yesterday"sv));
+        }
+    }
+}
+
+SCENARIO("Entity tags") {
+    GIVEN("content") {
+        const auto etag = MakeContentETag("{\"id\":\"map1\"}"sv);
+
+        THEN("the tag is strong and depends on the content") {
+            CHECK(etag.front() == '"');
+            CHECK(etag.back() == '"');
+            CHECK(etag == MakeContentETag("{\"id\":\"map1\"}"sv));
+            CHECK(etag != MakeContentETag("{\"id\":\"map2\"}"sv));
+        }
+
+        THEN("If-None-Match lists are matched with weak comparison") {
+            CHECK(IsETagMatched(etag, etag));
+            CHECK(IsETagMatched("\"other\", "s + etag, etag));
+            CHECK(IsETagMatched("W/"s + etag, etag));
+            CHECK(IsETagMatched("*"sv, etag));
+            CHECK_FALSE(IsETagMatched("\"other\""sv, etag));
+            CHECK_FALSE(IsETagMatched(""sv, etag));
+        }
+    }
+
+    GIVEN("a file modification time and size") {
+        THEN("the tag is built from both") {
+            CHECK(MakeFileETag(0x1f, 0x200) == "\"1f-200\""s);
+        }
+    }
+}
+
+SCENARIO("Conditional requests") {
+    const auto etag = "\"1f-200\""s;
+    const std::time_t last_modified = 784111777;
+
+    WHEN("the request has If-None-Match") {
+        THEN("only the entity tag is checked") {
+            CHECK(IsNotModified({etag, ""sv}, etag, last_modified));
+            CHECK_FALSE(IsNotModified({"\"other\""sv, "Sun, 06 Nov 1994 08:49:37 GMT"sv}, etag, last_modified));
+        }
+    }
+
+    WHEN("the request has only If-Modified-Since") {
+        THEN("the resource is not modified if it is not newer than the date") {
+            CHECK(IsNotModified({""sv, "Sun, 06 Nov 1994 08:49:37 GMT"sv}, etag, last_modified));
+            CHECK(IsNotModified({""sv, "Mon, 07 Nov 1994 08:49:37 GMT"sv}, etag, last_modified));
+            CHECK_FALSE(IsNotModified({""sv, "Sat, 05 Nov 1994 08:49:37 GMT"sv}, etag, last_modified));
+            CHECK_FALSE(IsNotModified({""sv, "garbage"sv}, etag, last_modified));
+            CHECK_FALSE(IsNotModified({""sv, "Sun, 06 Nov 1994 08:49:37 GMT"sv}, etag));
+        }
+    }
+
+    WHEN("the request is not conditional") {
+        THEN("the full response is sent") {
+            CHECK_FALSE(IsNotModified({}, etag, last_modified));
+        }
+    }
+}
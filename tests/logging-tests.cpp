@@ -0,0 +1,219 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <boost/log/sinks/basic_sink_backend.hpp>
+#include <boost/log/sinks/sync_frontend.hpp>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../src/logging.h"
+
+using namespace server_log;
+using namespace std::literals;
+namespace {
+
+namespace sinks = logging::sinks;
+
+// Запоминает записи журнала, чтобы отформатировать их в тесте
+class RecordCollector : public sinks::basic_sink_backend<sinks::synchronized_feeding> {
+public:
+    void consume(const logging::record_view& rec) {
+        records.push_back(rec);
+    }
+
+    std::vector<logging::record_view> records;
+};
+
+struct LogFixture {
+    LogFixture()
+        : sink{boost::make_shared<sinks::synchronous_sink<RecordCollector>>()} {
+        logging::core::get()->add_sink(sink);
+    }
+
+    ~LogFixture() {
+        logging::core::get()->remove_sink(sink);
+    }
+
+    const std::vector<logging::record_view>& Records() const {
+        return sink->locked_backend()->records;
+    }
+
+    boost::shared_ptr<sinks::synchronous_sink<RecordCollector>> sink;
+};
+
+template <typename Formatter>
+std::string Format(Formatter formatter, const logging::record_view& rec) {
+    std::string line;
+    logging::formatting_ostream strm{line};
+    formatter(rec, strm);
+    strm.flush();
+    return line;
+}
+
+boost::posix_time::ptime MakeTime(boost::posix_time::time_duration time_of_day) {
+    return {boost::gregorian::date{2024, 3, 9}, time_of_day};
+}
+
+}  // namespace
+
+SCENARIO_METHOD(LogFixture, "JSON log formatter") {
+    using boost::posix_time::microseconds;
+    using boost::posix_time::time_duration;
+
+    GIVEN("records with different timestamps, data and messages") {
+        const json::value response_data{
+            {"ip"s, "127.0.0.1"s},
+            {"response_time"s, 12},
+            {"code"s, 200},
+            {"content_type"s, nullptr},
+        };
+        const json::value nested_data{
+            {"exception"s, "Tab\tand \"quotes\" \\ /"s},
+            {"values"s, json::array{1, -2, true, 2.5, "\x01"s}},
+            {"empty"s, json::object{}},
+        };
+
+        BOOST_LOG_TRIVIAL(info) << logging::add_value(timestamp, MakeTime(time_duration{9, 5, 7}))
+                                << logging::add_value(additional_data, response_data)
+                                << "response sent"sv;
+        BOOST_LOG_TRIVIAL(info) << logging::add_value(timestamp, MakeTime(microseconds{86399999999}))
+                                << logging::add_value(additional_data, nested_data)
+                                << "line\nbreak \"quoted\" юникод"sv;
+        BOOST_LOG_TRIVIAL(info) << logging::add_value(timestamp, MakeTime(microseconds{7}))
+                                << "no data"sv;
+        REQUIRE(Records().size() == 3);
+
+        THEN("the buffered formatter prints the same lines as MyFormatter") {
+            for (const auto& rec : Records()) {
+                CHECK(Format(&JsonLineFormatter, rec) == Format(&MyFormatter, rec));
+            }
+        }
+
+        THEN("the line is a JSON object with the timestamp, data and message") {
+            CHECK(Format(&JsonLineFormatter, Records().front())
+                  == R"({"timestamp":"2024-03-09T09:05:07","data":{"ip":"127.0.0.1","response_time":12,)"
+                     R"("code":200,"content_type":null},"message":"response sent"})"
+                     "\n"s);
+            CHECK(Format(&JsonLineFormatter, Records().back())
+                  == R"({"timestamp":"2024-03-09T00:00:00.000007","message":"no data"})"
+                     "\n"s);
+        }
+    }
+}
+
+SCENARIO_METHOD(LogFixture, "Request log policy") {
+    GIVEN("route log rules") {
+        const auto state_rule = ParseRouteLogRule("/api/v1/game/state:aggregate"sv);
+        const auto maps_rule = ParseRouteLogRule("/api/v1/maps:sample=3,level=warning"sv);
+        const auto api_rule = ParseRouteLogRule("/api/:sample=2,aggregate"sv);
+
+        THEN("options are parsed") {
+            CHECK(state_rule.prefix == "/api/v1/game/state"s);
+            CHECK(state_rule.aggregate);
+            CHECK(state_rule.sample_rate == 0);
+            CHECK(maps_rule.sample_rate == 3);
+            CHECK(maps_rule.min_severity == Severity::warning);
+            CHECK_FALSE(maps_rule.aggregate);
+            CHECK(api_rule.sample_rate == 2);
+            CHECK(api_rule.aggregate);
+        }
+
+        THEN("wrong rules are rejected") {
+            CHECK_THROWS_AS(ParseRouteLogRule("/api/"sv), std::invalid_argument);
+            CHECK_THROWS_AS(ParseRouteLogRule("/api/:sample=x"sv), std::invalid_argument);
+            CHECK_THROWS_AS(ParseRouteLogRule("/api/:level=loud"sv), std::invalid_argument);
+            CHECK_THROWS_AS(ParseRouteLogRule("/api/:every"sv), std::invalid_argument);
+        }
+
+        WHEN("a policy decides which requests to log") {
+            RequestLogPolicy policy{std::vector<RouteLogRule>{api_rule, state_rule, maps_rule}};
+
+            THEN("the longest matching prefix is used") {
+                CHECK_FALSE(RequestLogPolicy::ShouldLog(policy.Decide("/api/v1/game/state?x=1"sv), Severity::info));
+                CHECK(RequestLogPolicy::ShouldLog(policy.Decide("/index.html"sv), Severity::info));
+
+                const auto first_map = policy.Decide("/api/v1/maps/map1"sv);
+                CHECK_FALSE(RequestLogPolicy::ShouldLog(first_map, Severity::info));
+                CHECK(RequestLogPolicy::ShouldLog(first_map, Severity::error));
+
+                CHECK(RequestLogPolicy::ShouldLog(policy.Decide("/api/v1/game/join"sv), Severity::info));
+                CHECK_FALSE(RequestLogPolicy::ShouldLog(policy.Decide("/api/v1/game/join"sv), Severity::info));
+            }
+
+            THEN("warnings and errors are not dropped by sampling") {
+                const auto first_map = policy.Decide("/api/v1/maps"sv);
+                const auto second_map = policy.Decide("/api/v1/maps"sv);
+                CHECK(first_map.is_sampled);
+                CHECK_FALSE(second_map.is_sampled);
+                CHECK(RequestLogPolicy::ShouldLog(second_map, Severity::warning));
+                CHECK(RequestLogPolicy::ShouldLog(second_map, Severity::error));
+
+                const auto state = policy.Decide("/api/v1/game/state"sv);
+                CHECK_FALSE(RequestLogPolicy::ShouldLog(state, Severity::info));
+                CHECK(RequestLogPolicy::ShouldLog(state, Severity::warning));
+
+                const auto join = policy.Decide("/api/v1/game/join"sv);
+                CHECK(RequestLogPolicy::ShouldLog(join, Severity::info));
+                CHECK_FALSE(RequestLogPolicy::ShouldLog(policy.Decide("/api/v1/game/join"sv), Severity::info));
+            }
+
+            THEN("the severity filter applies to sampled-out warnings") {
+                RequestLogPolicy errors_only{std::vector<RouteLogRule>{ParseRouteLogRule("/api/:sample=2,level=error"sv)}};
+                CHECK_FALSE(RequestLogPolicy::ShouldLog(errors_only.Decide("/api/v1/maps"sv), Severity::warning));
+                const auto sampled_out = errors_only.Decide("/api/v1/maps"sv);
+                CHECK_FALSE(sampled_out.is_sampled);
+                CHECK_FALSE(RequestLogPolicy::ShouldLog(sampled_out, Severity::warning));
+                CHECK(RequestLogPolicy::ShouldLog(sampled_out, Severity::error));
+            }
+
+            THEN("aggregated routes are logged as statistics") {
+                policy.CountResponse(policy.Decide("/api/v1/game/state"sv), 200, 10);
+                policy.CountResponse(policy.Decide("/api/v1/game/state"sv), 401, 30);
+                policy.CountResponse(policy.Decide("/api/v1/maps"sv), 200, 10);
+                policy.FlushStatistics();
+
+                REQUIRE(Records().size() == 1);
+                const json::value expected{
+                    {"route"s, "/api/v1/game/state"s}, {"requests"s, 2},
+                    {"2xx"s, 1}, {"3xx"s, 0}, {"4xx"s, 1}, {"5xx"s, 0},
+                    {"avg_response_time"s, 20}, {"max_response_time"s, 30},
+                };
+                CHECK(*Records().front()[additional_data] == expected);
+
+                policy.FlushStatistics();
+                CHECK(Records().size() == 1);
+            }
+        }
+    }
+}
+
+// Скрыт от обычного запуска, запускается явно: game_server_tests "[benchmark]"
+TEST_CASE_METHOD(LogFixture, "JSON log formatter throughput", "[.][benchmark]") {
+    const json::value response_data{
+        {"ip"s, "192.168.0.15"s},
+        {"response_time"s, 3},
+        {"code"s, 200},
+        {"content_type"s, "application/json"s},
+    };
+    BOOST_LOG_TRIVIAL(info) << logging::add_value(timestamp, boost::posix_time::microsec_clock::local_time())
+                            << logging::add_value(additional_data, response_data)
+                            << "response sent"sv;
+    REQUIRE(Records().size() == 1);
+    const auto& rec = Records().front();
+
+    // Время одной итерации - время форматирования одной записи, записей в секунду - 1 / время
+    std::string line;
+    logging::formatting_ostream strm{line};
+    BENCHMARK("MyFormatter") {
+        line.clear();
+        MyFormatter(rec, strm);
+        strm.flush();
+        return line.size();
+    };
+    BENCHMARK("JsonLineFormatter") {
+        line.clear();
+        JsonLineFormatter(rec, strm);
+        strm.flush();
+        return line.size();
+    };
+}
@@ -84,4 +84,194 @@ SCENARIO("Add loot on map") {
             }
         }
     }
-}
\ No newline at end of file
+}
+// Эталонный поиск: перебираем все дороги карты и проверяем попадание точки в полосу дороги
+bool PointIsOnRoad(const Road& road, double x, double y) {
+    const double min_x = std::min(road.GetStart().x, road.GetEnd().x) - 0.4;
+    const double max_x = std::max(road.GetStart().x, road.GetEnd().x) + 0.4;
+    const double min_y = std::min(road.GetStart().y, road.GetEnd().y) - 0.4;
+    const double max_y = std::max(road.GetStart().y, road.GetEnd().y) + 0.4;
+    return min_x <= x && x <= max_x && min_y <= y && y <= max_y;
+}
+
+SCENARIO("Find road by coordinates") {
+    GIVEN("a map with a grid of roads") {
+        Map::Id map_id("map_1"s);
+        Map test_map(map_id, "Test_map"s);
+        // Сетка из горизонтальных и вертикальных улиц с шагом 20, часть дорог задана "задом наперёд"
+        for(int i = 0; i <= 100; i += 20) {
+            if(i % 40 == 0) {
+                test_map.AddRoad(Road(Road::HORIZONTAL, {0, i}, 100));
+                test_map.AddRoad(Road(Road::VERTICAL, {i, 0}, 100));
+            } else {
+                test_map.AddRoad(Road(Road::HORIZONTAL, {100, i}, 0));
+                test_map.AddRoad(Road(Road::VERTICAL, {i, 100}, 0));
+            }
+        }
+
+        WHEN("points are looked up") {
+            THEN("the found road is the one the point lies on") {
+                for(double x = -1.0; x <= 101.0; x += 0.1) {
+                    for(int row = 0; row <= 100; row += 20) {
+                        for(double y : {row - 0.5, row - 0.4, row - 0.1, row + 0.0, row + 0.3, row + 0.4, row + 0.6}) {
+                            const Road* expected_hor = nullptr;
+                            for(const auto& road : test_map.GetRoads()) {
+                                if(road.IsHorizontal() && PointIsOnRoad(road, x, y)) {
+                                    expected_hor = &road;
+                                }
+                            }
+                            INFO("x: " << x << ", y: " << y);
+                            const Road* hor_road = test_map.FindHorRoad(x, y);
+                            const Road* vert_road = test_map.FindVertRoad(y, x);
+                            REQUIRE((hor_road == nullptr) == (expected_hor == nullptr));
+                            if(hor_road != nullptr) {
+                                CHECK(hor_road->GetStart().y == expected_hor->GetStart().y);
+                                CHECK(hor_road->IsHorizontal());
+                            }
+                            // Сетка симметрична, поэтому вертикальные дороги проверяем в транспонированной точке
+                            REQUIRE((vert_road == nullptr) == (expected_hor == nullptr));
+                            if(vert_road != nullptr) {
+                                CHECK(vert_road->GetStart().x == expected_hor->GetStart().y);
+                                CHECK(vert_road->IsVertical());
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+SCENARIO("Road location caching") {
+    GIVEN("a map with crossing and overlapping roads") {
+        Map::Id map_id("map_1"s);
+        Map test_map(map_id, "Test_map"s);
+        test_map.AddRoad(Road(Road::HORIZONTAL, {0, 0}, 40));
+        test_map.AddRoad(Road(Road::VERTICAL, {40, 0}, 30));
+        test_map.AddRoad(Road(Road::HORIZONTAL, {40, 30}, 0));
+        test_map.AddRoad(Road(Road::VERTICAL, {0, 0}, 30));
+        test_map.AddRoad(Road(Road::VERTICAL, {20, -10}, 10));
+        test_map.AddRoad(Road(Road::HORIZONTAL, {30, 0}, 50));
+
+        THEN("junctions graph links crossing roads") {
+            const auto& node = test_map.GetRoadNode(0);
+            CHECK(node.adjacent_roads.size() == 4);
+            CHECK(std::is_sorted(node.junctions.begin(), node.junctions.end()));
+        }
+
+        WHEN("points are located") {
+            THEN("cached bounds give the same roads as a direct lookup") {
+                for(double x = -1.0; x <= 51.0; x += 0.05) {
+                    for(double y : {-0.5, -0.4, 0.0, 0.2, 0.4, 5.0, 29.7, 30.0}) {
+                        const auto location = test_map.LocateRoads(x, y);
+                        INFO("x: " << x << ", y: " << y);
+                        REQUIRE(location.hor_road == test_map.FindHorRoad(x, y));
+                        REQUIRE(location.vert_road == test_map.FindVertRoad(x, y));
+                        REQUIRE(location.bounds.IsInside({x, y}));
+                        const auto& bounds = location.bounds;
+                        for(double bx : {bounds.left_x_, (bounds.left_x_ + bounds.right_x_) / 2, bounds.right_x_}) {
+                            for(double by : {bounds.up_y_, (bounds.up_y_ + bounds.down_y_) / 2, bounds.down_y_}) {
+                                CHECK(test_map.FindHorRoad(bx, by) == location.hor_road);
+                                CHECK(test_map.FindVertRoad(bx, by) == location.vert_road);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+SCENARIO("Session changes tracking") {
+    GIVEN("a game session with two dogs") {
+        Map::Id map_id("map_1"s);
+        Map test_map(map_id, "Test_map"s);
+        test_map.AddRoad(Road(model::Road::HORIZONTAL, {0, 0}, 30));
+        test_map.SetLootTypeCount(1);
+
+        lootGeneratorConfig loot_conf{TimeInterval{1000}, 1.0};
+        GameSession session(&test_map, false, loot_conf);
+        const auto dog0 = session.AddDog("Scooby Doo"s);
+        const auto dog1 = session.AddDog("Muhtar"s);
+        session.CommitTick();
+
+        THEN("new dogs are reported as changed") {
+            CHECK(session.GetTick() == 1);
+            const auto changes = session.GetChangesSince(0);
+            REQUIRE(changes.has_value());
+            CHECK(changes->changed_dogs == std::set<std::uint64_t>{dog0, dog1});
+            CHECK(changes->changed_loots.empty());
+        }
+
+        THEN("there are no changes since the current tick") {
+            const auto changes = session.GetChangesSince(1);
+            REQUIRE(changes.has_value());
+            CHECK(changes->changed_dogs.empty());
+            CHECK_FALSE(session.GetChangesSince(2).has_value());
+        }
+
+        WHEN("loot is generated and collected") {
+            session.AddLoot(TimeInterval{10000});
+            session.CommitTick();
+            REQUIRE(session.GetLoots().size() == 2);
+            std::set<std::uint64_t> loot_ids;
+            for(const auto& loot : session.GetLoots()) {
+                loot_ids.insert(loot.first);
+            }
+            const auto loot_changes = session.GetChangesSince(1);
+            REQUIRE(loot_changes.has_value());
+            CHECK(loot_changes->changed_loots == loot_ids);
+            CHECK(loot_changes->changed_dogs.empty());
+
+            // Первый пёс проходит через трофеи, второй стоит на месте
+            session.HandleEvents({{{0.0, 0.0}, {2.0, 0.0}, 0.3}, {{0.0, 0.0}, {0.0, 0.0}, 0.3}});
+            session.CommitTick();
+
+            THEN("collected loot is removed and the dog is changed") {
+                CHECK(session.GetLoots().empty());
+                const auto changes = session.GetChangesSince(2);
+                REQUIRE(changes.has_value());
+                CHECK(changes->changed_dogs == std::set<std::uint64_t>{dog0});
+                CHECK(changes->removed_loots == loot_ids);
+            }
+
+            THEN("loot created and removed in the requested range is only reported as removed") {
+                const auto changes = session.GetChangesSince(0);
+                REQUIRE(changes.has_value());
+                CHECK(changes->changed_loots.empty());
+                CHECK(changes->removed_loots == loot_ids);
+            }
+        }
+
+        THEN("the state version changes only when dogs or loot change") {
+            const auto state_version = session.GetStateVersion();
+            session.CommitTick();
+            CHECK(session.GetStateVersion() == state_version);
+            session.MarkDogChanged(dog0);
+            CHECK(session.GetStateVersion() != state_version);
+        }
+
+        WHEN("a dog is removed") {
+            session.RemoveDog(dog1);
+            session.CommitTick();
+
+            THEN("it is reported as removed") {
+                const auto changes = session.GetChangesSince(0);
+                REQUIRE(changes.has_value());
+                CHECK(changes->changed_dogs == std::set<std::uint64_t>{dog0});
+                CHECK(changes->removed_dogs == std::set<std::uint64_t>{dog1});
+            }
+        }
+
+        WHEN("more ticks pass than the history holds") {
+            for(size_t i = 0; i < GameSession::MAX_CHANGES_HISTORY; ++i) {
+                session.CommitTick();
+            }
+
+            THEN("old changes are no longer available") {
+                CHECK_FALSE(session.GetChangesSince(0).has_value());
+                CHECK(session.GetChangesSince(1).has_value());
+            }
+        }
+    }
+}
@@ -0,0 +1,116 @@
+#include <catch2/catch_test_macros.hpp>
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/app.h"
+
+using namespace app;
+using namespace std::literals;
+
+SCENARIO("Player tokens") {
+    GIVEN("players on two maps") {
+        const model::Map::Id map_id{"map1"s};
+        const model::Map::Id other_map_id{"map2"s};
+        Player scooby("Scooby Doo"s, 0, map_id);
+        Player hatiko("Hatiko"s, 0, other_map_id);
+        PlayerTokens player_tokens;
+        const auto scooby_token = player_tokens.AddPlayer(scooby);
+        const auto hatiko_token = player_tokens.AddPlayer(hatiko);
+
+        THEN("players and tokens are found in both directions") {
+            CHECK((*scooby_token).size() == 32);
+            CHECK(scooby_token != hatiko_token);
+            CHECK(player_tokens.FindPlayerByToken(scooby_token) == &scooby);
+            CHECK(player_tokens.FindPlayerByToken(hatiko_token) == &hatiko);
+            CHECK(player_tokens.FindTokenByPlayer(scooby.GetPlayerId(), map_id) == scooby_token);
+            CHECK(player_tokens.FindTokenByPlayer(hatiko.GetPlayerId(), other_map_id) == hatiko_token);
+            CHECK(player_tokens.FindPlayerByToken(Token{"00000000000000000000000000000000"s}) == nullptr);
+
+            std::string name;
+            CHECK(player_tokens.VisitPlayerByToken(scooby_token, [&name](const Player& player) {
+                name = player.GetName();
+            }));
+            CHECK(name == "Scooby Doo"s);
+            CHECK(player_tokens.GetTokens().size() == 2);
+        }
+
+        THEN("all tokens are visited without copying the index") {
+            std::map<std::string, const Player*> visited;
+            player_tokens.ForEachToken([&visited](const Token& token, const Player& player) {
+                visited.emplace(*token, &player);
+            });
+            CHECK(visited == std::map<std::string, const Player*>{{*scooby_token, &scooby}, {*hatiko_token, &hatiko}});
+        }
+
+        WHEN("a player is removed") {
+            player_tokens.RemovePlayer(scooby.GetPlayerId(), map_id);
+
+            THEN("only the token of this player is removed") {
+                CHECK(player_tokens.FindPlayerByToken(scooby_token) == nullptr);
+                CHECK_FALSE(player_tokens.FindTokenByPlayer(scooby.GetPlayerId(), map_id));
+                CHECK(player_tokens.FindPlayerByToken(hatiko_token) == &hatiko);
+                CHECK(player_tokens.GetTokens().size() == 1);
+            }
+        }
+
+        WHEN("a player gets another token") {
+            const Token restored_token{"0123456789abcdef0123456789abcdef"s};
+            player_tokens.AddToken(restored_token, scooby);
+
+            THEN("the previous token is no longer valid") {
+                CHECK(player_tokens.FindPlayerByToken(scooby_token) == nullptr);
+                CHECK(player_tokens.FindPlayerByToken(restored_token) == &scooby);
+                CHECK(player_tokens.FindTokenByPlayer(scooby.GetPlayerId(), map_id) == restored_token);
+            }
+        }
+
+        WHEN("tokens are replaced") {
+            PlayerTokens::TokenToPlayerPtr tokens{{scooby_token, &scooby}};
+            player_tokens.SetTokens(std::move(tokens));
+
+            THEN("both indexes are rebuilt") {
+                CHECK(player_tokens.FindPlayerByToken(hatiko_token) == nullptr);
+                CHECK_FALSE(player_tokens.FindTokenByPlayer(hatiko.GetPlayerId(), other_map_id));
+                CHECK(player_tokens.FindTokenByPlayer(scooby.GetPlayerId(), map_id) == scooby_token);
+            }
+        }
+
+        WHEN("tokens are checked while other players join and retire") {
+            constexpr int readers_count = 4;
+            constexpr std::uint64_t joins_count = 2000;
+            std::vector<Player> joined;
+            joined.reserve(joins_count);
+            for(std::uint64_t i = 0; i < joins_count; ++i) {
+                joined.emplace_back("Dog"s, i + 1, map_id);
+            }
+            std::atomic_bool is_done = false;
+            std::atomic_int failed_lookups = 0;
+            std::vector<std::thread> readers;
+            for(int i = 0; i < readers_count; ++i) {
+                readers.emplace_back([&] {
+                    while(!is_done) {
+                        if(player_tokens.FindPlayerByToken(scooby_token) != &scooby) {
+                            ++failed_lookups;
+                        }
+                    }
+                });
+            }
+            for(auto& player : joined) {
+                player_tokens.AddPlayer(player);
+                player_tokens.RemovePlayer(player.GetPlayerId(), map_id);
+            }
+            is_done = true;
+            for(auto& reader : readers) {
+                reader.join();
+            }
+
+            THEN("lookups of other tokens are not affected") {
+                CHECK(failed_lookups == 0);
+                CHECK(player_tokens.GetTokens().size() == 2);
+            }
+        }
+    }
+}
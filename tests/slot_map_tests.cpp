@@ -0,0 +1,89 @@
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+
+#include "../src/slot_map.h"
+
+using namespace std::literals;
+
+SCENARIO("Slot map") {
+    using util::SlotMap;
+
+    GIVEN("an empty slot map") {
+        SlotMap<std::string> slot_map;
+
+        THEN("it has no elements") {
+            CHECK(slot_map.empty());
+            CHECK(slot_map.size() == 0);
+            CHECK(slot_map.begin() == slot_map.end());
+            CHECK(slot_map.find(0) == slot_map.end());
+        }
+
+        WHEN("elements are inserted") {
+            const auto id0 = slot_map.insert("Scooby Doo"s);
+            const auto id1 = slot_map.insert("Muhtar"s);
+            const auto id2 = slot_map.insert("Hatiko"s);
+
+            THEN("ids are sequential until a slot is reused") {
+                CHECK(id0 == 0);
+                CHECK(id1 == 1);
+                CHECK(id2 == 2);
+                CHECK(slot_map.size() == 3);
+                CHECK(slot_map.at(id1) == "Muhtar"s);
+            }
+
+            THEN("elements are iterated in insertion order") {
+                auto it = slot_map.begin();
+                CHECK(it->first == id0);
+                CHECK((++it)->first == id1);
+                CHECK((++it)->first == id2);
+            }
+
+            AND_WHEN("an element is erased") {
+                CHECK(slot_map.erase(id0) == 1);
+
+                THEN("other ids remain valid") {
+                    CHECK(slot_map.size() == 2);
+                    CHECK_FALSE(slot_map.contains(id0));
+                    CHECK(slot_map.at(id1) == "Muhtar"s);
+                    CHECK(slot_map.at(id2) == "Hatiko"s);
+                    CHECK_THROWS_AS(slot_map.at(id0), std::out_of_range);
+                    CHECK(slot_map.erase(id0) == 0);
+                }
+
+                THEN("the reused slot gets a new id") {
+                    const auto id3 = slot_map.insert("Rex"s);
+                    CHECK(id3 != id0);
+                    CHECK(static_cast<std::uint32_t>(id3) == static_cast<std::uint32_t>(id0));
+                    CHECK_FALSE(slot_map.contains(id0));
+                    CHECK(slot_map.at(id3) == "Rex"s);
+                    CHECK(slot_map.size() == 3);
+                }
+            }
+        }
+
+        WHEN("elements are restored with known ids") {
+            const SlotMap<std::string>::Id restored_id = (1ULL << 32) | 3;
+            CHECK(slot_map.try_emplace(restored_id, "Rex"s).second);
+            CHECK(slot_map.try_emplace(1, "Muhtar"s).second);
+
+            THEN("they are found by these ids") {
+                CHECK(slot_map.size() == 2);
+                CHECK(slot_map.at(restored_id) == "Rex"s);
+                CHECK(slot_map.at(1) == "Muhtar"s);
+                CHECK_FALSE(slot_map.try_emplace(1, "Hatiko"s).second);
+                CHECK(slot_map.at(1) == "Muhtar"s);
+            }
+
+            THEN("new elements take the missing slots") {
+                const auto id0 = slot_map.insert("Scooby Doo"s);
+                const auto id2 = slot_map.insert("Hatiko"s);
+                CHECK(id0 != restored_id);
+                CHECK(id0 != 1);
+                CHECK(id2 != restored_id);
+                CHECK(id2 != 1);
+                CHECK(id0 != id2);
+                CHECK(slot_map.size() == 4);
+            }
+        }
+    }
+}
@@ -1,12 +1,19 @@
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/archive/text_oarchive.hpp>
 #include <catch2/catch_test_macros.hpp>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <deque>
+#include <filesystem>
+#include <fstream>
 #include <sstream>
 
 #include "../src/model.h"
 #include "../src/model_serialization.h"
 #include "../src/app.h"
 #include "../src/app_serialization.h"
+#include "../src/state_file.h"
+#include "../src/infrastructure.h"
 
 using namespace model;
 using namespace app;
@@ -21,6 +28,25 @@ struct Fixture {
     OutputArchive output_archive{strm};
 };
 
+// Номер контрольной точки, с которого начинается журнал
+std::uint64_t ReadJournalCheckpointId(const std::filesystem::path& journal_path) {
+    std::ifstream in{journal_path, std::ios_base::binary};
+    std::uint64_t checkpoint_id = 0;
+    in.read(reinterpret_cast<char*>(&checkpoint_id), sizeof(checkpoint_id));
+    return checkpoint_id;
+}
+
+// Дожидается завершения процесса, оставляя его статус SerializationListener
+void WaitForExit(pid_t pid) {
+    siginfo_t info{};
+    waitid(P_PID, pid, &info, WEXITED | WNOWAIT);
+}
+
+bool IsRunning(pid_t pid) {
+    siginfo_t info{};
+    return waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0 && info.si_pid == 0;
+}
+
 }  // namespace
 
 // SCENARIO_METHOD(Fixture, "Point serialization") {
@@ -234,4 +260,512 @@ SCENARIO_METHOD(Fixture, "PlayerTokens Serialization") {
             }
         }
     }
-}
\ No newline at end of file
+}
+SCENARIO_METHOD(Fixture, "Journal record Serialization") {
+    GIVEN("a game with session and a copy of it saved before the last tick") {
+        using TimeInterval = loot_gen::LootGenerator::TimeInterval;
+
+        Map::Id map_id("map_1"s);
+        Map test_map(map_id, "Test_map"s);
+        test_map.AddRoad(Road(model::Road::HORIZONTAL, {0, 0}, 30));
+        test_map.SetLootTypeCount(6);
+        test_map.SetDogSpeed(3.0);
+
+        Game game;
+        game.AddMap(test_map);
+        game.SetLootGeneratorConfig(TimeInterval{1000}, 0.8);
+        game.AddSession(GameSession{game.FindMap(map_id), game.GetRandomize(), game.GetLootGeneratorConfig()});
+        auto session = game.FindSession(map_id);
+        Players players(game);
+        PlayerTokens player_tokens;
+        const auto scooby_id = session->AddDog("Scooby Doo");
+        const auto hatiko_id = session->AddDog("Hatiko");
+        session->CommitTick();
+
+        Game saved_game = game;
+        Players saved_players(saved_game);
+
+        const auto pluto_id = session->AddDog("Pluto");
+        auto& pluto = players.Insert(Player("Pluto"s, pluto_id, map_id));
+        const auto pluto_token = player_tokens.AddPlayer(pluto);
+        session->RemoveDog(scooby_id);
+        session->FindDog(hatiko_id)->AddScore(12);
+        session->MarkDogChanged(hatiko_id);
+        session->AddLoot(TimeInterval{5000});
+        session->CommitTick();
+
+        WHEN("changes since the saved tick are serialized") {
+            {
+                serialization::JournalRecordRepr record;
+                record.AddSessionChanges(*session, *session->GetChangesSince(1));
+                record.AddJoinedPlayer(pluto_token, pluto);
+                output_archive << record;
+            }
+
+            THEN("they bring the saved copy to the current state") {
+                InputArchive input_archive{strm};
+                serialization::JournalRecordRepr record;
+                input_archive >> record;
+                PlayerTokens saved_tokens;
+                record.Apply(saved_game, saved_players, saved_tokens);
+
+                const auto& restored = *saved_game.FindSession(map_id);
+                CHECK(restored.GetDogsIndex() == session->GetDogsIndex());
+                REQUIRE(restored.GetDogs().size() == session->GetDogs().size());
+                for(const auto& [dog_id, dog] : session->GetDogs()) {
+                    REQUIRE(restored.GetDogs().contains(dog_id));
+                    CHECK(restored.GetDogs().at(dog_id) == dog);
+                }
+                REQUIRE(restored.GetLoots().size() == session->GetLoots().size());
+                for(const auto& [loot_id, loot] : session->GetLoots()) {
+                    REQUIRE(restored.GetLoots().contains(loot_id));
+                    CHECK(restored.GetLoots().at(loot_id) == loot);
+                }
+                const auto restored_player = saved_tokens.FindPlayerByToken(pluto_token);
+                REQUIRE(restored_player != nullptr);
+                CHECK(restored_player->GetName() == "Pluto"s);
+                CHECK(*(restored_player->GetPlayerId()) == pluto_id);
+            }
+        }
+    }
+}
+SCENARIO("State file") {
+    GIVEN("a game with session, players and tokens") {
+        using TimeInterval = loot_gen::LootGenerator::TimeInterval;
+
+        Map::Id map_id("map_1"s);
+        Map test_map(map_id, "Test_map"s);
+        test_map.AddRoad(Road(model::Road::HORIZONTAL, {0, 0}, 30));
+        test_map.SetLootTypeCount(6);
+        test_map.SetDogSpeed(3.0);
+
+        Game game;
+        game.AddMap(test_map);
+        game.SetLootGeneratorConfig(TimeInterval{1000}, 0.8);
+        Players players(game);
+        PlayerTokens player_tokens;
+        auto& scooby = players.Add(map_id, "Scooby Doo"s);
+        const auto scooby_token = player_tokens.AddPlayer(scooby);
+        auto& hatiko = players.Add(map_id, "Hatiko"s);
+        player_tokens.AddPlayer(hatiko);
+        auto session = game.FindSession(map_id);
+        auto scooby_dog = session->FindDog(*scooby.GetPlayerId());
+        scooby_dog->SetSpeed("R"s, 3);
+        scooby_dog->AddScore(48);
+        scooby_dog->PutLootInTheBag(7, Loot(2, {1.0, 0.0}));
+        scooby_dog->PutLootInTheBag(9, Loot(5, {1.0, 0.0}));
+        session->AddLoot(TimeInterval{5000});
+
+        const auto path = std::filesystem::temp_directory_path() / "state-file-test.bin";
+        state_file::Save(path, game, players, player_tokens, {3, 128});
+
+        WHEN("the file is loaded into a fresh game") {
+            Game restored_game;
+            restored_game.AddMap(test_map);
+            restored_game.SetLootGeneratorConfig(TimeInterval{1000}, 0.8);
+            Players restored_players(restored_game);
+            PlayerTokens restored_tokens;
+            REQUIRE(state_file::IsStateFile(path));
+            const auto info = state_file::Load(path, restored_game, restored_players, restored_tokens);
+
+            THEN("sessions, players and tokens are restored") {
+                CHECK(info.checkpoint_id == 3);
+                CHECK(info.journal_offset == 128);
+                const auto restored = restored_game.FindSession(map_id);
+                REQUIRE(restored != nullptr);
+                CHECK(restored->GetDogsIndex() == session->GetDogsIndex());
+                CHECK(restored->GetLootsIndex() == session->GetLootsIndex());
+                REQUIRE(restored->GetDogs().size() == session->GetDogs().size());
+                for(const auto& [dog_id, dog] : session->GetDogs()) {
+                    CHECK(restored->GetDogs().at(dog_id) == dog);
+                }
+                REQUIRE(restored->GetLoots().size() == session->GetLoots().size());
+                for(const auto& [loot_id, loot] : session->GetLoots()) {
+                    CHECK(restored->GetLoots().at(loot_id) == loot);
+                }
+                CHECK(restored_players.GetPlayers().size() == 2);
+                CHECK(restored_tokens.GetTokens().size() == 2);
+                const auto player = restored_tokens.FindPlayerByToken(scooby_token);
+                REQUIRE(player != nullptr);
+                CHECK(player->GetName() == "Scooby Doo"s);
+                CHECK(player->GetPlayerId() == scooby.GetPlayerId());
+            }
+        }
+
+        WHEN("the file is corrupted") {
+            {
+                std::fstream file{path, std::ios_base::binary | std::ios_base::in | std::ios_base::out};
+                file.seekp(-1, std::ios_base::end);
+                file.put('\xff');
+            }
+            THEN("loading fails") {
+                Game restored_game;
+                restored_game.AddMap(test_map);
+                Players restored_players(restored_game);
+                PlayerTokens restored_tokens;
+                CHECK_THROWS_AS(state_file::Load(path, restored_game, restored_players, restored_tokens), std::runtime_error);
+            }
+        }
+
+        WHEN("the state is saved as a boost archive") {
+            {
+                std::ofstream out{path, std::ios_base::binary | std::ios_base::trunc};
+                boost::archive::text_oarchive ar{out};
+                serialization::SessionsRepr sessions_repr(game.GetSessions());
+                ar << sessions_repr;
+            }
+            THEN("it is not taken for the new format") {
+                CHECK_FALSE(state_file::IsStateFile(path));
+            }
+        }
+        std::filesystem::remove(path);
+    }
+}
+SCENARIO("Incremental state saving") {
+    GIVEN("a game saved incrementally while snapshot processes cannot be started") {
+        using TimeInterval = loot_gen::LootGenerator::TimeInterval;
+        constexpr std::uint64_t JOURNAL_HEADER_SIZE = sizeof(std::uint64_t);
+
+        Map::Id map_id("map_1"s);
+        Map test_map(map_id, "Test_map"s);
+        test_map.AddRoad(Road(model::Road::HORIZONTAL, {0, 0}, 30));
+        test_map.SetLootTypeCount(6);
+        test_map.SetDogSpeed(3.0);
+
+        Game game;
+        game.AddMap(test_map);
+        game.SetLootGeneratorConfig(TimeInterval{1000}, 0.8);
+        Players players(game);
+        PlayerTokens player_tokens;
+        auto& scooby = players.Add(map_id, "Scooby Doo"s);
+        player_tokens.AddPlayer(scooby);
+        auto session = game.FindSession(map_id);
+
+        const auto path = std::filesystem::temp_directory_path() / "incremental-state-test.bin";
+        const auto journal_path = path.string() + ".journal"s;
+        std::filesystem::remove(path);
+        std::filesystem::remove(journal_path);
+
+        // Снимки пишутся синхронно, как при неудачном fork
+        int fork_calls = 0;
+        infra::SerializationListener listener(game, players, player_tokens);
+        listener.SetPathToStateFile(path);
+        listener.SetIncremental(true);
+        listener.SetForker([&fork_calls] {
+            ++fork_calls;
+            errno = EAGAIN;
+            return pid_t{-1};
+        });
+
+        const auto load_state = [&](Game& restored_game, Players& restored_players, PlayerTokens& restored_tokens) {
+            restored_game.AddMap(test_map);
+            restored_game.SetLootGeneratorConfig(TimeInterval{1000}, 0.8);
+            infra::SerializationListener loader(restored_game, restored_players, restored_tokens);
+            loader.SetPathToStateFile(path);
+            return loader.LoadState();
+        };
+
+        listener.OnTick(0ms);
+
+        THEN("the first save writes a checkpoint and starts its journal") {
+            CHECK(fork_calls == 1);
+            Game restored_game;
+            Players restored_players(restored_game);
+            PlayerTokens restored_tokens;
+            restored_game.AddMap(test_map);
+            const auto info = state_file::Load(path, restored_game, restored_players, restored_tokens);
+            CHECK(info.checkpoint_id == 1);
+            CHECK(info.journal_offset == JOURNAL_HEADER_SIZE);
+            CHECK(ReadJournalCheckpointId(journal_path) == 1);
+            CHECK(std::filesystem::file_size(journal_path) == JOURNAL_HEADER_SIZE);
+        }
+
+        WHEN("changes are saved after a tick") {
+            auto& pluto = players.Add(map_id, "Pluto"s);
+            const auto pluto_token = player_tokens.AddPlayer(pluto);
+            session->FindDog(*scooby.GetPlayerId())->AddScore(12);
+            session->MarkDogChanged(*scooby.GetPlayerId());
+            session->CommitTick();
+            listener.OnTick(0ms);
+
+            THEN("they are appended to the journal without a new checkpoint") {
+                CHECK(fork_calls == 1);
+                CHECK(ReadJournalCheckpointId(journal_path) == 1);
+                CHECK(std::filesystem::file_size(journal_path) > JOURNAL_HEADER_SIZE);
+            }
+
+            THEN("the checkpoint with the journal restores the state") {
+                Game restored_game;
+                Players restored_players(restored_game);
+                PlayerTokens restored_tokens;
+                REQUIRE(load_state(restored_game, restored_players, restored_tokens));
+                const auto restored = restored_game.FindSession(map_id);
+                REQUIRE(restored != nullptr);
+                REQUIRE(restored->GetDogs().size() == 2);
+                for(const auto& [dog_id, dog] : session->GetDogs()) {
+                    CHECK(restored->GetDogs().at(dog_id) == dog);
+                }
+                const auto player = restored_tokens.FindPlayerByToken(pluto_token);
+                REQUIRE(player != nullptr);
+                CHECK(player->GetName() == "Pluto"s);
+            }
+
+            AND_WHEN("the change history no longer covers the saved tick") {
+                const auto journal_size = std::filesystem::file_size(journal_path);
+                for(size_t i = 0; i <= GameSession::MAX_CHANGES_HISTORY; ++i) {
+                    session->CommitTick();
+                }
+                session->FindDog(*pluto.GetPlayerId())->AddScore(7);
+                session->MarkDogChanged(*pluto.GetPlayerId());
+                session->CommitTick();
+                listener.OnTick(0ms);
+
+                THEN("a new checkpoint remembers the journal position and the journal is rotated") {
+                    CHECK(fork_calls == 2);
+                    Game restored_game;
+                    Players restored_players(restored_game);
+                    PlayerTokens restored_tokens;
+                    restored_game.AddMap(test_map);
+                    const auto info = state_file::Load(path, restored_game, restored_players, restored_tokens);
+                    CHECK(info.checkpoint_id == 2);
+                    CHECK(info.journal_offset == journal_size);
+                    CHECK(ReadJournalCheckpointId(journal_path) == 2);
+                    CHECK(std::filesystem::file_size(journal_path) == JOURNAL_HEADER_SIZE);
+                }
+
+                THEN("the new checkpoint restores the state") {
+                    Game restored_game;
+                    Players restored_players(restored_game);
+                    PlayerTokens restored_tokens;
+                    REQUIRE(load_state(restored_game, restored_players, restored_tokens));
+                    const auto restored = restored_game.FindSession(map_id);
+                    REQUIRE(restored != nullptr);
+                    CHECK(restored->GetDogs().at(*pluto.GetPlayerId()) == session->GetDogs().at(*pluto.GetPlayerId()));
+                    CHECK(restored_tokens.FindPlayerByToken(pluto_token) != nullptr);
+                }
+            }
+        }
+        std::filesystem::remove(path);
+        std::filesystem::remove(journal_path);
+    }
+}
+SCENARIO("Incremental saving after missed ticks") {
+    GIVEN("a game saved incrementally with snapshot processes controlled by the test") {
+        using TimeInterval = loot_gen::LootGenerator::TimeInterval;
+
+        Map::Id map_id("map_1"s);
+        Map test_map(map_id, "Test_map"s);
+        test_map.AddRoad(Road(model::Road::HORIZONTAL, {0, 0}, 30));
+        test_map.SetDogSpeed(3.0);
+
+        Game game;
+        game.AddMap(test_map);
+        game.SetLootGeneratorConfig(TimeInterval{1000}, 0.0);
+        Players players(game);
+        PlayerTokens player_tokens;
+        auto& scooby = players.Add(map_id, "Scooby Doo"s);
+        player_tokens.AddPlayer(scooby);
+        auto session = game.FindSession(map_id);
+
+        const auto path = std::filesystem::temp_directory_path() / "missed-ticks-state-test.bin";
+        const auto journal_path = path.string() + ".journal"s;
+        std::filesystem::remove(path);
+        std::filesystem::remove(journal_path);
+
+        // Процессы снимков создаются по очереди forks, без неё снимок пишется синхронно
+        std::deque<std::function<pid_t()>> forks;
+        infra::SerializationListener listener(game, players, player_tokens);
+        listener.SetPathToStateFile(path);
+        listener.SetIncremental(true);
+        listener.SetForker([&forks] {
+            if(forks.empty()) {
+                errno = EAGAIN;
+                return pid_t{-1};
+            }
+            const auto forker = std::move(forks.front());
+            forks.pop_front();
+            return forker();
+        });
+
+        // Игрок присоединяется, а сессия выполняет больше тиков, чем хранит её история
+        const auto miss_ticks = [&] {
+            auto& pluto = players.Add(map_id, "Pluto"s);
+            const auto pluto_token = player_tokens.AddPlayer(pluto);
+            for(size_t i = 0; i <= GameSession::MAX_CHANGES_HISTORY; ++i) {
+                session->CommitTick();
+            }
+            return pluto_token;
+        };
+        const auto load_checkpoint_id = [&] {
+            Game restored_game;
+            restored_game.AddMap(test_map);
+            Players restored_players(restored_game);
+            PlayerTokens restored_tokens;
+            return state_file::Load(path, restored_game, restored_players, restored_tokens).checkpoint_id;
+        };
+        const auto check_restored_player = [&](const Token& token) {
+            Game restored_game;
+            restored_game.AddMap(test_map);
+            restored_game.SetLootGeneratorConfig(TimeInterval{1000}, 0.0);
+            Players restored_players(restored_game);
+            PlayerTokens restored_tokens;
+            infra::SerializationListener loader(restored_game, restored_players, restored_tokens);
+            loader.SetPathToStateFile(path);
+            REQUIRE(loader.LoadState());
+            const auto player = restored_tokens.FindPlayerByToken(token);
+            REQUIRE(player != nullptr);
+            CHECK(player->GetName() == "Pluto"s);
+            const auto restored = restored_game.FindSession(map_id);
+            REQUIRE(restored != nullptr);
+            CHECK(restored->GetDogs().size() == 2);
+            CHECK(restored_players.GetPlayers().size() == 2);
+        };
+
+        WHEN("ticks are missed while the first snapshot is being written") {
+            int pipe_fds[2];
+            REQUIRE(pipe(pipe_fds) == 0);
+            pid_t child = -1;
+            // Процесс снимка ждёт разрешения теста
+            forks.push_back([&] {
+                child = fork();
+                if(child == 0) {
+                    char byte = 0;
+                    [[maybe_unused]] const auto bytes_read = read(pipe_fds[0], &byte, 1);
+                }
+                return child;
+            });
+            listener.OnTick(0ms);
+            const auto pluto_token = miss_ticks();
+            listener.OnTick(0ms);
+
+            THEN("saving does not wait for the running snapshot") {
+                CHECK(IsRunning(child));
+                CHECK_FALSE(std::filesystem::exists(path));
+            }
+
+            AND_WHEN("the running snapshot finishes") {
+                REQUIRE(write(pipe_fds[1], "x", 1) == 1);
+                WaitForExit(child);
+                listener.OnTick(0ms);
+
+                THEN("a new snapshot is written because the finished one misses the skipped ticks") {
+                    CHECK(load_checkpoint_id() == 2);
+                    check_restored_player(pluto_token);
+                }
+            }
+            close(pipe_fds[0]);
+            close(pipe_fds[1]);
+        }
+
+        WHEN("the snapshot started after missed ticks fails") {
+            listener.OnTick(0ms);
+            const auto journal_size = std::filesystem::file_size(journal_path);
+            const auto pluto_token = miss_ticks();
+            pid_t child = -1;
+            forks.push_back([&child] {
+                child = fork();
+                if(child == 0) {
+                    _exit(EXIT_FAILURE);
+                }
+                return child;
+            });
+            listener.OnTick(0ms);
+            WaitForExit(child);
+            session->CommitTick();
+            listener.OnTick(0ms);
+
+            THEN("the journal is left untouched and the snapshot is retried") {
+                CHECK(forks.empty());
+                CHECK(load_checkpoint_id() == 2);
+                CHECK(ReadJournalCheckpointId(journal_path) == 2);
+                CHECK(std::filesystem::file_size(journal_path) == journal_size);
+                check_restored_player(pluto_token);
+            }
+        }
+        std::filesystem::remove(path);
+        std::filesystem::remove(journal_path);
+    }
+}
+SCENARIO("Incremental saving with a save period longer than the change history") {
+    GIVEN("an auto ticking game saved once per MAX_CHANGES_HISTORY + 44 ticks") {
+        using TimeInterval = loot_gen::LootGenerator::TimeInterval;
+        constexpr auto TICK_PERIOD = 50ms;
+        constexpr size_t TICKS_PER_SAVE = GameSession::MAX_CHANGES_HISTORY + 44;
+
+        Map::Id map_id("map_1"s);
+        Map test_map(map_id, "Test_map"s);
+        test_map.AddRoad(Road(model::Road::HORIZONTAL, {0, 0}, 30));
+        test_map.SetDogSpeed(3.0);
+
+        Game game;
+        game.AddMap(test_map);
+        game.SetLootGeneratorConfig(TimeInterval{1000}, 0.0);
+        game.SetAutoTick();
+        Players players(game);
+        PlayerTokens player_tokens;
+        auto& scooby = players.Add(map_id, "Scooby Doo"s);
+        player_tokens.AddPlayer(scooby);
+        auto session = game.FindSession(map_id);
+
+        const auto path = std::filesystem::temp_directory_path() / "long-period-state-test.bin";
+        const auto journal_path = path.string() + ".journal"s;
+        std::filesystem::remove(path);
+        std::filesystem::remove(journal_path);
+
+        int fork_calls = 0;
+        infra::SerializationListener listener(game, players, player_tokens);
+        listener.SetPathToStateFile(path);
+        listener.SetIncremental(true);
+        listener.SetSavePeriod(TICK_PERIOD * TICKS_PER_SAVE);
+        listener.SetForker([&fork_calls] {
+            ++fork_calls;
+            errno = EAGAIN;
+            return pid_t{-1};
+        });
+        listener.OnTick(TICK_PERIOD * TICKS_PER_SAVE);
+        REQUIRE(fork_calls == 1);
+
+        WHEN("a player joins early in the period and the period passes") {
+            auto& pluto = players.Add(map_id, "Pluto"s);
+            const auto pluto_token = player_tokens.AddPlayer(pluto);
+            session->CommitTick();
+            session->FindDog(*scooby.GetPlayerId())->AddScore(12);
+            session->MarkDogChanged(*scooby.GetPlayerId());
+            for(size_t i = 1; i < TICKS_PER_SAVE; ++i) {
+                session->CommitTick();
+                listener.OnTick(TICK_PERIOD);
+            }
+            REQUIRE(std::filesystem::file_size(journal_path) == sizeof(std::uint64_t));
+            session->CommitTick();
+            listener.OnTick(TICK_PERIOD);
+
+            THEN("the changes are journaled instead of writing a full snapshot") {
+                CHECK(fork_calls == 1);
+                CHECK(ReadJournalCheckpointId(journal_path) == 1);
+                CHECK(std::filesystem::file_size(journal_path) > sizeof(std::uint64_t));
+            }
+
+            THEN("the checkpoint with the journal restores the state") {
+                Game restored_game;
+                restored_game.AddMap(test_map);
+                restored_game.SetLootGeneratorConfig(TimeInterval{1000}, 0.0);
+                Players restored_players(restored_game);
+                PlayerTokens restored_tokens;
+                infra::SerializationListener loader(restored_game, restored_players, restored_tokens);
+                loader.SetPathToStateFile(path);
+                REQUIRE(loader.LoadState());
+                const auto restored = restored_game.FindSession(map_id);
+                REQUIRE(restored != nullptr);
+                REQUIRE(restored->GetDogs().size() == 2);
+                for(const auto& [dog_id, dog] : session->GetDogs()) {
+                    CHECK(restored->GetDogs().at(dog_id) == dog);
+                }
+                const auto player = restored_tokens.FindPlayerByToken(pluto_token);
+                REQUIRE(player != nullptr);
+                CHECK(player->GetName() == "Pluto"s);
+            }
+        }
+        std::filesystem::remove(path);
+        std::filesystem::remove(journal_path);
+    }
+}
@@ -0,0 +1,192 @@
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <unistd.h>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include "../src/static_cache.h"
+
+using namespace http_handler;
+using namespace std::literals;
+namespace fs = std::filesystem;
+namespace io = boost::iostreams;
+namespace {
+
+struct TempDirFixture {
+    TempDirFixture()
+        : root{fs::temp_directory_path() / ("static_cache_test_"s + std::to_string(::getpid()))} {
+        fs::remove_all(root);
+        fs::create_directories(root / "js"s);
+    }
+
+    ~TempDirFixture() {
+        fs::remove_all(root);
+    }
+
+    fs::path WriteFile(const fs::path& relative_path, const std::string& content) const {
+        const auto path = root / relative_path;
+        std::ofstream{path, std::ios_base::binary | std::ios_base::trunc} << content;
+        return path;
+    }
+
+    fs::path root;
+};
+
+}  // namespace
+
+SCENARIO_METHOD(TempDirFixture, "Static file cache") {
+    GIVEN("static files and a cache for 10 bytes") {
+        const auto index_path = WriteFile("index.html"s, "<html>"s);
+        const auto script_path = WriteFile("js/app.js"s, "let a;"s);
+        const auto big_path = WriteFile("big.bin"s, "0123456789"s);
+        StaticFileCache cache{10, 8};
+
+        WHEN("a file is loaded") {
+            const auto loaded = cache.Load("/"s, index_path, "text/html"sv);
+
+            THEN("it is returned with its metadata and found by key") {
+                REQUIRE(loaded);
+                CHECK(*loaded->data == "<html>"s);
+                CHECK(loaded->content_type == "text/html"sv);
+                CHECK(loaded->etag.front() == '"');
+                CHECK(loaded->etag.back() == '"');
+                CHECK(loaded->last_modified.ends_with(" GMT"sv));
+                CHECK(cache.Find("/"s) == loaded);
+                CHECK(cache.Find("/index.html"s) == nullptr);
+                CHECK(cache.GetSize() == 6);
+            }
+        }
+
+        WHEN("files do not fit into the cache") {
+            const auto index = cache.Load("/index.html"s, index_path, "text/html"sv);
+            const auto script = cache.Load("/js/app.js"s, script_path, "text/javascript"sv);
+
+            THEN("the least recently used file is evicted") {
+                CHECK(cache.Find("/index.html"s) == nullptr);
+                CHECK(cache.Find("/js/app.js"s) == script);
+                CHECK(cache.GetSize() == 6);
+                // Вытесненный файл остаётся доступен ответам, которые его уже получили
+                CHECK(*index->data == "<html>"s);
+            }
+        }
+
+        WHEN("a file is larger than the cached file limit") {
+            THEN("it is not cached") {
+                CHECK(cache.Load("/big.bin"s, big_path, "application/octet-stream"sv) == nullptr);
+                CHECK(cache.Find("/big.bin"s) == nullptr);
+                CHECK(cache.GetSize() == 0);
+            }
+        }
+
+        WHEN("the cache is cleared") {
+            cache.Load("/index.html"s, index_path, "text/html"sv);
+            cache.Clear();
+
+            THEN("files are loaded again") {
+                CHECK(cache.Find("/index.html"s) == nullptr);
+                CHECK(cache.GetSize() == 0);
+            }
+        }
+    }
+
+    GIVEN("a large script with a precompressed brotli sibling") {
+        std::string script;
+        for (int i = 0; i < 200; ++i) {
+            script += "console.log('line "s + std::to_string(i) + "');\n"s;
+        }
+        const auto script_path = WriteFile("js/three.js"s, script);
+        WriteFile("js/three.js.br"s, "brotli bytes"s);
+        StaticFileCache cache;
+
+        WHEN("it is loaded") {
+            const auto file = cache.Load("/js/three.js"s, script_path, "text/javascript"sv);
+            REQUIRE(file);
+
+            THEN("the brotli variant is read and the gzip variant is compressed in memory") {
+                REQUIRE(file->brotli_data);
+                CHECK(*file->brotli_data == "brotli bytes"s);
+                REQUIRE(file->gzip_data);
+                CHECK(file->gzip_data->size() < script.size());
+
+                std::string decompressed;
+                {
+                    io::filtering_ostream out;
+                    out.push(io::gzip_decompressor());
+                    out.push(io::back_inserter(decompressed));
+                    out.write(file->gzip_data->data(), file->gzip_data->size());
+                }
+                CHECK(decompressed == script);
+                CHECK(cache.GetSize() == file->GetTotalSize());
+            }
+
+            THEN("every variant has its own ETag") {
+                CHECK(file->GetETag(ContentEncoding::IDENTITY) == file->etag);
+                CHECK(file->GetETag(ContentEncoding::GZIP) != file->etag);
+                CHECK(file->GetETag(ContentEncoding::GZIP).ends_with("-gzip\""sv));
+                CHECK(file->GetETag(ContentEncoding::BROTLI).ends_with("-br\""sv));
+            }
+        }
+
+        THEN("a sibling is used only for an unchanged file") {
+            CHECK(HasEncodedSibling(script_path, ContentEncoding::BROTLI));
+            CHECK_FALSE(HasEncodedSibling(script_path, ContentEncoding::GZIP));
+            fs::last_write_time(script_path, fs::last_write_time(script_path) + 1h);
+            CHECK_FALSE(HasEncodedSibling(script_path, ContentEncoding::BROTLI));
+        }
+    }
+
+    GIVEN("a cache watching the static directory") {
+        const auto script_path = WriteFile("js/app.js"s, "let a;"s);
+        StaticFileCache cache;
+        cache.WatchDirectory(root);
+        REQUIRE(cache.Load("/js/app.js"s, script_path, "text/javascript"sv));
+
+        WHEN("a file in a subdirectory changes") {
+            WriteFile("js/app.js"s, "let b;"s);
+
+            THEN("the cache is cleared") {
+                bool is_cleared = false;
+                for (int attempt = 0; attempt < 200 && !is_cleared; ++attempt) {
+                    is_cleared = cache.Find("/js/app.js"s) == nullptr;
+                    std::this_thread::sleep_for(5ms);
+                }
+                CHECK(is_cleared);
+                const auto reloaded = cache.Load("/js/app.js"s, script_path, "text/javascript"sv);
+                REQUIRE(reloaded);
+                CHECK(*reloaded->data == "let b;"s);
+            }
+        }
+    }
+}
+
+SCENARIO("Accept-Encoding negotiation") {
+    WHEN("the client accepts both compressed variants") {
+        THEN("brotli is preferred") {
+            CHECK(ChooseContentEncoding("gzip, deflate, br"sv, true, true) == ContentEncoding::BROTLI);
+            CHECK(ChooseContentEncoding("gzip, deflate, br"sv, true, false) == ContentEncoding::GZIP);
+            CHECK(ChooseContentEncoding("gzip, deflate, br"sv, false, false) == ContentEncoding::IDENTITY);
+        }
+    }
+
+    WHEN("weights are given") {
+        THEN("the encoding with the higher weight wins and q=0 is refused") {
+            CHECK(ChooseContentEncoding("br;q=0.5, gzip"sv, true, true) == ContentEncoding::GZIP);
+            CHECK(ChooseContentEncoding("br;q=0, gzip;q=0"sv, true, true) == ContentEncoding::IDENTITY);
+            CHECK(ChooseContentEncoding("GZIP ; q=0.8"sv, true, true) == ContentEncoding::GZIP);
+        }
+    }
+
+    WHEN("the header is missing or uses a wildcard") {
+        THEN("a wildcard accepts encodings that are not listed") {
+            CHECK(ChooseContentEncoding(""sv, true, true) == ContentEncoding::IDENTITY);
+            CHECK(ChooseContentEncoding("identity"sv, true, true) == ContentEncoding::IDENTITY);
+            CHECK(ChooseContentEncoding("*"sv, true, false) == ContentEncoding::GZIP);
+            CHECK(ChooseContentEncoding("*, br;q=0"sv, true, true) == ContentEncoding::GZIP);
+        }
+    }
+}